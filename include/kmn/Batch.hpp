@@ -0,0 +1,332 @@
+#ifndef KMN_BATCH_HPP
+#define KMN_BATCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <kmn/K_means.hpp>
+#include <kmn/Workspace.hpp>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+// Batched k_means over many small independent datasets, e.g. one per user
+// or per tile. Their points are packed into one arena, the problems are
+// handed out to the threads largest first, and each thread runs its
+// problems sequentially through one workspace, so that past the first
+// few problems, runs make no heap allocation. Centroids, ids and sizes
+// of every problem come back in flat arrays.
+
+namespace kmn {
+
+// problem_batch: Datasets of dims-dimensional points of T, each with its
+//                own k, packed row-major one after the other
+template<arithmetic T>
+class problem_batch
+{
+  size_type m_dims;
+  std::vector<T> m_values;
+  // Problem p's points are rows [m_offsets[p], m_offsets[p + 1])
+  std::vector<size_type> m_offsets{ 0 };
+  std::vector<size_type> m_ks;
+
+public:
+  using value_type = T;
+
+  explicit problem_batch(size_type dims) noexcept : m_dims{ dims } { }
+
+  // reserve: Sizes the arena for problems holding points in total
+  void reserve(size_type problems, size_type points)
+  {
+    m_values.reserve(points * m_dims);
+    m_offsets.reserve(problems + 1);
+    m_ks.reserve(problems);
+  }
+
+  // add: Appends the points of a matrix source of dims columns, or the
+  //      row-major values of a span, a whole number of rows of dims, as
+  //      a problem of k clusters, and returns its index
+  auto add(hlpr::matrix_source auto const& points, size_type k) -> size_type
+  {
+    assert(static_cast<size_type>(points.cols()) == m_dims);
+    auto const rows = static_cast<size_type>(points.rows());
+    auto const first = m_values.size();
+    m_values.resize(first + rows * m_dims);
+    if(rows > 0) points.load(0, rows, m_values.data() + first);
+    return push(rows, k);
+  }
+
+  auto add(std::span<T const> values, size_type k) -> size_type
+  {
+    assert(values.size() % m_dims == 0);
+    m_values.insert(m_values.end(), values.begin(), values.end());
+    return push(values.size() / m_dims, k);
+  }
+
+  // add: Appends a range of DataPoints of dims coordinates as a problem
+  template<hlpr::data_points_range R>
+  auto add(R const& points, size_type k) -> size_type
+  {
+    size_type rows{};
+    for(auto const& pt: points) //
+    {
+      assert(pt.size() == m_dims);
+      for(size_type d{}; d < pt.size(); ++d) //
+      { m_values.push_back(static_cast<T>(pt[d])); }
+      ++rows;
+    }
+    return push(rows, k);
+  }
+
+  // clang-format off
+  [[nodiscard]] auto size() const noexcept { return m_ks.size(); }
+  [[nodiscard]] auto dims() const noexcept { return m_dims; }
+  [[nodiscard]] auto points() const noexcept { return m_offsets.back(); }
+
+  [[nodiscard]] auto k(size_type p) const noexcept { return m_ks[p]; }
+
+  [[nodiscard]] auto offsets() const noexcept -> std::span<size_type const>
+  { return m_offsets; }
+
+  // problem: The points of the p-th problem, viewing the arena
+  [[nodiscard]] auto problem(size_type p) const noexcept -> matrix_view<T>
+  {
+    return { m_values.data() + m_offsets[p] * m_dims,
+             m_offsets[p + 1] - m_offsets[p], m_dims };
+  }
+
+private:
+  auto push(size_type rows, size_type k) -> size_type
+  {
+    m_offsets.push_back(m_offsets.back() + rows);
+    m_ks.push_back(k);
+    return m_ks.size() - 1;
+  }
+  // clang-format on
+};
+
+// batch_k_means_result: What k_means_batch found, every problem's results
+//                       laid out one after the other
+template<std::floating_point V>
+struct batch_k_means_result
+{
+  size_type dims{};
+  // Problem p's points are rows [point_offsets[p], point_offsets[p + 1])
+  // of the batch, and out_indices[i] is the 1-based id, within its
+  // problem, of the centroid the i-th row was assigned to
+  std::vector<size_type> point_offsets{};
+  std::vector<size_type> out_indices{};
+  // Problem p owns the k slots [centroid_offsets[p],
+  // centroid_offsets[p + 1]) of cluster_sizes and cluster_sse, and their
+  // rows of centroids, of which its first clusters[p] are in use; fewer
+  // than k when options.empty_clusters dropped some
+  std::vector<size_type> centroid_offsets{};
+  std::vector<size_type> clusters{};
+  std::vector<V> centroids{};
+  std::vector<size_type> cluster_sizes{};
+  std::vector<double> cluster_sse{};
+  // One per problem
+  std::vector<double> inertia{};
+  std::vector<convergence_report> convergence{};
+  // Empty unless kmn was compiled with KMN_INSTRUMENTATION
+  run_profile profile{};
+
+  // clang-format off
+  [[nodiscard]] auto size() const noexcept { return inertia.size(); }
+
+  [[nodiscard]] auto centroids_of(size_type p) const noexcept
+  -> std::span<V const>
+  {
+    return std::span<V const>{ centroids }.subspan(
+    centroid_offsets[p] * dims, clusters[p] * dims);
+  }
+
+  [[nodiscard]] auto out_indices_of(size_type p) const noexcept
+  -> std::span<size_type const>
+  {
+    return std::span<size_type const>{ out_indices }.subspan(
+    point_offsets[p], point_offsets[p + 1] - point_offsets[p]);
+  }
+
+  [[nodiscard]] auto cluster_sizes_of(size_type p) const noexcept
+  -> std::span<size_type const>
+  {
+    return std::span<size_type const>{ cluster_sizes }.subspan(
+    centroid_offsets[p], clusters[p]);
+  }
+  // clang-format on
+};
+
+template<typename T>
+using batch_centroid_value_t = matrix_centroid_value_t<matrix_view<T>>;
+
+namespace hlpr {
+  // batch_order: Problems by decreasing cost, their points times k, so
+  //              that the threads finish on small ones; ties keep their
+  //              order
+  template<typename T>
+  [[nodiscard]] auto batch_order(problem_batch<T> const& batch)
+  -> std::vector<size_type>
+  {
+    auto const cost = [&](size_type p)
+    { return batch.problem(p).rows() * batch.k(p); };
+
+    std::vector<size_type> order(batch.size());
+    std::iota(order.begin(), order.end(), size_type{ 0 });
+    std::ranges::stable_sort(order, [&](size_type a, size_type b)
+                             { return cost(a) > cost(b); });
+    return order;
+  }
+} // namespace hlpr
+
+// k_means_batch_impl: Runs every problem of the batch in a workspace of
+//                     its thread. Problem p is seeded with the seed of
+//                     options plus p, so that the results don't depend
+//                     on the threads; options.weights, when given, hold
+//                     one weight per row of the batch.
+template<typename T>
+auto k_means_batch_impl(auto const& policy,
+                        problem_batch<T> const& batch,
+                        k_means_options const& options)
+-> batch_k_means_result<batch_centroid_value_t<T>>
+{
+  using value_t = batch_centroid_value_t<T>;
+  hlpr::profiler prof;
+  hlpr::profile_scope const profiling{ &prof };
+
+  auto const n_problems = batch.size();
+  auto const dims = batch.dims();
+  auto const base_seed = options.seeding.seed.value_or(
+  (std::uint64_t{ std::random_device{}() } << 32U) | std::random_device{}());
+
+  batch_k_means_result<value_t> result{
+    .dims = dims,
+    .point_offsets = std::vector<size_type>(batch.offsets().begin(),
+                                            batch.offsets().end()),
+    .out_indices = std::vector<size_type>(batch.points()),
+    .centroid_offsets = std::vector<size_type>(n_problems + 1),
+    .clusters = std::vector<size_type>(n_problems),
+    .inertia = std::vector<double>(n_problems),
+    .convergence = std::vector<convergence_report>(n_problems)
+  };
+  for(size_type p{}; p < n_problems; ++p) //
+  {
+    result.centroid_offsets[p + 1] =
+    result.centroid_offsets[p] + batch.k(p);
+  }
+  auto const slots = result.centroid_offsets.back();
+  result.centroids.resize(slots * dims);
+  result.cluster_sizes.resize(slots);
+  result.cluster_sse.resize(slots);
+
+  size_type n_threads{ 1 };
+  if constexpr(std::same_as<std::remove_cvref_t<decltype(policy)>,
+                            parallel_policy>)
+  { n_threads = std::clamp(n_problems, size_type{ 1 }, policy.threads()); }
+
+  // Threads claim the next problem in order, each one writing its own
+  // slices of the result
+  auto const order = hlpr::batch_order(batch);
+  std::atomic<size_type> next{ 0 };
+
+  hlpr::run_on_threads(
+  n_threads,
+  [&](size_type)
+  {
+    workspace<value_t> ws;
+    auto run_options = options;
+    run_options.n_init = 1;
+
+    for(auto i = next++; i < n_problems; i = next++) //
+    {
+      auto const p = order[i];
+      auto const first_row = result.point_offsets[p];
+      auto const rows = result.point_offsets[p + 1] - first_row;
+      run_options.seeding.seed = base_seed + p;
+      if(not options.weights.empty())
+      { run_options.weights = options.weights.subspan(first_row, rows); }
+
+      // The problems were checked by k_means_batch
+      auto const found =
+      *ws.run(batch.problem(p),
+              std::span{ result.out_indices }.subspan(first_row, rows),
+              batch.k(p), run_options);
+
+      auto const slot = result.centroid_offsets[p];
+      auto const clusters = found.cluster_sizes.size();
+      stdr::copy(found.centroids,
+                 result.centroids.begin()
+                 + static_cast<std::ptrdiff_t>(slot * dims));
+      stdr::copy(found.cluster_sizes,
+                 result.cluster_sizes.begin()
+                 + static_cast<std::ptrdiff_t>(slot));
+      stdr::copy(found.cluster_sse,
+                 result.cluster_sse.begin()
+                 + static_cast<std::ptrdiff_t>(slot));
+      result.clusters[p] = clusters;
+      result.inertia[p] = std::accumulate(found.cluster_sse.begin(),
+                                          found.cluster_sse.end(), 0.0);
+      result.convergence[p] = found.convergence;
+    }
+  });
+
+  result.profile = prof.take();
+  return result;
+}
+
+// clang-format off
+struct k_means_batch_fn
+{
+  // Runs k_means on every problem of the batch, with the options of
+  // config and the problem's own k. Under a parallel_policy, problems
+  // run concurrently, each on a single thread, and on_iteration is
+  // called from all of them. options.n_init is ignored.
+  template<typename T>
+  [[nodiscard]]
+  auto operator()(problem_batch<T> const& batch,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<batch_k_means_result<batch_centroid_value_t<T>>>
+  { return (*this)(seq, batch, config); }
+
+  template<typename T>
+  [[nodiscard]]
+  auto operator()(hlpr::execution_policy auto policy,
+                  problem_batch<T> const& batch,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<batch_k_means_result<batch_centroid_value_t<T>>>
+  {
+    auto const options = hlpr::to_options(config);
+    if(not valid_batch(batch, options)) return std::nullopt;
+
+    return k_means_batch_impl(policy, batch, options);
+  }
+
+private:
+  template<typename T>
+  [[nodiscard]] static
+  auto valid_batch(problem_batch<T> const& batch,
+                   k_means_options const& options) noexcept -> bool
+  {
+    if(batch.dims() == 0) return false;
+    for(size_type p{}; p < batch.size(); ++p) {
+      if(batch.k(p) < 2 or batch.problem(p).rows() < batch.k(p))
+      { return false; }
+    }
+    return hlpr::valid_weights(options, batch.points())
+           and hlpr::valid_seeding(options);
+  }
+};
+
+// clang-format on
+// k_means_batch: Callable object running k_means over a problem_batch;
+//                empty if a problem has k < 2 or fewer points than k,
+//                or if the weights don't match the batch's rows
+constexpr inline k_means_batch_fn k_means_batch{};
+
+} // namespace kmn
+
+#endif
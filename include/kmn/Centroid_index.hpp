@@ -0,0 +1,444 @@
+#ifndef KMN_CENTROID_INDEX_HPP
+#define KMN_CENTROID_INDEX_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <kmn/Distance_kernels.hpp>
+#include <limits>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Spatial indexes over the centroids, for passes whose k is large enough
+// that walking a tree costs less than measuring every centroid. A k-d
+// tree (Friedman, Bentley and Finkel) splits boxes on their widest
+// dimension; a ball tree (Omohundro) splits balls along the direction of
+// their two farthest centroids, and holds up better on points without
+// cluster structure in a dozen dimensions or more. Both
+// bucket the centroids into leaves laid out like a centroid_block, which
+// the kernels of Distance_kernels.hpp measure one lane per centroid: a
+// leaf yields the very distances a block of all k centroids would, so
+// that a search returns the centroid brute force would, the first one
+// on ties.
+
+namespace kmn {
+
+using size_type = std::size_t;
+
+// centroid_tree: How a centroid_index partitions the centroids
+enum class centroid_tree
+{
+  kd_tree, // Axis-aligned boxes, halved on their widest dimension
+  ball_tree // Balls around the mean of their centroids
+};
+
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(centroid_tree tree) noexcept -> std::string_view
+{
+  switch(tree) {
+    case centroid_tree::kd_tree: return "kd_tree";
+    case centroid_tree::ball_tree: return "ball_tree";
+  }
+  return "unknown";
+}
+
+// clang-format on
+// centroid_index: k centroids of dims coordinates in a k-d or a ball tree,
+//                 rebuilt by assign() and assign_rows() whenever they
+//                 move. Offers the nearest() of a centroid_block, whose
+//                 distances buffer holds stride() elements: the total
+//                 width of the leaves, at least k. Searches are const and
+//                 may run concurrently.
+template<std::floating_point V>
+class centroid_index
+{
+public:
+  // Centroids of a leaf, at most; a leaf holds at least half as many
+  static constexpr size_type leaf_size = 2 * simd::lanes_per_line<V>;
+
+private:
+  struct node
+  {
+    // Its centroids are m_order[first, first + count)
+    size_type first{};
+    size_type count{};
+    // Children, both 0 in leaves, as the root is no one's child
+    size_type left{};
+    size_type right{};
+    // Leaves: first lane of their distances, their width, a whole
+    // number of cache lines, and the offset of their block in m_soa
+    size_type lane{};
+    size_type width{};
+    size_type soa{};
+    // Ball trees: radius of the ball, widened to cover rounding
+    double radius{};
+  };
+
+  struct match
+  {
+    size_type index;
+    V distance;
+  };
+
+  size_type m_k;
+  size_type m_dims;
+  centroid_tree m_tree;
+  // Row-major copy of the centroids the tree was built from
+  std::vector<V> m_rows;
+  std::vector<size_type> m_order;
+  std::vector<double> m_keys;
+  std::vector<node> m_nodes;
+  // 2 * dims values per node: the box's lower then upper corner in k-d
+  // trees, the ball's center in ball trees
+  std::vector<double> m_bounds;
+  std::vector<V> m_soa;
+  size_type m_stride{};
+  // Lower bounds are scaled down by it before pruning a subtree, so that
+  // the kernels' rounding cannot hide a centroid nearer than the best
+  double m_margin{};
+  simd::isa m_isa;
+  simd::sqr_distances_fn<V> m_kernel;
+  simd::sqr_distances_fn<V> m_dims_kernel;
+
+  [[nodiscard]] auto row(size_type c) const noexcept -> V const*
+  { return m_rows.data() + c * m_dims; }
+
+  [[nodiscard]] static auto width_of(size_type count) noexcept -> size_type
+  {
+    constexpr auto lanes = simd::lanes_per_line<V>;
+    return (count + lanes - 1) / lanes * lanes;
+  }
+
+  // bound: Box or ball of the centroids of node n
+  void bound(size_type n)
+  {
+    auto& nd = m_nodes[n];
+    auto* bounds = m_bounds.data() + n * 2 * m_dims;
+    auto const members = std::span{ m_order }.subspan(nd.first, nd.count);
+
+    if(m_tree == centroid_tree::kd_tree) {
+      std::fill_n(bounds, m_dims, std::numeric_limits<double>::infinity());
+      std::fill_n(bounds + m_dims, m_dims,
+                  -std::numeric_limits<double>::infinity());
+      for(auto const c: members) //
+      {
+        for(size_type d{}; d < m_dims; ++d) //
+        {
+          auto const coord = static_cast<double>(row(c)[d]);
+          bounds[d] = std::min(bounds[d], coord);
+          bounds[m_dims + d] = std::max(bounds[m_dims + d], coord);
+        }
+      }
+      return;
+    }
+
+    std::fill_n(bounds, m_dims, 0.0);
+    for(auto const c: members) //
+    {
+      for(size_type d{}; d < m_dims; ++d) //
+      { bounds[d] += static_cast<double>(row(c)[d]); }
+    }
+    double center_norm{};
+    for(size_type d{}; d < m_dims; ++d) //
+    {
+      bounds[d] /= static_cast<double>(nd.count);
+      center_norm += bounds[d] * bounds[d];
+    }
+    double radius{};
+    for(auto const c: members) //
+    { radius = std::max(radius, distance_to_center(n, row(c))); }
+    // The distances to the center are rounded, possibly down
+    nd.radius = radius + 1e-9 * (radius + std::sqrt(center_norm));
+  }
+
+  [[nodiscard]] auto distance_to_center(size_type n, V const* pt) const
+  noexcept -> double
+  {
+    auto const* center = m_bounds.data() + n * 2 * m_dims;
+    double sum{};
+    for(size_type d{}; d < m_dims; ++d) //
+    {
+      auto const diff = static_cast<double>(pt[d]) - center[d];
+      sum += diff * diff;
+    }
+    return std::sqrt(sum);
+  }
+
+  // lower_bound: Squared distance from pt to node n's box or ball, which
+  //              none of its centroids is nearer than
+  [[nodiscard]] auto lower_bound(size_type n, V const* pt) const noexcept
+  -> double
+  {
+    if(m_tree == centroid_tree::ball_tree) {
+      auto const gap = distance_to_center(n, pt) - m_nodes[n].radius;
+      return gap > 0.0 ? gap * gap : 0.0;
+    }
+
+    auto const* lower = m_bounds.data() + n * 2 * m_dims;
+    auto const* upper = lower + m_dims;
+    double sum{};
+    for(size_type d{}; d < m_dims; ++d) //
+    {
+      auto const coord = static_cast<double>(pt[d]);
+      auto const gap = std::max({ lower[d] - coord, coord - upper[d], 0.0 });
+      sum += gap * gap;
+    }
+    return sum;
+  }
+
+  // split: Builds the subtree of the centroids m_order[first, first +
+  //        count) and returns its root. Nodes are halved at the median of
+  //        their centroids along the widest dimension of their box, or
+  //        along the line through the centroid farthest from their
+  //        center and the one farthest from it.
+  auto split(size_type first, size_type count) -> size_type
+  {
+    auto const n = m_nodes.size();
+    m_nodes.push_back({ .first = first, .count = count });
+    m_bounds.resize(m_bounds.size() + 2 * m_dims);
+    bound(n);
+
+    auto const members = std::span{ m_order }.subspan(first, count);
+    if(count <= leaf_size) {
+      auto& leaf = m_nodes[n];
+      leaf.lane = m_stride;
+      leaf.width = width_of(count);
+      leaf.soa = m_soa.size();
+      m_soa.resize(m_soa.size() + leaf.width * m_dims);
+      for(size_type j{}; j < count; ++j) //
+      {
+        for(size_type d{}; d < m_dims; ++d) //
+        { m_soa[leaf.soa + d * leaf.width + j] = row(members[j])[d]; }
+      }
+      m_stride += leaf.width;
+      return n;
+    }
+
+    if(m_tree == centroid_tree::kd_tree) {
+      auto const* lower = m_bounds.data() + n * 2 * m_dims;
+      auto const* upper = lower + m_dims;
+      size_type widest{};
+      for(size_type d{ 1 }; d < m_dims; ++d) //
+      {
+        if(upper[d] - lower[d] > upper[widest] - lower[widest]) widest = d;
+      }
+      for(auto const c: members) //
+      { m_keys[c] = static_cast<double>(row(c)[widest]); }
+    } else {
+      auto const farthest_from = [&](auto&& distance)
+      {
+        return *std::ranges::max_element(
+        members, {}, [&](size_type c) { return distance(row(c)); });
+      };
+      auto const a = farthest_from([&](V const* pt)
+                                   { return distance_to_center(n, pt); });
+      auto const b = farthest_from(
+      [&](V const* pt)
+      {
+        double sum{};
+        for(size_type d{}; d < m_dims; ++d) //
+        {
+          auto const diff =
+          static_cast<double>(pt[d]) - static_cast<double>(row(a)[d]);
+          sum += diff * diff;
+        }
+        return sum;
+      });
+      for(auto const c: members) //
+      {
+        double key{};
+        for(size_type d{}; d < m_dims; ++d) //
+        {
+          key += static_cast<double>(row(c)[d])
+                 * (static_cast<double>(row(b)[d])
+                    - static_cast<double>(row(a)[d]));
+        }
+        m_keys[c] = key;
+      }
+    }
+
+    auto const half = count / 2;
+    std::ranges::nth_element(members, members.begin()
+                                      + static_cast<std::ptrdiff_t>(half),
+                             {}, [&](size_type c) { return m_keys[c]; });
+    auto const left = split(first, half);
+    auto const right = split(first + half, count - half);
+    m_nodes[n].left = left;
+    m_nodes[n].right = right;
+    return n;
+  }
+
+  void build()
+  {
+    m_order.resize(m_k);
+    std::iota(m_order.begin(), m_order.end(), size_type{});
+    m_keys.resize(m_k);
+    m_nodes.clear();
+    m_bounds.clear();
+    m_soa.clear();
+    m_stride = 0;
+    if(m_k != 0) split(0, m_k);
+  }
+
+  // search: Looks for a centroid nearer to pt than best in the subtree of
+  //         node n, nearer child first; slice is 0 for whole distances,
+  //         else the dimensions of the partial ones summed. Adds the
+  //         centroids of the leaves it measures to measured.
+  void search(size_type n, V const* pt, size_type slice, V* distances,
+              V* partial, match& best, size_type& measured) const noexcept
+  {
+    auto const& nd = m_nodes[n];
+    if(nd.left == 0) {
+      measured += nd.count;
+      auto* out = distances + nd.lane;
+      auto const* soa = m_soa.data() + nd.soa;
+      if(slice == 0) {
+        m_dims_kernel(pt, soa, m_dims, nd.width, out);
+      } else {
+        for(size_type d0{}; d0 < m_dims; d0 += slice) //
+        {
+          auto const n_dims = std::min(slice, m_dims - d0);
+          if(d0 == 0) {
+            m_kernel(pt, soa, n_dims, nd.width, out);
+          } else {
+            m_kernel(pt + d0, soa + d0 * nd.width, n_dims, nd.width, partial);
+            for(size_type j{}; j < nd.width; ++j) out[j] += partial[j];
+          }
+        }
+      }
+      for(size_type j{}; j < nd.count; ++j) //
+      {
+        auto const c = m_order[nd.first + j];
+        if(out[j] < best.distance
+           or (out[j] == best.distance and c < best.index))
+        { best = { c, out[j] }; }
+      }
+      return;
+    }
+
+    auto near = nd.left;
+    auto far = nd.right;
+    auto near_bound = lower_bound(near, pt);
+    auto far_bound = lower_bound(far, pt);
+    if(far_bound < near_bound) {
+      std::swap(near, far);
+      std::swap(near_bound, far_bound);
+    }
+    if(not prunes(near_bound, best)) {
+      search(near, pt, slice, distances, partial, best, measured);
+    }
+    if(not prunes(far_bound, best)) {
+      search(far, pt, slice, distances, partial, best, measured);
+    }
+  }
+
+  [[nodiscard]] auto prunes(double bound, match const& best) const noexcept
+  -> bool
+  { return bound * m_margin > static_cast<double>(best.distance); }
+
+  [[nodiscard]] auto find(V const* pt, size_type slice, V* distances,
+                          V* partial, size_type& measured) const noexcept
+  -> size_type
+  {
+    match best{ m_k, std::numeric_limits<V>::infinity() };
+    if(m_k != 0) search(0, pt, slice, distances, partial, best, measured);
+    if(best.index == m_k) { // Every distance is NaN, as is the first one
+      best = { 0, std::numeric_limits<V>::quiet_NaN() };
+    }
+    distances[best.index] = best.distance;
+    return best.index;
+  }
+
+public:
+  centroid_index(size_type k, size_type dims,
+                 centroid_tree tree = centroid_tree::kd_tree,
+                 simd::isa set = simd::active_isa())
+  : m_k{ k },
+    m_dims{ dims },
+    m_tree{ tree },
+    m_rows(k * dims),
+    m_isa{ set },
+    m_kernel{ simd::sqr_distances_kernel<V>(set) },
+    m_dims_kernel{ simd::sqr_distances_kernel<V>(set, dims) }
+  {
+    reshape(k, dims, tree);
+  }
+
+  // clang-format off
+  [[nodiscard]] auto size() const noexcept -> size_type { return m_k; }
+  [[nodiscard]] auto dims() const noexcept -> size_type { return m_dims; }
+  [[nodiscard]] auto tree() const noexcept -> centroid_tree { return m_tree; }
+  // Length of the distances buffer nearest() needs
+  [[nodiscard]] auto stride() const noexcept -> size_type { return m_stride; }
+
+  // clang-format on
+  // reshape: Resizes the index for k centroids of dims coordinates, all
+  //          zero until assigned, reusing its storage when large enough
+  void reshape(size_type k, size_type dims, centroid_tree tree)
+  {
+    m_k = k;
+    m_dims = dims;
+    m_tree = tree;
+    m_rows.assign(k * dims, V{});
+    m_dims_kernel = simd::sqr_distances_kernel<V>(m_isa, dims);
+    // A kernel's squared distance over dims dimensions is within a
+    // relative (dims + 2) epsilon of the exact one, give or take
+    auto const eps = static_cast<double>(std::numeric_limits<V>::epsilon());
+    m_margin = std::max(0.0, 1.0 - 2.0 * static_cast<double>(dims + 4) * eps);
+    build();
+  }
+
+  void reshape(size_type k, size_type dims) { reshape(k, dims, m_tree); }
+
+  // assign: Rebuilds the tree over a range of k centroids,
+  //         each indexable by dimension
+  void assign(std::ranges::sized_range auto const& centroids)
+  {
+    size_type c{};
+    for(auto const& centroid: centroids) //
+    {
+      for(size_type d{}; d < m_dims; ++d) //
+      { m_rows[c * m_dims + d] = static_cast<V>(centroid[d]); }
+      ++c;
+    }
+    build();
+  }
+
+  // assign_rows: Rebuilds the tree over k centroids stored row-major
+  void assign_rows(V const* rows)
+  {
+    std::copy_n(rows, m_k * m_dims, m_rows.begin());
+    build();
+  }
+
+  // nearest: Index of the centroid nearest to pt, the first one on ties,
+  //          whose squared distance is left in distances[index]
+  [[nodiscard]] auto nearest(V const* pt, V* distances) const noexcept
+  -> size_type
+  {
+    size_type measured{};
+    return find(pt, 0, distances, nullptr, measured);
+  }
+
+  // nearest: Same, adding the distances the search measured to measured
+  [[nodiscard]] auto nearest(V const* pt, V* distances,
+                             size_type& measured) const noexcept -> size_type
+  { return find(pt, 0, distances, nullptr, measured); }
+
+  // nearest: Same, the distances being sums of partial ones over slices
+  //          of slice dimensions, as centroid_block::sqr_distances over
+  //          each slice would add them up; partial must hold leaf_size
+  //          elements
+  [[nodiscard]] auto nearest(V const* pt, size_type slice, V* distances,
+                             V* partial, size_type& measured) const noexcept
+  -> size_type
+  { return find(pt, slice, distances, partial, measured); }
+};
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef KMN_COMPACT_STORAGE_HPP
+#define KMN_COMPACT_STORAGE_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <kmn/Matrix_view.hpp>
+#include <limits>
+#include <ranges>
+#include <span>
+#include <vector>
+
+// Points stored in fewer bytes than a float: IEEE half precision
+// (float16), bfloat16, or int8 codes with a scale and an offset per
+// dimension. The views below are matrix sources whose value_type is
+// float, so that k_means reads them as it reads a matrix_view<float>:
+// rows are decoded to float a tile at a time, distances and sums are
+// computed on the decoded tiles, and centroids are floats. Only the
+// stored points shrink, which is what each assignment pass reads.
+
+namespace kmn {
+
+// float16: IEEE 754 binary16 storage, 5 exponent and 10 mantissa bits;
+//          values beyond ±65504 round to infinities
+struct float16
+{
+  std::uint16_t bits{};
+
+  float16() = default;
+
+  // Rounds to nearest, ties to even
+  constexpr explicit float16(float value) noexcept
+  {
+    auto u = std::bit_cast<std::uint32_t>(value);
+    auto const sign = static_cast<std::uint16_t>((u >> 16U) & 0x8000U);
+    u &= 0x7FFF'FFFFU;
+
+    if(u >= 0x4780'0000U) { // 2^16 and above, infinities and NaNs
+      bits = u > 0x7F80'0000U ? 0x7E00U : 0x7C00U;
+    } else if(u < 0x3880'0000U) { // Below 2^-14, subnormal
+      // Adding 0.5 aligns the 10 mantissa bits to the bottom
+      // of the float, rounding them as the addition rounds
+      constexpr auto magic = 0x3F00'0000U;
+      u = std::bit_cast<std::uint32_t>(std::bit_cast<float>(u)
+                                       + std::bit_cast<float>(magic))
+          - magic;
+      bits = static_cast<std::uint16_t>(u);
+    } else {
+      auto const odd = (u >> 13U) & 1U;
+      u += 0xC800'0FFFU + odd; // Rebias the exponent, then round
+      bits = static_cast<std::uint16_t>(u >> 13U);
+    }
+    bits = static_cast<std::uint16_t>(bits | sign);
+  }
+
+  [[nodiscard]] constexpr explicit operator float() const noexcept
+  {
+    auto const sign = std::uint32_t{ bits & 0x8000U } << 16U;
+    auto const u = std::uint32_t{ bits & 0x7FFFU } << 13U;
+    auto const exponent = u & 0x0F80'0000U;
+    if(exponent == 0x0F80'0000U) // Infinities and NaNs
+    { return std::bit_cast<float>(sign | (u + 0x7000'0000U)); }
+    if(exponent == 0) { // Zeros and subnormals, renormalized
+      constexpr auto magic = 0x3880'0000U; // 2^-14
+      auto const f = std::bit_cast<float>(u + magic)
+                     - std::bit_cast<float>(magic);
+      return std::bit_cast<float>(sign | std::bit_cast<std::uint32_t>(f));
+    }
+    return std::bit_cast<float>(sign | (u + 0x3800'0000U));
+  }
+};
+
+// bfloat16: The upper half of a float, 8 exponent and 7 mantissa bits;
+//           same range as float, with about 3 significant digits
+struct bfloat16
+{
+  std::uint16_t bits{};
+
+  bfloat16() = default;
+
+  // Rounds to nearest, ties to even
+  constexpr explicit bfloat16(float value) noexcept
+  {
+    auto const u = std::bit_cast<std::uint32_t>(value);
+    if((u & 0x7FFF'FFFFU) > 0x7F80'0000U) { // Quiet NaNs stay NaNs
+      bits = static_cast<std::uint16_t>((u >> 16U) | 0x0040U);
+    } else {
+      bits = static_cast<std::uint16_t>(
+      (u + 0x7FFFU + ((u >> 16U) & 1U)) >> 16U);
+    }
+  }
+
+  [[nodiscard]] constexpr explicit operator float() const noexcept
+  { return std::bit_cast<float>(std::uint32_t{ bits } << 16U); }
+};
+
+namespace hlpr {
+  template<typename S>
+  concept half_storage = std::same_as<S, float16> or std::same_as<S, bfloat16>;
+} // namespace hlpr
+
+// compact_row: A row of a compact_view, decoded on access
+template<hlpr::half_storage S>
+class compact_row
+{
+  S const* m_values{};
+  size_type m_cols{};
+
+public:
+  using value_type = float;
+
+  compact_row() = default;
+  constexpr compact_row(S const* values, size_type cols) noexcept
+  : m_values{ values }, m_cols{ cols }
+  { }
+
+  // clang-format off
+  [[nodiscard]] constexpr auto size() const noexcept { return m_cols; }
+
+  [[nodiscard]] constexpr auto operator[](size_type d) const noexcept
+  -> float
+  { return static_cast<float>(m_values[d]); }
+
+  [[nodiscard]] constexpr auto begin() const noexcept
+  { return hlpr::index_iterator<compact_row>{ this, 0 }; }
+
+  [[nodiscard]] constexpr auto end() const noexcept
+  {
+    return hlpr::index_iterator<compact_row>{
+      this, static_cast<std::ptrdiff_t>(m_cols) };
+  }
+  // clang-format on
+};
+
+// compact_view: Non-owning view over a row-major buffer of rows x cols
+//               float16 or bfloat16 values, consecutive rows being
+//               stride values apart. It is a range of its rows, each
+//               one a compact_row, and reads as floats.
+template<hlpr::half_storage S>
+class compact_view: public std::ranges::view_interface<compact_view<S>>
+{
+  S const* m_data{};
+  size_type m_rows{};
+  size_type m_cols{};
+  size_type m_stride{};
+
+public:
+  using value_type = float;
+  using storage_type = S;
+
+  compact_view() = default;
+
+  constexpr compact_view(S const* data, size_type rows, //
+                         size_type cols, size_type stride) noexcept
+  : m_data{ data }, m_rows{ rows }, m_cols{ cols }, m_stride{ stride }
+  { assert(stride >= cols); }
+
+  constexpr compact_view(S const* data, size_type rows, size_type cols) noexcept
+  : compact_view(data, rows, cols, cols)
+  { }
+
+  // clang-format off
+  [[nodiscard]] constexpr auto rows() const noexcept { return m_rows; }
+  [[nodiscard]] constexpr auto cols() const noexcept { return m_cols; }
+  [[nodiscard]] constexpr auto stride() const noexcept { return m_stride; }
+  [[nodiscard]] constexpr auto data() const noexcept { return m_data; }
+
+  [[nodiscard]] constexpr
+  auto operator[](size_type row) const noexcept -> compact_row<S>
+  { return { m_data + row * m_stride, m_cols }; }
+
+  [[nodiscard]] constexpr auto begin() const noexcept
+  { return hlpr::index_iterator<compact_view>{ this, 0 }; }
+
+  [[nodiscard]] constexpr auto end() const noexcept
+  {
+    return hlpr::index_iterator<compact_view>{
+      this, static_cast<std::ptrdiff_t>(m_rows) };
+  }
+
+  [[nodiscard]] constexpr auto size() const noexcept { return m_rows; }
+
+  // clang-format on
+  // load: Decodes count rows starting at first into a
+  //       row-major tile of count x cols() values of type V
+  template<typename V>
+  constexpr void load(size_type first, size_type count, V* tile) const noexcept
+  {
+    for(size_type r{}; r < count; ++r) //
+    {
+      auto const* row = m_data + (first + r) * m_stride;
+      for(size_type d{}; d < m_cols; ++d) //
+      { tile[r * m_cols + d] = static_cast<V>(static_cast<float>(row[d])); }
+    }
+  }
+};
+
+// quantized_row: A row of a quantized_view, decoded on access
+class quantized_row
+{
+  std::int8_t const* m_codes{};
+  float const* m_scale{};
+  float const* m_offset{};
+  size_type m_cols{};
+
+public:
+  using value_type = float;
+
+  quantized_row() = default;
+  constexpr quantized_row(std::int8_t const* codes, float const* scale,
+                          float const* offset, size_type cols) noexcept
+  : m_codes{ codes }, m_scale{ scale }, m_offset{ offset }, m_cols{ cols }
+  { }
+
+  // clang-format off
+  [[nodiscard]] constexpr auto size() const noexcept { return m_cols; }
+
+  [[nodiscard]] constexpr auto operator[](size_type d) const noexcept
+  -> float
+  { return m_offset[d] + m_scale[d] * static_cast<float>(m_codes[d]); }
+
+  [[nodiscard]] constexpr auto begin() const noexcept
+  { return hlpr::index_iterator<quantized_row>{ this, 0 }; }
+
+  [[nodiscard]] constexpr auto end() const noexcept
+  {
+    return hlpr::index_iterator<quantized_row>{
+      this, static_cast<std::ptrdiff_t>(m_cols) };
+  }
+  // clang-format on
+};
+
+// quantized_view: Non-owning view over a row-major buffer of rows x cols
+//                 int8 codes, consecutive rows being stride codes apart,
+//                 coordinate d of a row being offset[d] + scale[d] x its
+//                 code. It is a range of its rows, each one a
+//                 quantized_row, and reads as floats.
+class quantized_view: public std::ranges::view_interface<quantized_view>
+{
+  std::int8_t const* m_codes{};
+  float const* m_scale{};
+  float const* m_offset{};
+  size_type m_rows{};
+  size_type m_cols{};
+  size_type m_stride{};
+
+public:
+  using value_type = float;
+  using storage_type = std::int8_t;
+
+  quantized_view() = default;
+
+  // scale and offset hold cols values each
+  constexpr quantized_view(std::int8_t const* codes,
+                           std::span<float const> scale,
+                           std::span<float const> offset,
+                           size_type rows,
+                           size_type stride) noexcept
+  : m_codes{ codes },
+    m_scale{ scale.data() },
+    m_offset{ offset.data() },
+    m_rows{ rows },
+    m_cols{ scale.size() },
+    m_stride{ stride }
+  { assert(offset.size() == scale.size() and stride >= scale.size()); }
+
+  constexpr quantized_view(std::int8_t const* codes,
+                           std::span<float const> scale,
+                           std::span<float const> offset,
+                           size_type rows) noexcept
+  : quantized_view(codes, scale, offset, rows, scale.size())
+  { }
+
+  // clang-format off
+  [[nodiscard]] constexpr auto rows() const noexcept { return m_rows; }
+  [[nodiscard]] constexpr auto cols() const noexcept { return m_cols; }
+  [[nodiscard]] constexpr auto stride() const noexcept { return m_stride; }
+  [[nodiscard]] constexpr auto data() const noexcept { return m_codes; }
+
+  [[nodiscard]] constexpr auto scale() const noexcept
+  { return std::span<float const>{ m_scale, m_cols }; }
+  [[nodiscard]] constexpr auto offset() const noexcept
+  { return std::span<float const>{ m_offset, m_cols }; }
+
+  [[nodiscard]] constexpr
+  auto operator[](size_type row) const noexcept -> quantized_row
+  { return { m_codes + row * m_stride, m_scale, m_offset, m_cols }; }
+
+  [[nodiscard]] constexpr auto begin() const noexcept
+  { return hlpr::index_iterator<quantized_view>{ this, 0 }; }
+
+  [[nodiscard]] constexpr auto end() const noexcept
+  {
+    return hlpr::index_iterator<quantized_view>{
+      this, static_cast<std::ptrdiff_t>(m_rows) };
+  }
+
+  [[nodiscard]] constexpr auto size() const noexcept { return m_rows; }
+
+  // clang-format on
+  // load: Decodes count rows starting at first into a
+  //       row-major tile of count x cols() values of type V
+  template<typename V>
+  constexpr void load(size_type first, size_type count, V* tile) const noexcept
+  {
+    for(size_type r{}; r < count; ++r) //
+    {
+      auto const* row = m_codes + (first + r) * m_stride;
+      for(size_type d{}; d < m_cols; ++d) //
+      {
+        tile[r * m_cols + d] = static_cast<V>(
+        m_offset[d] + m_scale[d] * static_cast<float>(row[d]));
+      }
+    }
+  }
+};
+
+// compact_matrix: Points of a matrix source stored as float16 or bfloat16
+template<hlpr::half_storage S>
+struct compact_matrix
+{
+  // rows x cols row-major
+  std::vector<S> values{};
+  size_type rows{};
+  size_type cols{};
+
+  // clang-format off
+  [[nodiscard]] auto view() const noexcept -> compact_view<S>
+  { return { values.data(), rows, cols }; }
+  // clang-format on
+};
+
+// quantized_matrix: Points of a matrix source stored as int8 codes
+struct quantized_matrix
+{
+  // rows x cols row-major
+  std::vector<std::int8_t> codes{};
+  std::vector<float> scale{};
+  std::vector<float> offset{};
+  size_type rows{};
+
+  // clang-format off
+  [[nodiscard]] auto view() const noexcept -> quantized_view
+  { return { codes.data(), scale, offset, rows }; }
+  // clang-format on
+};
+
+namespace hlpr {
+  // Rows read at once by the encoders
+  inline constexpr size_type encode_tile_rows = 256;
+
+  // for_each_tile: Calls fn(first, count, tile) over consecutive tiles
+  //                of the rows of a matrix source, read as doubles
+  void for_each_tile(matrix_source auto const& points, auto&& fn)
+  {
+    auto const rows = static_cast<size_type>(points.rows());
+    auto const cols = static_cast<size_type>(points.cols());
+    std::vector<double> tile(encode_tile_rows * cols);
+    for(size_type first{}; first < rows; first += encode_tile_rows) //
+    {
+      auto const count = std::min(encode_tile_rows, rows - first);
+      points.load(first, count, tile.data());
+      fn(first, count, tile.data());
+    }
+  }
+} // namespace hlpr
+
+// make_compact: Copy of a matrix source's points as float16 or bfloat16,
+//               each value rounded to the nearest one
+template<hlpr::half_storage S>
+[[nodiscard]] auto make_compact(hlpr::matrix_source auto const& points)
+-> compact_matrix<S>
+{
+  compact_matrix<S> matrix{ .rows = static_cast<size_type>(points.rows()),
+                            .cols = static_cast<size_type>(points.cols()) };
+  matrix.values.resize(matrix.rows * matrix.cols);
+  hlpr::for_each_tile(points,
+                      [&](size_type first, size_type count, double const* tile)
+                      {
+                        auto* out = matrix.values.data() + first * matrix.cols;
+                        for(size_type i{}; i < count * matrix.cols; ++i) //
+                        { out[i] = S{ static_cast<float>(tile[i]) }; }
+                      });
+  return matrix;
+}
+
+// make_quantized: Copy of a matrix source's points as int8 codes. Each
+//                 dimension's range is mapped linearly onto [-127, 127],
+//                 so that a coordinate is off by at most half a step,
+//                 (max - min) / 508; constant dimensions are exact.
+//                 Non-finite values aren't supported.
+[[nodiscard]] auto make_quantized(hlpr::matrix_source auto const& points)
+-> quantized_matrix
+{
+  auto const rows = static_cast<size_type>(points.rows());
+  auto const cols = static_cast<size_type>(points.cols());
+  constexpr auto max_code = 127.0;
+
+  std::vector<double> lowest(cols, std::numeric_limits<double>::max());
+  std::vector<double> highest(cols, std::numeric_limits<double>::lowest());
+  hlpr::for_each_tile(points,
+                      [&](size_type, size_type count, double const* tile)
+                      {
+                        for(size_type r{}; r < count; ++r) //
+                        {
+                          for(size_type d{}; d < cols; ++d) //
+                          {
+                            auto const x = tile[r * cols + d];
+                            lowest[d] = std::min(lowest[d], x);
+                            highest[d] = std::max(highest[d], x);
+                          }
+                        }
+                      });
+
+  quantized_matrix matrix{ .codes = std::vector<std::int8_t>(rows * cols),
+                           .scale = std::vector<float>(cols),
+                           .offset = std::vector<float>(cols),
+                           .rows = rows };
+  for(size_type d{}; d < cols and rows != 0; ++d) //
+  {
+    matrix.offset[d] = static_cast<float>((lowest[d] + highest[d]) / 2);
+    matrix.scale[d] =
+    static_cast<float>((highest[d] - lowest[d]) / (2 * max_code));
+  }
+
+  hlpr::for_each_tile(
+  points,
+  [&](size_type first, size_type count, double const* tile)
+  {
+    auto* out = matrix.codes.data() + first * cols;
+    for(size_type r{}; r < count; ++r) //
+    {
+      for(size_type d{}; d < cols; ++d) //
+      {
+        if(matrix.scale[d] == 0.0F) continue;
+        auto const offset = static_cast<double>(matrix.offset[d]);
+        auto const scale = static_cast<double>(matrix.scale[d]);
+        auto const code = std::round((tile[r * cols + d] - offset) / scale);
+        out[r * cols + d] =
+        static_cast<std::int8_t>(std::clamp(code, -max_code, max_code));
+      }
+    }
+  });
+  return matrix;
+}
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef KMN_CORESET_HPP
+#define KMN_CORESET_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <kmn/K_means.hpp>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+// Lightweight coresets (Bachem, Lucic and Krause, "Scalable k-means
+// clustering via lightweight coresets"): a small set of weighted points
+// whose weighted inertia, for any k centroids, is an unbiased estimate
+// of the inertia of the full set. With m points drawn, the estimate is
+// within a factor 1 ± eps of it, plus an eps share of the inertia around
+// the mean, with probability 1 - delta once m is in
+// O((dims k log k + log(1 / delta)) / eps²), whatever the number of points.
+
+namespace kmn {
+
+// coreset_options: How many points a coreset draws, and their seed
+struct coreset_options
+{
+  // Points drawn, with replacement; points drawn more than once are
+  // kept once, so the coreset may hold fewer
+  size_type size{ 4096 };
+  // Drawn from std::random_device when empty
+  std::optional<std::uint64_t> seed{};
+};
+
+// coreset: Weighted points standing in for a larger set; k_means runs on
+//          them as k_means(set.view(), ids, k, { .weights = set.weights })
+template<std::floating_point V>
+struct coreset
+{
+  // size() x dims row-major
+  std::vector<V> points{};
+  size_type dims{};
+  std::vector<double> weights{};
+  std::uint64_t seed{};
+
+  // clang-format off
+  [[nodiscard]] auto size() const noexcept -> size_type
+  { return weights.size(); }
+
+  [[nodiscard]] auto view() const noexcept -> matrix_view<V>
+  { return { points.data(), size(), dims }; }
+  // clang-format on
+};
+
+namespace hlpr {
+  // coreset_of: Draws a lightweight coreset of the rows, optionally
+  //             weighted, in two passes: one for the weighted mean, one
+  //             for the points' squared distances to it. Point i is drawn
+  //             with probability q(i) = w(i) / 2W + w(i) d²(i) / 2D, W and
+  //             D being the sums of w and w d², and weighs w(i) / m q(i)
+  //             per draw. Rows are read in index order.
+  template<std::floating_point V>
+  auto coreset_of(auto const& policy, auto const& rows,
+                  coreset_options const& options,
+                  std::span<double const> weights) -> coreset<V>
+  {
+    auto const n = rows.size();
+    auto const dims = rows.dims();
+    auto const weight = [&](size_type i)
+    { return weights.empty() ? 1.0 : weights[i]; };
+
+    coreset<V> set{ .dims = dims,
+                    .seed = options.seed.value_or(
+                    (std::uint64_t{ std::random_device{}() } << 32U)
+                    | std::random_device{}()) };
+
+    // Small enough sets are their own coreset
+    if(options.size >= n) {
+      set.points.resize(n * dims);
+      set.weights.resize(n);
+      for(size_type i{}; i < n; ++i) //
+      {
+        rows.load(i, set.points.data() + i * dims);
+        set.weights[i] = weight(i);
+      }
+      return set;
+    }
+
+    // Weighted mean, the last value holding the sum of the weights
+    std::vector<double> mean(dims + 1);
+    ordered_block_reduce(
+    policy, n,
+    [&] { return std::vector<double>(dims + 1); },
+    [&](auto& sums, size_type first, size_type last)
+    {
+      std::ranges::fill(sums, 0.0);
+      rows.for_each(first, last,
+                    [&](size_type i, V const* coords)
+                    {
+                      auto const w = weight(i);
+                      for(size_type d{}; d < dims; ++d) //
+                      { sums[d] += w * static_cast<double>(coords[d]); }
+                      sums[dims] += w;
+                    });
+      return 0;
+    },
+    [&](auto const& sums, int)
+    {
+      for(size_type d{}; d <= dims; ++d) mean[d] += sums[d];
+    });
+    auto const total_weight = mean[dims];
+    for(size_type d{}; d < dims; ++d) mean[d] /= total_weight;
+
+    // Weighted squared distances to the mean, summed per block
+    std::vector<double> sqr_dist(n);
+    std::vector<double> block_sums((n + parallel_block_size - 1)
+                                   / parallel_block_size);
+    for_each_block(policy, n,
+                   [&](size_type b, size_type first, size_type last)
+                   {
+                     double block_sum{};
+                     rows.for_each(
+                     first, last,
+                     [&](size_type i, V const* coords)
+                     {
+                       double dist{};
+                       for(size_type d{}; d < dims; ++d) //
+                       {
+                         auto const diff =
+                         static_cast<double>(coords[d]) - mean[d];
+                         dist += diff * diff;
+                       }
+                       sqr_dist[i] = dist;
+                       block_sum += weight(i) * dist;
+                     });
+                     block_sums[b] = block_sum;
+                   });
+    auto const total_dist =
+    std::accumulate(block_sums.begin(), block_sums.end(), 0.0);
+
+    // Every point on the mean leaves the uniform share only
+    auto const probability = [&](size_type i)
+    {
+      auto const uniform = weight(i) / total_weight;
+      if(not(total_dist > 0.0)) return uniform;
+      return 0.5 * uniform + 0.5 * weight(i) * sqr_dist[i] / total_dist;
+    };
+
+    // Sorted draws are matched against the running sum of the
+    // probabilities, counting how often each point is drawn
+    auto const m = options.size;
+    std::mt19937_64 gen{ set.seed };
+    std::vector<double> draws(m);
+    for(auto& u: draws) u = std::uniform_real_distribution<double>{}(gen);
+    std::ranges::sort(draws);
+
+    std::vector<std::pair<size_type, size_type>> picks;
+    double cumulative{};
+    size_type next{};
+    for(size_type i{}; i < n and next < m; ++i) //
+    {
+      cumulative += probability(i);
+      size_type count{};
+      for(; next < m and draws[next] < cumulative; ++next) ++count;
+      if(count != 0) picks.emplace_back(i, count);
+    }
+    if(next < m) { // Rounding left the sum of probabilities short of 1
+      if(picks.empty() or picks.back().first != n - 1)
+      { picks.emplace_back(n - 1, 0); }
+      picks.back().second += m - next;
+    }
+
+    set.points.resize(picks.size() * dims);
+    set.weights.resize(picks.size());
+    for(size_type j{}; auto const& [i, count]: picks) //
+    {
+      rows.load(i, set.points.data() + j * dims);
+      set.weights[j++] = static_cast<double>(count) * weight(i)
+                         / (static_cast<double>(m) * probability(i));
+    }
+    return set;
+  }
+} // namespace hlpr
+
+// clang-format off
+// make_coreset: Lightweight coreset of a matrix source or a range of
+//               DataPoints, whose points may carry weights, one each.
+//               Empty without points or coreset points, or if a weight
+//               is missing or not positive.
+template<typename PTS>
+  requires hlpr::matrix_source<PTS> or hlpr::data_points_range<PTS>
+[[nodiscard]]
+auto make_coreset(hlpr::execution_policy auto policy,
+                  PTS const& points,
+                  coreset_options const& options,
+                  std::span<double const> weights = {})
+{
+  using value_t = hlpr::centroid_value_t<PTS>;
+
+  auto const rows = hlpr::rows_of<value_t>(points);
+  std::optional<coreset<value_t>> set;
+  if(rows.size() == 0 or rows.dims() == 0 or options.size == 0
+     or not hlpr::valid_weights({ .weights = weights }, rows.size()))
+  { return set; }
+
+  set = hlpr::coreset_of<value_t>(policy, rows, options, weights);
+  return set;
+}
+
+template<typename PTS>
+  requires hlpr::matrix_source<PTS> or hlpr::data_points_range<PTS>
+[[nodiscard]]
+auto make_coreset(PTS const& points,
+                  coreset_options const& options,
+                  std::span<double const> weights = {})
+{ return make_coreset(seq, points, options, weights); }
+// clang-format on
+
+} // namespace kmn
+
+#endif
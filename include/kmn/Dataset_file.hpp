@@ -0,0 +1,502 @@
+#ifndef KMN_DATASET_FILE_HPP
+#define KMN_DATASET_FILE_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <kmn/DataPoint.hpp>
+#include <kmn/Matrix_view.hpp>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) or defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#error "kmn/Dataset_file.hpp maps files with POSIX mmap"
+#endif
+
+// Binary dataset files: a 64-byte header followed, from data_offset,
+// by rows of dims values, consecutive rows being stride values apart.
+//
+//   offset  bytes  field
+//        0      8  magic "KMNDATA\0"
+//        8      4  version
+//       12      1  element type (element_type)
+//       13      1  byte order of the header fields and values,
+//                  1 little endian, 2 big endian
+//       14      2  reserved
+//       16      8  dims
+//       24      8  rows
+//       32      8  stride, in values, >= dims
+//       40      8  data_offset, in bytes, a multiple of alignment
+//       48      8  alignment, in bytes, of the data and padded rows
+//       56      8  reserved
+
+namespace kmn {
+
+// element_type: Value type of a dataset file
+enum class element_type : std::uint8_t
+{
+  i8 = 1,
+  u8,
+  i16,
+  u16,
+  i32,
+  u32,
+  i64,
+  u64,
+  f32,
+  f64
+};
+
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(element_type type) noexcept -> std::string_view
+{
+  switch(type) {
+    case element_type::i8: return "i8";
+    case element_type::u8: return "u8";
+    case element_type::i16: return "i16";
+    case element_type::u16: return "u16";
+    case element_type::i32: return "i32";
+    case element_type::u32: return "u32";
+    case element_type::i64: return "i64";
+    case element_type::u64: return "u64";
+    case element_type::f32: return "f32";
+    case element_type::f64: return "f64";
+  }
+  return "unknown";
+}
+
+// clang-format on
+// element_type_of: The element_type of an arithmetic type
+template<arithmetic T>
+[[nodiscard]] constexpr auto element_type_of() noexcept -> element_type
+{
+  if constexpr(std::floating_point<T>) {
+    static_assert(sizeof(T) == 4 or sizeof(T) == 8);
+    return sizeof(T) == 4 ? element_type::f32 : element_type::f64;
+  } else {
+    static_assert(sizeof(T) <= 8);
+    auto constexpr width = std::bit_width(sizeof(T)) - 1; // 0 to 3
+    return static_cast<element_type>(1 + 2 * width
+                                     + (std::unsigned_integral<T> ? 1 : 0));
+  }
+}
+
+// with_element_type: Calls fn(T{}) with the arithmetic type T of type
+template<typename F>
+decltype(auto) with_element_type(element_type type, F&& fn)
+{
+  switch(type) {
+    case element_type::i8: return fn(std::int8_t{});
+    case element_type::u8: return fn(std::uint8_t{});
+    case element_type::i16: return fn(std::int16_t{});
+    case element_type::u16: return fn(std::uint16_t{});
+    case element_type::i32: return fn(std::int32_t{});
+    case element_type::u32: return fn(std::uint32_t{});
+    case element_type::i64: return fn(std::int64_t{});
+    case element_type::u64: return fn(std::uint64_t{});
+    case element_type::f32: return fn(float{});
+    case element_type::f64: break;
+  }
+  return fn(double{});
+}
+
+// dataset_error: Thrown when a dataset file can't be read or written
+struct dataset_error: std::runtime_error
+{
+  using std::runtime_error::runtime_error;
+};
+
+// dataset_header: A dataset file's header, in native byte order
+struct dataset_header
+{
+  static constexpr std::uint32_t current_version = 1;
+  static constexpr size_type size = 64;
+
+  std::uint32_t version{ current_version };
+  element_type type{ element_type::f32 };
+  std::endian byte_order{ std::endian::native };
+  size_type dims{};
+  size_type rows{};
+  size_type stride{};
+  size_type data_offset{ size };
+  size_type alignment{ size };
+
+  [[nodiscard]] auto value_size() const noexcept -> size_type
+  {
+    return with_element_type(type, [](auto v) { return sizeof(v); });
+  }
+
+  // data_bytes: Bytes from data_offset to the end of the last row
+  [[nodiscard]] auto data_bytes() const noexcept -> size_type
+  { return rows == 0 ? 0 : ((rows - 1) * stride + dims) * value_size(); }
+};
+
+namespace hlpr {
+  inline constexpr std::array<char, 8> dataset_magic{ 'K', 'M', 'N', 'D',
+                                                      'A', 'T', 'A', '\0' };
+
+  template<std::integral U>
+  [[nodiscard]] constexpr auto byteswap(U value) noexcept -> U
+  {
+    auto bytes = std::bit_cast<std::array<std::uint8_t, sizeof(U)>>(value);
+    std::ranges::reverse(bytes);
+    return std::bit_cast<U>(bytes);
+  }
+
+  // Header fields are read and written in the file's byte order
+  template<std::integral U>
+  void put_field(std::uint8_t* bytes, size_type offset, U value, bool swap)
+  {
+    if(swap) value = byteswap(value);
+    std::memcpy(bytes + offset, &value, sizeof(U));
+  }
+
+  template<std::integral U>
+  [[nodiscard]] auto get_field(std::uint8_t const* bytes, size_type offset,
+                               bool swap) -> U
+  {
+    U value;
+    std::memcpy(&value, bytes + offset, sizeof(U));
+    return swap ? byteswap(value) : value;
+  }
+
+  [[nodiscard]] inline auto encode_header(dataset_header const& header)
+  -> std::array<std::uint8_t, dataset_header::size>
+  {
+    std::array<std::uint8_t, dataset_header::size> bytes{};
+    auto const swap = header.byte_order != std::endian::native;
+    std::memcpy(bytes.data(), dataset_magic.data(), dataset_magic.size());
+    put_field(bytes.data(), 8, header.version, swap);
+    bytes[12] = static_cast<std::uint8_t>(header.type);
+    bytes[13] = header.byte_order == std::endian::little ? 1 : 2;
+    put_field(bytes.data(), 16, std::uint64_t{ header.dims }, swap);
+    put_field(bytes.data(), 24, std::uint64_t{ header.rows }, swap);
+    put_field(bytes.data(), 32, std::uint64_t{ header.stride }, swap);
+    put_field(bytes.data(), 40, std::uint64_t{ header.data_offset }, swap);
+    put_field(bytes.data(), 48, std::uint64_t{ header.alignment }, swap);
+    return bytes;
+  }
+
+  [[nodiscard]] inline auto decode_header(std::uint8_t const* bytes)
+  -> dataset_header
+  {
+    if(std::memcmp(bytes, dataset_magic.data(), dataset_magic.size()) != 0)
+    { throw dataset_error{ "not a kmn dataset file" }; }
+
+    dataset_header header;
+    if(bytes[13] != 1 and bytes[13] != 2)
+    { throw dataset_error{ "invalid byte order" }; }
+    header.byte_order = bytes[13] == 1 ? std::endian::little : std::endian::big;
+    auto const swap = header.byte_order != std::endian::native;
+
+    header.version = get_field<std::uint32_t>(bytes, 8, swap);
+    if(header.version != dataset_header::current_version)
+    { throw dataset_error{ "unsupported dataset version" }; }
+
+    if(bytes[12] < 1
+       or bytes[12] > static_cast<std::uint8_t>(element_type::f64))
+    { throw dataset_error{ "invalid element type" }; }
+    header.type = static_cast<element_type>(bytes[12]);
+
+    auto const field = [&](size_type offset)
+    {
+      return static_cast<size_type>(
+      get_field<std::uint64_t>(bytes, offset, swap));
+    };
+    header.dims = field(16);
+    header.rows = field(24);
+    header.stride = field(32);
+    header.data_offset = field(40);
+    header.alignment = field(48);
+
+    if(header.stride < header.dims
+       or header.data_offset < dataset_header::size)
+    { throw dataset_error{ "inconsistent dataset header" }; }
+
+    // Checked by division, so that neither data_bytes() nor the end of
+    // the data overflows and wraps past the truncation check
+    constexpr auto max_size = std::numeric_limits<size_type>::max();
+    auto const max_values = max_size / header.value_size();
+    if(header.rows != 0
+       and (header.dims > max_values
+            or (header.stride != 0
+                and header.rows - 1
+                    > (max_values - header.dims) / header.stride)
+            or header.data_bytes() > max_size - header.data_offset))
+    { throw dataset_error{ "dataset header sizes overflow" }; }
+    return header;
+  }
+
+  // round_up: Smallest multiple of alignment not below n
+  [[nodiscard]] constexpr //
+  auto round_up(size_type n, size_type alignment) noexcept -> size_type
+  { return (n + alignment - 1) / alignment * alignment; }
+} // namespace hlpr
+
+// read_dataset_header: Reads and checks a dataset file's header
+[[nodiscard]] inline auto
+read_dataset_header(std::filesystem::path const& path) -> dataset_header
+{
+  std::ifstream file{ path, std::ios::binary };
+  std::array<char, dataset_header::size> bytes{};
+  if(not file.read(bytes.data(), bytes.size())) {
+    throw dataset_error{ "cannot read a dataset header from "
+                         + path.string() };
+  }
+
+  std::array<std::uint8_t, dataset_header::size> header_bytes{};
+  std::memcpy(header_bytes.data(), bytes.data(), bytes.size());
+  return hlpr::decode_header(header_bytes.data());
+}
+
+// dataset_layout: Where a dataset_writer places the values.
+//                 The data starts at a multiple of alignment; with
+//                 pad_rows, so does every row.
+struct dataset_layout
+{
+  size_type alignment{ 64 };
+  bool pad_rows{ false };
+};
+
+// dataset_writer: Writes rows of dims values of type T to a dataset file
+//                 in native byte order. The row count is written to the
+//                 header on close(), which the destructor calls.
+template<arithmetic T>
+class dataset_writer
+{
+  std::ofstream m_file;
+  dataset_header m_header;
+  std::vector<T> m_padding;
+
+public:
+  dataset_writer(std::filesystem::path const& path, size_type dims,
+                 dataset_layout layout = {})
+  : m_file{ path, std::ios::binary | std::ios::trunc }
+  {
+    if(not std::has_single_bit(layout.alignment)
+       or layout.alignment % sizeof(T) != 0)
+    {
+      throw dataset_error{ "alignment must be a power of two "
+                           "multiple of the value size" };
+    }
+    if(not m_file) throw dataset_error{ "cannot create " + path.string() };
+
+    m_header.type = element_type_of<T>();
+    m_header.dims = dims;
+    m_header.alignment = layout.alignment;
+    m_header.stride =
+    layout.pad_rows ? hlpr::round_up(dims, layout.alignment / sizeof(T))
+                    : dims;
+    m_header.data_offset =
+    hlpr::round_up(dataset_header::size, layout.alignment);
+    m_padding.resize(m_header.stride - dims);
+
+    // The header is rewritten on close
+    std::vector<char> const preamble(m_header.data_offset);
+    m_file.write(preamble.data(),
+                 static_cast<std::streamsize>(preamble.size()));
+  }
+
+  dataset_writer(dataset_writer const&) = delete;
+  auto operator=(dataset_writer const&) -> dataset_writer& = delete;
+  dataset_writer(dataset_writer&&) noexcept = default;
+  auto operator=(dataset_writer&&) noexcept -> dataset_writer& = default;
+
+  ~dataset_writer()
+  {
+    try {
+      close();
+    } catch(...) { // NOLINT(bugprone-empty-catch)
+    }
+  }
+
+  // clang-format off
+  [[nodiscard]] auto header() const noexcept -> dataset_header const&
+  { return m_header; }
+
+  // clang-format on
+  // write: Appends whole rows of row-major values
+  void write(std::span<T const> values)
+  {
+    auto const dims = m_header.dims;
+    if(values.size() % dims != 0)
+    { throw dataset_error{ "partial row written to a dataset" }; }
+
+    auto const rows = values.size() / dims;
+    if(m_padding.empty()) {
+      write_values(values.data(), values.size());
+    } else {
+      for(size_type r{}; r < rows; ++r) //
+      {
+        write_values(values.data() + r * dims, dims);
+        write_values(m_padding.data(), m_padding.size());
+      }
+    }
+    m_header.rows += rows;
+  }
+
+  // write_point: Appends a point, e.g. a DataPoint<T, D>
+  void write_point(stdr::random_access_range auto const& point)
+  {
+    if(static_cast<size_type>(stdr::size(point)) != m_header.dims)
+    { throw dataset_error{ "point of the wrong dimension" }; }
+
+    std::vector<T> row(m_header.dims);
+    for(size_type d{}; d < m_header.dims; ++d) //
+    { row[d] = static_cast<T>(point[d]); }
+    write(row);
+  }
+
+  void close()
+  {
+    if(not m_file.is_open()) return;
+
+    auto const bytes = hlpr::encode_header(m_header);
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<char const*>(bytes.data()), // NOLINT
+                 static_cast<std::streamsize>(bytes.size()));
+    m_file.close();
+    if(m_file.fail()) throw dataset_error{ "cannot write a dataset" };
+  }
+
+private:
+  void write_values(T const* values, size_type count)
+  {
+    m_file.write(reinterpret_cast<char const*>(values), // NOLINT
+                 static_cast<std::streamsize>(count * sizeof(T)));
+    if(not m_file) throw dataset_error{ "cannot write a dataset" };
+  }
+};
+
+// mapped_dataset: Read-only memory mapping of a dataset file of T values
+//                 in native byte order. Opening it reads the header only;
+//                 pages are loaded by the OS as the points are read.
+template<arithmetic T>
+class mapped_dataset
+{
+  void* m_map{ nullptr };
+  size_type m_bytes{};
+  dataset_header m_header{};
+
+public:
+  using value_type = T;
+
+  explicit mapped_dataset(std::filesystem::path const& path)
+  : m_header{ read_dataset_header(path) }
+  {
+    if(m_header.type != element_type_of<T>()) {
+      throw dataset_error{
+        "dataset holds " + std::string(to_string(m_header.type))
+        + " values, not " + std::string(to_string(element_type_of<T>()))
+      };
+    }
+    if(m_header.byte_order != std::endian::native) {
+      throw dataset_error{ "dataset isn't in native byte order, "
+                           "convert it with kmn_convert native" };
+    }
+    if(m_header.data_offset % alignof(T) != 0)
+    { throw dataset_error{ "misaligned dataset values" }; }
+
+    auto const fd = ::open(path.c_str(), O_RDONLY); // NOLINT
+    if(fd < 0) throw dataset_error{ "cannot open " + path.string() };
+
+    struct stat info{};
+    if(::fstat(fd, &info) != 0) {
+      ::close(fd);
+      throw dataset_error{ "cannot stat " + path.string() };
+    }
+    m_bytes = static_cast<size_type>(info.st_size);
+    if(m_bytes < m_header.data_offset + m_header.data_bytes()) {
+      ::close(fd);
+      throw dataset_error{ "truncated dataset " + path.string() };
+    }
+
+    m_map = ::mmap(nullptr, m_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file open
+    if(m_map == MAP_FAILED) { // NOLINT
+      m_map = nullptr;
+      throw dataset_error{ "cannot map " + path.string() };
+    }
+  }
+
+  mapped_dataset(mapped_dataset const&) = delete;
+  auto operator=(mapped_dataset const&) -> mapped_dataset& = delete;
+
+  mapped_dataset(mapped_dataset&& other) noexcept
+  : m_map{ std::exchange(other.m_map, nullptr) },
+    m_bytes{ std::exchange(other.m_bytes, 0) },
+    m_header{ other.m_header }
+  { }
+
+  auto operator=(mapped_dataset&& other) noexcept -> mapped_dataset&
+  {
+    if(this != &other) {
+      unmap();
+      m_map = std::exchange(other.m_map, nullptr);
+      m_bytes = std::exchange(other.m_bytes, 0);
+      m_header = other.m_header;
+    }
+    return *this;
+  }
+
+  ~mapped_dataset() { unmap(); }
+
+  // clang-format off
+  [[nodiscard]] auto header() const noexcept -> dataset_header const&
+  { return m_header; }
+  [[nodiscard]] auto rows() const noexcept { return m_header.rows; }
+  [[nodiscard]] auto cols() const noexcept { return m_header.dims; }
+
+  [[nodiscard]] auto data() const noexcept -> T const*
+  {
+    return reinterpret_cast<T const*>( // NOLINT
+           static_cast<char const*>(m_map) + m_header.data_offset);
+  }
+
+  // view: The mapped values, accepted as is by k_means
+  [[nodiscard]] auto view() const noexcept -> matrix_view<T>
+  { return { data(), m_header.rows, m_header.dims, m_header.stride }; }
+
+  // clang-format on
+  // points: The mapped values viewed in place as DataPoints, which have
+  //         the layout of T[D]; the file must hold unpadded rows of D values
+  template<size_type D>
+  [[nodiscard]] auto points() const -> std::span<DataPoint<T, D> const>
+  {
+    static_assert(sizeof(DataPoint<T, D>) == D * sizeof(T));
+    static_assert(std::is_standard_layout_v<DataPoint<T, D>>);
+
+    if(m_header.dims != D or m_header.stride != D)
+    { throw dataset_error{ "dataset rows aren't unpadded D-points" }; }
+
+    return { reinterpret_cast<DataPoint<T, D> const*>(data()), // NOLINT
+             m_header.rows };
+  }
+
+private:
+  void unmap() noexcept
+  {
+    if(m_map != nullptr) ::munmap(m_map, m_bytes);
+    m_map = nullptr;
+  }
+};
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,430 @@
+#ifndef KMN_DISTANCE_KERNELS_HPP
+#define KMN_DISTANCE_KERNELS_HPP
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <ranges>
+#include <string_view>
+#include <utility> // std::index_sequence
+#include <vector>
+
+// Runtime ISA dispatch relies on GCC/Clang target attributes
+#if(defined(__GNUC__) or defined(__clang__)) \
+and (defined(__x86_64__) or defined(__i386__))
+#define KMN_SIMD_X86 1
+#include <immintrin.h>
+#define KMN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KMN_SIMD_X86 0
+#endif
+
+namespace kmn::simd {
+
+using size_type = std::size_t;
+
+// isa: Instruction sets the distance kernels are compiled for
+enum class isa
+{
+  scalar,
+  sse2,
+  avx2,
+  avx512
+};
+
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(isa set) noexcept -> std::string_view
+{
+  switch(set) {
+    case isa::scalar: return "scalar";
+    case isa::sse2: return "sse2";
+    case isa::avx2: return "avx2";
+    case isa::avx512: return "avx512";
+  }
+  return "unknown";
+}
+
+// clang-format on
+// Centroid rows are padded to whole cache lines,
+// which every kernel consumes one at a time
+inline constexpr size_type cache_line_size = 64;
+
+template<std::floating_point V>
+inline constexpr size_type lanes_per_line = cache_line_size / sizeof(V);
+
+// sqr_distances_fn: Writes to out[j], for every j < ld, the squared
+//                   euclidean distance from pt to the j-th centroid of
+//                   a dimension-major block: soa[d * ld + j] is its d-th
+//                   coordinate, and ld is a multiple of lanes_per_line<V>
+template<std::floating_point V>
+using sqr_distances_fn = void (*)(V const* pt, V const* soa, //
+                                  size_type dims, size_type ld,
+                                  V* out) noexcept;
+
+// Dimensions with kernels compiled for them, whose loop over the
+// dimensions has a constant trip count the compiler can unroll
+inline constexpr std::array<size_type, 7> specialized_dims{ 2,  3,  4, 8,
+                                                            16, 32, 64 };
+
+// Every kernel is instantiated for each specialized dimension D, in which
+// case it ignores its dims argument, and for D = 0, which reads it
+namespace detail {
+  template<size_type D>
+  [[nodiscard]] constexpr auto kernel_dims(size_type dims) noexcept
+  -> size_type
+  { return D == 0 ? dims : D; }
+
+  template<size_type D, std::floating_point V>
+  void sqr_distances_scalar(V const* pt, V const* soa, //
+                            size_type dims, size_type ld,
+                            V* out) noexcept
+  {
+    std::fill(out, out + ld, V{});
+    for(size_type d{}; d < kernel_dims<D>(dims); ++d) //
+    {
+      auto const coord = pt[d];
+      auto const* row = soa + d * ld;
+      for(size_type j{}; j < ld; ++j) //
+      {
+        auto const diff = coord - row[j];
+        out[j] += diff * diff;
+      }
+    }
+  }
+
+#if KMN_SIMD_X86
+  // Each kernel accumulates one cache line of centroids
+  // across all dimensions before storing it
+
+  template<size_type D>
+  KMN_TARGET("sse2")
+  inline void sqr_distances_sse2(float const* pt, float const* soa, //
+                                 size_type dims, size_type ld,
+                                 float* out) noexcept
+  {
+    for(size_type j{}; j < ld; j += lanes_per_line<float>) //
+    {
+      auto acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+      auto acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+      for(size_type d{}; d < kernel_dims<D>(dims); ++d) //
+      {
+        auto const coord = _mm_set1_ps(pt[d]);
+        auto const* row = soa + d * ld + j;
+        auto const d0 = _mm_sub_ps(coord, _mm_loadu_ps(row));
+        auto const d1 = _mm_sub_ps(coord, _mm_loadu_ps(row + 4));
+        auto const d2 = _mm_sub_ps(coord, _mm_loadu_ps(row + 8));
+        auto const d3 = _mm_sub_ps(coord, _mm_loadu_ps(row + 12));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(d2, d2));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(d3, d3));
+      }
+      _mm_storeu_ps(out + j, acc0);
+      _mm_storeu_ps(out + j + 4, acc1);
+      _mm_storeu_ps(out + j + 8, acc2);
+      _mm_storeu_ps(out + j + 12, acc3);
+    }
+  }
+
+  template<size_type D>
+  KMN_TARGET("sse2")
+  inline void sqr_distances_sse2(double const* pt, double const* soa, //
+                                 size_type dims, size_type ld,
+                                 double* out) noexcept
+  {
+    for(size_type j{}; j < ld; j += lanes_per_line<double>) //
+    {
+      auto acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+      auto acc2 = _mm_setzero_pd(), acc3 = _mm_setzero_pd();
+      for(size_type d{}; d < kernel_dims<D>(dims); ++d) //
+      {
+        auto const coord = _mm_set1_pd(pt[d]);
+        auto const* row = soa + d * ld + j;
+        auto const d0 = _mm_sub_pd(coord, _mm_loadu_pd(row));
+        auto const d1 = _mm_sub_pd(coord, _mm_loadu_pd(row + 2));
+        auto const d2 = _mm_sub_pd(coord, _mm_loadu_pd(row + 4));
+        auto const d3 = _mm_sub_pd(coord, _mm_loadu_pd(row + 6));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+        acc2 = _mm_add_pd(acc2, _mm_mul_pd(d2, d2));
+        acc3 = _mm_add_pd(acc3, _mm_mul_pd(d3, d3));
+      }
+      _mm_storeu_pd(out + j, acc0);
+      _mm_storeu_pd(out + j + 2, acc1);
+      _mm_storeu_pd(out + j + 4, acc2);
+      _mm_storeu_pd(out + j + 6, acc3);
+    }
+  }
+
+  template<size_type D>
+  KMN_TARGET("avx2")
+  inline void sqr_distances_avx2(float const* pt, float const* soa, //
+                                 size_type dims, size_type ld,
+                                 float* out) noexcept
+  {
+    for(size_type j{}; j < ld; j += lanes_per_line<float>) //
+    {
+      auto acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+      for(size_type d{}; d < kernel_dims<D>(dims); ++d) //
+      {
+        auto const coord = _mm256_set1_ps(pt[d]);
+        auto const* row = soa + d * ld + j;
+        auto const d0 = _mm256_sub_ps(coord, _mm256_loadu_ps(row));
+        auto const d1 = _mm256_sub_ps(coord, _mm256_loadu_ps(row + 8));
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+      }
+      _mm256_storeu_ps(out + j, acc0);
+      _mm256_storeu_ps(out + j + 8, acc1);
+    }
+  }
+
+  template<size_type D>
+  KMN_TARGET("avx2")
+  inline void sqr_distances_avx2(double const* pt, double const* soa, //
+                                 size_type dims, size_type ld,
+                                 double* out) noexcept
+  {
+    for(size_type j{}; j < ld; j += lanes_per_line<double>) //
+    {
+      auto acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+      for(size_type d{}; d < kernel_dims<D>(dims); ++d) //
+      {
+        auto const coord = _mm256_set1_pd(pt[d]);
+        auto const* row = soa + d * ld + j;
+        auto const d0 = _mm256_sub_pd(coord, _mm256_loadu_pd(row));
+        auto const d1 = _mm256_sub_pd(coord, _mm256_loadu_pd(row + 4));
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+      }
+      _mm256_storeu_pd(out + j, acc0);
+      _mm256_storeu_pd(out + j + 4, acc1);
+    }
+  }
+
+  template<size_type D>
+  KMN_TARGET("avx512f")
+  inline void sqr_distances_avx512(float const* pt, float const* soa, //
+                                   size_type dims, size_type ld,
+                                   float* out) noexcept
+  {
+    for(size_type j{}; j < ld; j += lanes_per_line<float>) //
+    {
+      auto acc = _mm512_setzero_ps();
+      for(size_type d{}; d < kernel_dims<D>(dims); ++d) //
+      {
+        auto const diff = _mm512_sub_ps(_mm512_set1_ps(pt[d]),
+                                        _mm512_loadu_ps(soa + d * ld + j));
+        acc = _mm512_add_ps(acc, _mm512_mul_ps(diff, diff));
+      }
+      _mm512_storeu_ps(out + j, acc);
+    }
+  }
+
+  template<size_type D>
+  KMN_TARGET("avx512f")
+  inline void sqr_distances_avx512(double const* pt, double const* soa, //
+                                   size_type dims, size_type ld,
+                                   double* out) noexcept
+  {
+    for(size_type j{}; j < ld; j += lanes_per_line<double>) //
+    {
+      auto acc = _mm512_setzero_pd();
+      for(size_type d{}; d < kernel_dims<D>(dims); ++d) //
+      {
+        auto const diff = _mm512_sub_pd(_mm512_set1_pd(pt[d]),
+                                        _mm512_loadu_pd(soa + d * ld + j));
+        acc = _mm512_add_pd(acc, _mm512_mul_pd(diff, diff));
+      }
+      _mm512_storeu_pd(out + j, acc);
+    }
+  }
+#endif // KMN_SIMD_X86
+} // namespace detail
+
+// detect_isa: Widest instruction set the running CPU supports
+[[nodiscard]] inline auto detect_isa() noexcept -> isa
+{
+#if KMN_SIMD_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f")) return isa::avx512;
+  if(__builtin_cpu_supports("avx2")) return isa::avx2;
+  if(__builtin_cpu_supports("sse2")) return isa::sse2;
+#endif
+  return isa::scalar;
+}
+
+// active_isa: Instruction set picked once per process for the kernels
+[[nodiscard]] inline auto active_isa() noexcept -> isa
+{
+  static isa const detected = detect_isa();
+  return detected;
+}
+
+namespace detail {
+  // kernel_for: Kernel compiled for the given instruction set and D,
+  //             or the scalar one if the set isn't available
+  template<std::floating_point V, size_type D>
+  [[nodiscard]] auto kernel_for(isa set) noexcept -> sqr_distances_fn<V>
+  {
+    if constexpr(std::same_as<V, float> or std::same_as<V, double>) //
+    {
+#if KMN_SIMD_X86
+      switch(set) {
+        case isa::avx512: return &sqr_distances_avx512<D>;
+        case isa::avx2: return &sqr_distances_avx2<D>;
+        case isa::sse2: return &sqr_distances_sse2<D>;
+        case isa::scalar: break;
+      }
+#endif
+    }
+    (void)set;
+    return &sqr_distances_scalar<D, V>;
+  }
+
+  template<std::floating_point V, size_type... I>
+  [[nodiscard]] auto kernel_for(isa set,
+                                size_type dims,
+                                std::index_sequence<I...>) noexcept
+  -> sqr_distances_fn<V>
+  {
+    sqr_distances_fn<V> kernel = nullptr;
+    (void)((dims == specialized_dims[I]
+            and (kernel = kernel_for<V, specialized_dims[I]>(set)))
+           or ...);
+    return kernel != nullptr ? kernel : kernel_for<V, 0>(set);
+  }
+} // namespace detail
+
+// sqr_distances_kernel: Kernel compiled for the given instruction set,
+//                       or the scalar one if it isn't available, which
+//                       reads its dims argument
+template<std::floating_point V>
+[[nodiscard]] auto sqr_distances_kernel(isa set) noexcept
+-> sqr_distances_fn<V>
+{ return detail::kernel_for<V, 0>(set); }
+
+// sqr_distances_kernel: Same, unrolled for dims when it is one of the
+//                       specialized_dims; it must then be called with
+//                       dims dimensions
+template<std::floating_point V>
+[[nodiscard]] auto sqr_distances_kernel(isa set, size_type dims) noexcept
+-> sqr_distances_fn<V>
+{
+  return detail::kernel_for<V>(
+  set, dims, std::make_index_sequence<specialized_dims.size()>{});
+}
+
+template<std::floating_point V>
+[[nodiscard]] auto sqr_distances_kernel() noexcept -> sqr_distances_fn<V>
+{
+  static auto const kernel = sqr_distances_kernel<V>(active_isa());
+  return kernel;
+}
+
+// centroid_block: k centroids of dims coordinates stored dimension-major,
+//                 so that one kernel call yields a point's squared
+//                 distances to all of them. Each row is padded with zeros
+//                 to a whole number of cache lines. Whole distances use
+//                 the kernel unrolled for dims, if any, partial ones the
+//                 kernel reading its dims argument.
+template<std::floating_point V>
+class centroid_block
+{
+  size_type m_k;
+  size_type m_dims;
+  size_type m_ld;
+  std::vector<V> m_soa;
+  isa m_isa;
+  sqr_distances_fn<V> m_kernel;
+  sqr_distances_fn<V> m_dims_kernel;
+
+public:
+  centroid_block(size_type k, size_type dims, isa set = active_isa())
+  : m_k{ k },
+    m_dims{ dims },
+    m_ld{ (k + lanes_per_line<V> - 1) / lanes_per_line<V>
+          * lanes_per_line<V> },
+    m_soa(m_ld * dims),
+    m_isa{ set },
+    m_kernel{ sqr_distances_kernel<V>(set) },
+    m_dims_kernel{ sqr_distances_kernel<V>(set, dims) }
+  { }
+
+  // clang-format off
+  [[nodiscard]] auto size() const noexcept -> size_type { return m_k; }
+  [[nodiscard]] auto dims() const noexcept -> size_type { return m_dims; }
+  // Length of a row, hence of the distances buffer nearest() needs
+  [[nodiscard]] auto stride() const noexcept -> size_type { return m_ld; }
+
+  [[nodiscard]] auto data() const noexcept -> V const* { return m_soa.data(); }
+
+  [[nodiscard]] auto coord(size_type c, size_type d) const noexcept -> V
+  { return m_soa[d * m_ld + c]; }
+
+  // clang-format on
+  // reshape: Resizes the block for k centroids of dims coordinates,
+  //          reusing its storage when it is large enough
+  void reshape(size_type k, size_type dims)
+  {
+    m_k = k;
+    m_dims = dims;
+    m_ld = (k + lanes_per_line<V> - 1) / lanes_per_line<V> * lanes_per_line<V>;
+    m_soa.assign(m_ld * dims, V{});
+    m_dims_kernel = sqr_distances_kernel<V>(m_isa, dims);
+  }
+
+  // assign: Transposes a range of k centroids, each indexable by dimension
+  void assign(std::ranges::sized_range auto const& centroids) noexcept
+  {
+    size_type c{};
+    for(auto const& centroid: centroids) //
+    {
+      for(size_type d{}; d < m_dims; ++d) //
+      { m_soa[d * m_ld + c] = static_cast<V>(centroid[d]); }
+      ++c;
+    }
+  }
+
+  // assign_rows: Transposes k centroids stored row-major, dims apart
+  void assign_rows(V const* rows) noexcept
+  {
+    for(size_type c{}; c < m_k; ++c) //
+    {
+      for(size_type d{}; d < m_dims; ++d) //
+      { m_soa[d * m_ld + c] = rows[c * m_dims + d]; }
+    }
+  }
+
+  // set: Replaces the c-th centroid with dims coordinates
+  void set(size_type c, V const* coords) noexcept
+  {
+    for(size_type d{}; d < m_dims; ++d) m_soa[d * m_ld + c] = coords[d];
+  }
+
+  // sqr_distances: One kernel call for the distances from pt to all
+  //                centroids; distances must hold stride() elements
+  void sqr_distances(V const* pt, V* distances) const noexcept
+  { m_dims_kernel(pt, m_soa.data(), m_dims, m_ld, distances); }
+
+  // sqr_distances: Partial squared distances over the n_dims
+  //                dimensions from first_dim; pt points to first_dim
+  void sqr_distances(V const* pt, size_type first_dim, size_type n_dims,
+                     V* distances) const noexcept
+  { m_kernel(pt, m_soa.data() + first_dim * m_ld, n_dims, m_ld, distances); }
+
+  // nearest: Index of the centroid nearest to pt, the first one on ties
+  [[nodiscard]] auto nearest(V const* pt, V* distances) const noexcept
+  -> size_type
+  {
+    sqr_distances(pt, distances);
+    return static_cast<size_type>(std::min_element(distances, distances + m_k)
+                                  - distances);
+  }
+};
+
+} // namespace kmn::simd
+
+#endif
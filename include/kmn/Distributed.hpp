@@ -0,0 +1,436 @@
+#ifndef KMN_DISTRIBUTED_HPP
+#define KMN_DISTRIBUTED_HPP
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <kmn/K_means.hpp>
+#include <kmn/Model.hpp> // hlpr::read_value, hlpr::write_header
+#include <optional>
+#include <span>
+#include <vector>
+
+// Lloyd iterations over points sharded across workers, e.g. processes.
+// Every iteration, each worker runs local_step over its shard against
+// the current centroids and hands back the shard's partial_stats, and
+// the coordinator merges them in shard order into the next centroids;
+// only O(k dims) values per shard cross a process boundary. Partial
+// stats serialize to a blob of a 56-byte header followed by the stats:
+//
+//   offset  bytes  field
+//        0      8  magic "KMNSTATS"
+//        8      4  version
+//       12      1  size of a coordinate, 4 or 8 (float or double)
+//       13      1  byte order, 1 little endian, 2 big endian
+//       14      2  reserved
+//       16      8  k
+//       24      8  dims
+//       32      8  reassigned, u64
+//       40      8  inertia, f64
+//       48      8  distances, u64
+//       56         k x dims f64 sums, k f64 masses, k u64 counts,
+//                  k f64 sse, k f64 farthest_sqr, then the k x dims
+//                  coordinates of the farthest points
+
+namespace kmn {
+
+namespace hlpr {
+  inline constexpr std::array<char, 8> stats_magic{ 'K', 'M', 'N', 'S',
+                                                    'T', 'A', 'T', 'S' };
+  inline constexpr size_type stats_header_size = 56;
+  inline constexpr std::uint32_t stats_version = 2;
+} // namespace hlpr
+
+// partial_stats: What a pass over one shard adds up per cluster,
+//                as a flat_accumulator does, k x dims row-major
+template<std::floating_point V>
+struct partial_stats
+{
+  size_type dims{};
+  // Weighted coordinate sums, and the weight of each cluster's points
+  std::vector<double> sums{};
+  std::vector<double> masses{};
+  std::vector<std::uint64_t> counts{};
+  std::vector<double> sse{};
+  // Each cluster's point farthest from its centroid, the first one on
+  // ties, and its squared distance
+  std::vector<V> farthest{};
+  std::vector<double> farthest_sqr{};
+  double inertia{};
+  // Points of the shard whose id the pass changed
+  std::uint64_t reassigned{};
+  // Point-to-centroid distances the pass measured
+  std::uint64_t distances{};
+
+  partial_stats() = default;
+
+  partial_stats(size_type k, size_type n_dims)
+  : dims{ n_dims },
+    sums(k * n_dims),
+    masses(k),
+    counts(k),
+    sse(k),
+    farthest(k * n_dims),
+    farthest_sqr(k)
+  { }
+
+  // clang-format off
+  [[nodiscard]] auto k() const noexcept { return counts.size(); }
+
+  // clang-format on
+  // merge: Adds the stats of a shard that comes after this one
+  void merge(partial_stats const& other) noexcept
+  {
+    assert(other.k() == k() and other.dims == dims);
+    for(size_type i{}; i < sums.size(); ++i) sums[i] += other.sums[i];
+    for(size_type c{}; c < k(); ++c) //
+    {
+      masses[c] += other.masses[c];
+      counts[c] += other.counts[c];
+      sse[c] += other.sse[c];
+      if(other.farthest_sqr[c] > farthest_sqr[c]) {
+        farthest_sqr[c] = other.farthest_sqr[c];
+        std::copy_n(other.farthest.data() + c * dims, dims,
+                    farthest.data() + c * dims);
+      }
+    }
+    inertia += other.inertia;
+    reassigned += other.reassigned;
+    distances += other.distances;
+  }
+
+  // to_blob: Serializes the stats, in native byte order
+  [[nodiscard]] auto to_blob() const -> std::vector<std::byte>
+  {
+    std::vector<std::byte> blob;
+    blob.reserve(
+    hlpr::stats_header_size
+    + (sums.size() + masses.size() + sse.size() + farthest_sqr.size())
+      * sizeof(double)
+    + counts.size() * sizeof(std::uint64_t) + farthest.size() * sizeof(V));
+    hlpr::write_header<V>(blob, hlpr::stats_magic, hlpr::stats_version, k(),
+                          dims);
+    hlpr::write_value(blob, reassigned);
+    hlpr::write_value(blob, inertia);
+    hlpr::write_value(blob, distances);
+
+    hlpr::write_values(blob, std::span{ sums });
+    hlpr::write_values(blob, std::span{ masses });
+    hlpr::write_values(blob, std::span{ counts });
+    hlpr::write_values(blob, std::span{ sse });
+    hlpr::write_values(blob, std::span{ farthest_sqr });
+    hlpr::write_values(blob, std::span{ farthest });
+    return blob;
+  }
+
+  // from_blob: Stats serialized by to_blob, on this machine or not, and
+  //            with float or double coordinates; nullopt if blob isn't one
+  [[nodiscard]] static auto from_blob(std::span<std::byte const> blob)
+  -> std::optional<partial_stats>
+  {
+    using hlpr::read_value;
+
+    if(blob.size() < hlpr::stats_header_size
+       or std::memcmp(blob.data(), hlpr::stats_magic.data(),
+                      hlpr::stats_magic.size())
+          != 0)
+    { return std::nullopt; }
+
+    auto const* bytes = blob.data();
+    auto const order = read_value<std::uint8_t>(bytes + 13, false);
+    if(order != 1 and order != 2) return std::nullopt;
+    auto const swap =
+    (order == 1) != (std::endian::native == std::endian::little);
+
+    auto const version = read_value<std::uint32_t>(bytes + 8, swap);
+    auto const value_size = read_value<std::uint8_t>(bytes + 12, false);
+    auto const k = read_value<std::uint64_t>(bytes + 16, swap);
+    auto const dims = read_value<std::uint64_t>(bytes + 24, swap);
+    // Checked by division, so that no product of them overflows
+    auto const payload = blob.size() - hlpr::stats_header_size;
+    auto const row_bytes = sizeof(double) + value_size;
+    if(version != hlpr::stats_version
+       or (value_size != sizeof(float) and value_size != sizeof(double))
+       or k == 0 or dims == 0 or dims > payload / row_bytes)
+    { return std::nullopt; }
+    auto const cluster_bytes =
+    dims * row_bytes + 3 * sizeof(double) + sizeof(std::uint64_t);
+    if(payload % cluster_bytes != 0 or payload / cluster_bytes != k)
+    { return std::nullopt; }
+
+    partial_stats stats(k, dims);
+    stats.reassigned = read_value<std::uint64_t>(bytes + 32, swap);
+    stats.inertia = read_value<double>(bytes + 40, swap);
+    stats.distances = read_value<std::uint64_t>(bytes + 48, swap);
+
+    auto const* at = bytes + hlpr::stats_header_size;
+    auto const extract = [&]<typename T>(std::vector<T>& values)
+    {
+      for(auto& value: values) {
+        value = read_value<T>(at, swap);
+        at += sizeof(T);
+      }
+    };
+    extract(stats.sums);
+    extract(stats.masses);
+    extract(stats.counts);
+    extract(stats.sse);
+    extract(stats.farthest_sqr);
+    for(auto& coord: stats.farthest) {
+      coord = value_size == sizeof(float)
+              ? static_cast<V>(read_value<float>(at, swap))
+              : static_cast<V>(read_value<double>(at, swap));
+      at += value_size;
+    }
+    return stats;
+  }
+};
+
+namespace hlpr {
+  // stats_of: partial_stats of an accumulator's pass
+  template<std::floating_point V>
+  [[nodiscard]] auto stats_of(flat_accumulator<V> const& acc,
+                              size_type reassigned) -> partial_stats<V>
+  {
+    partial_stats<V> stats(acc.counts.size(), acc.dims);
+    stdr::transform(acc.sums, stats.sums.begin(),
+                    [](auto sum) { return static_cast<double>(sum); });
+    stdr::copy(acc.masses, stats.masses.begin());
+    stdr::copy(acc.counts, stats.counts.begin());
+    stdr::copy(acc.sse, stats.sse.begin());
+    stdr::copy(acc.farthest, stats.farthest.begin());
+    stdr::copy(acc.farthest_sqr, stats.farthest_sqr.begin());
+    stats.inertia = acc.inertia;
+    stats.reassigned = reassigned;
+    stats.distances = acc.distances;
+    return stats;
+  }
+
+  template<typename CENTROID_T>
+  [[nodiscard]] auto stats_of(cluster_accumulator<CENTROID_T> const& acc,
+                              size_type reassigned)
+  -> partial_stats<typename CENTROID_T::value_type>
+  {
+    auto constexpr dims = data_point_size_v<CENTROID_T>;
+    partial_stats<typename CENTROID_T::value_type> stats(acc.counts.size(),
+                                                         dims);
+    for(size_type c{}; c < stats.k(); ++c) //
+    {
+      for(size_type d{}; d < dims; ++d) //
+      {
+        stats.sums[c * dims + d] = static_cast<double>(acc.sums[c][d]);
+        stats.farthest[c * dims + d] = acc.farthest[c][d];
+      }
+    }
+    stdr::copy(acc.masses, stats.masses.begin());
+    stdr::copy(acc.counts, stats.counts.begin());
+    stdr::copy(acc.sse, stats.sse.begin());
+    stdr::copy(acc.farthest_sqr, stats.farthest_sqr.begin());
+    stats.inertia = acc.inertia;
+    stats.reassigned = reassigned;
+    stats.distances = acc.distances;
+    return stats;
+  }
+} // namespace hlpr
+
+// clang-format off
+// local_step: Worker side of an iteration. Runs the fused pass of k_means
+//             over a shard, a matrix source or a range of DataPoints,
+//             against k x dims row-major centroids: writes the id of each
+//             point's nearest centroid to out_indices, which hold the
+//             shard's ids of the previous pass, and returns the shard's
+//             stats. weights, if any, weigh the shard's points. Empty if
+//             the sizes of the shard, ids, centroids or weights don't match.
+template<typename PTS, hlpr::unsigned_range IDX_R>
+  requires (hlpr::matrix_source<PTS> or hlpr::data_points_range<PTS>)
+           and stdr::random_access_range<IDX_R>
+[[nodiscard]]
+auto local_step(hlpr::execution_policy auto policy,
+                PTS const& shard,
+                IDX_R&& out_indices,
+                std::span<hlpr::centroid_value_t<PTS> const> centroids,
+                std::span<double const> weights = {})
+-> std::optional<partial_stats<hlpr::centroid_value_t<PTS>>>
+{
+  using value_t = hlpr::centroid_value_t<PTS>;
+
+  auto const rows = hlpr::rows_of<value_t>(shard);
+  auto const dims = rows.dims();
+  auto const k = dims == 0 ? 0 : centroids.size() / dims;
+  if(k == 0 or centroids.size() != k * dims
+     or rows.size() != static_cast<size_type>(stdr::size(out_indices))
+     or not hlpr::valid_weights({ .weights = weights }, rows.size()))
+  { return std::nullopt; }
+
+  // The same pass as k_means over the same kind of input,
+  // so that distances and ties come out the same
+  if constexpr(hlpr::matrix_source<PTS>) {
+    flat_accumulator<value_t> acc(k, dims, weights);
+    auto const reassigned = hlpr::with_centroid_finder<value_t>(
+    centroid_search::automatic, k, dims,
+    [&](auto& finder)
+    {
+      finder.assign_rows(centroids.data());
+      return assign_and_accumulate_rows(policy, shard, out_indices, finder,
+                                        acc);
+    });
+    return hlpr::stats_of(acc, reassigned);
+  } else {
+    using centroid_type = centroid_t<PTS>;
+    std::vector<centroid_type> points_centroids(k);
+    for(size_type c{}; c < k; ++c) //
+    {
+      for(size_type d{}; d < dims; ++d) //
+      { points_centroids[c][d] = centroids[c * dims + d]; }
+    }
+    cluster_accumulator<centroid_type> acc(k, weights);
+    auto const reassigned = hlpr::with_centroid_finder<value_t>(
+    centroid_search::automatic, k, dims,
+    [&](auto& finder)
+    {
+      finder.assign(points_centroids);
+      return assign_and_accumulate(policy, shard, out_indices, finder,
+                                   acc);
+    });
+    return hlpr::stats_of(acc, reassigned);
+  }
+}
+
+template<typename PTS, hlpr::unsigned_range IDX_R>
+  requires (hlpr::matrix_source<PTS> or hlpr::data_points_range<PTS>)
+           and stdr::random_access_range<IDX_R>
+[[nodiscard]]
+auto local_step(PTS const& shard,
+                IDX_R&& out_indices,
+                std::span<hlpr::centroid_value_t<PTS> const> centroids,
+                std::span<double const> weights = {})
+-> std::optional<partial_stats<hlpr::centroid_value_t<PTS>>>
+{ return local_step(seq, shard, FWD(out_indices), centroids, weights); }
+// clang-format on
+
+// merge_stats: Stats of the union of shards, merged in the given order
+template<std::floating_point V>
+[[nodiscard]] auto merge_stats(std::span<partial_stats<V> const> shards)
+-> partial_stats<V>
+{
+  assert(not shards.empty());
+  partial_stats<V> merged(shards.front().k(), shards.front().dims);
+  for(auto const& shard: shards) merged.merge(shard);
+  return merged;
+}
+
+template<std::floating_point V>
+[[nodiscard]] auto merge_stats(std::vector<partial_stats<V>> const& shards)
+-> partial_stats<V>
+{ return merge_stats(std::span<partial_stats<V> const>{ shards }); }
+
+// move_centroids: Moves k x dims row-major centroids to the means of
+//                 merged stats, as the update of k_means does, and
+//                 handles the emptied clusters as the strategy says,
+//                 drop being taken as keep since the workers own the ids.
+//                 Returns the largest squared shift of a centroid.
+template<std::floating_point V>
+auto move_centroids(std::vector<V>& centroids,
+                    partial_stats<V> const& merged,
+                    empty_cluster_strategy empty_clusters) -> double
+{
+  flat_accumulator<V> acc(merged.k(), merged.dims);
+  stdr::transform(merged.sums, acc.sums.begin(), [](double sum)
+                  { return static_cast<hlpr::sum_t<V>>(sum); });
+  stdr::copy(merged.masses, acc.masses.begin());
+  stdr::transform(merged.counts, acc.counts.begin(), [](std::uint64_t count)
+                  { return static_cast<size_type>(count); });
+  stdr::copy(merged.farthest, acc.farthest.begin());
+  stdr::copy(merged.farthest_sqr, acc.farthest_sqr.begin());
+
+  if(empty_clusters == empty_cluster_strategy::drop)
+  { empty_clusters = empty_cluster_strategy::keep; }
+  return move_flat_centroids(centroids, acc, empty_clusters);
+}
+
+// distributed_result: What the coordinator found
+template<std::floating_point V>
+struct distributed_result
+{
+  // k x dims row-major
+  std::vector<V> centroids{};
+  size_type dims{};
+  // Measured by the last pass
+  std::vector<size_type> cluster_sizes{};
+  std::vector<double> cluster_sse{};
+  double inertia{};
+  // One sample per Lloyd iteration
+  std::vector<iteration_sample> trace{};
+  convergence_report convergence{};
+};
+
+// run_distributed: Coordinator side of the iterations, from k x dims
+//                  row-major initial centroids. step(centroids) must run
+//                  local_step on every shard against the centroids, a
+//                  std::span<V const>, and return the shards' stats in
+//                  shard order. Iterations stop on the criteria of
+//                  options, whose empty_clusters apply with drop taken
+//                  as keep and whose on_iteration is called after each
+//                  iteration; the seeding, algorithm, mini-batch, n_init
+//                  and weights options are the workers' or caller's.
+//                  Empty if dims or the centroids' size is off, or if
+//                  a shard's stats don't match the centroids.
+template<std::floating_point V>
+auto run_distributed(std::vector<V> centroids,
+                     size_type dims,
+                     k_means_options const& options,
+                     auto&& step) -> std::optional<distributed_result<V>>
+{
+  auto const k = dims == 0 ? 0 : centroids.size() / dims;
+  if(k == 0 or centroids.size() != k * dims) return std::nullopt;
+
+  partial_stats<V> merged(k, dims);
+  bool mismatch{};
+  size_type distances{};
+  std::vector<iteration_sample> trace;
+
+  auto convergence = iterate_until_converged(
+  options.convergence,
+  [&]
+  {
+    std::vector<partial_stats<V>> const shards =
+    step(std::span<V const>{ centroids });
+    mismatch = shards.empty()
+               or not stdr::all_of(shards, [&](auto const& shard)
+                                   { return shard.k() == k
+                                            and shard.dims == dims; });
+    // Stop on the next check instead of merging stats that don't fit
+    if(mismatch) return size_type{ 0 };
+
+    merged = merge_stats(shards);
+    distances += static_cast<size_type>(merged.distances);
+    return static_cast<size_type>(merged.reassigned);
+  },
+  [&]
+  {
+    if(mismatch) return 0.0;
+    return move_centroids(centroids, merged, options.empty_clusters);
+  },
+  [](size_type) { },
+  trace_iterations(trace, merged, options));
+  if(mismatch) return std::nullopt;
+
+  convergence.distances = distances;
+
+  distributed_result<V> result{ .centroids = std::move(centroids),
+                                .dims = dims,
+                                .inertia = merged.inertia,
+                                .trace = std::move(trace),
+                                .convergence = convergence };
+  result.cluster_sizes.assign(merged.counts.begin(), merged.counts.end());
+  result.cluster_sse = std::move(merged.sse);
+  return result;
+}
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef KMN_EXECUTION_HPP
+#define KMN_EXECUTION_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <kmn/Instrumentation.hpp>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace kmn {
+
+using size_type = std::size_t;
+
+/********************* Execution policies **********************/
+
+// sequenced_policy: Runs the passes over the points on the calling thread
+struct sequenced_policy
+{ };
+
+// parallel_policy: Spreads each pass over the points across thread_count threads,
+//                  or all hardware threads if thread_count is 0
+struct parallel_policy
+{
+  size_type thread_count{};
+
+  // clang-format off
+  [[nodiscard]]
+  auto threads() const noexcept -> size_type
+  {
+    if(thread_count != 0) return thread_count;
+    return std::max(size_type{ std::thread::hardware_concurrency() },
+                    size_type{ 1 });
+  }
+  // clang-format on
+};
+
+inline constexpr sequenced_policy seq{};
+inline constexpr parallel_policy par{};
+
+namespace hlpr {
+  template<typename P>
+  concept execution_policy = std::same_as<P, sequenced_policy>
+                             or std::same_as<P, parallel_policy>;
+
+  // Points per block of a parallel pass. It is fixed, independently
+  // of the thread count, so that the order in which the block partial
+  // sums are merged, hence the rounding of the sums, never changes.
+  inline constexpr size_type parallel_block_size = 8192;
+
+  // scaling_thread_counts: Thread counts to time a pass at, the powers
+  //                        of two below max_threads, then max_threads
+  [[nodiscard]] inline auto scaling_thread_counts(size_type max_threads)
+  -> std::vector<size_type>
+  {
+    std::vector<size_type> counts;
+    for(size_type threads{ 1 }; threads < max_threads; threads *= 2)
+      counts.push_back(threads);
+    counts.push_back(std::max(max_threads, size_type{ 1 }));
+    return counts;
+  }
+
+  // run_on_threads: Calls task(thread_idx) on n_threads threads,
+  //                 the calling thread being one of them, the others
+  //                 inheriting its profiler and phase
+  void run_on_threads(size_type n_threads, auto const& task)
+  {
+    hlpr::thread_context const context;
+    std::vector<std::jthread> workers;
+    workers.reserve(n_threads - 1);
+    for(size_type t{ 1 }; t < n_threads; ++t) //
+    {
+      workers.emplace_back(
+      [&task, context](size_type thread_idx)
+      {
+        profile_scope const scope{ context };
+        task(thread_idx);
+      },
+      t);
+    }
+    task(size_type{ 0 });
+  } // workers are joined on destruction
+
+  // ordered_block_reduce: Splits [0, n) into blocks of parallel_block_size
+  //                       handed out to the policy's threads. Each thread
+  //                       runs process(partial, first, last) on a block
+  //                       with its own partial from make_partial(), then
+  //                       merge(partial, result) once the preceding blocks
+  //                       have been merged, so merges run in block order.
+  void ordered_block_reduce(parallel_policy policy, size_type n,
+                            auto const& make_partial,
+                            auto const& process,
+                            auto const& merge)
+  {
+    auto const n_blocks =
+    (n + parallel_block_size - 1) / parallel_block_size;
+    auto const n_threads =
+    std::max(std::min(policy.threads(), n_blocks), size_type{ 1 });
+
+    std::atomic<size_type> next_block{ 0 };
+    std::atomic<size_type> merged_blocks{ 0 };
+
+    // Busy seconds of each thread, waits for merges excluded
+    thread_context const context;
+    std::vector<double> busy;
+    if constexpr(instrumented) busy.resize(n_threads);
+
+    auto const block_task = [&](size_type thread_idx)
+    {
+      auto partial = make_partial();
+      worker_clock clock{ context };
+
+      for(auto block = next_block++; block < n_blocks; block = next_block++) //
+      {
+        auto const first = block * parallel_block_size;
+        auto const last = std::min(n, first + parallel_block_size);
+
+        auto&& result = clock.time([&]() -> decltype(auto)
+                                   { return process(partial, first, last); });
+
+        // Wait for the preceding blocks to be merged
+        for(auto merged = merged_blocks.load(); merged != block;
+            merged = merged_blocks.load())
+        { merged_blocks.wait(merged); }
+
+        merge(partial, std::forward<decltype(result)>(result));
+
+        merged_blocks.store(block + 1);
+        merged_blocks.notify_all();
+      }
+      if constexpr(instrumented) busy[thread_idx] = clock.finish();
+    };
+
+    run_on_threads(n_threads, block_task);
+    count_threads(context, busy);
+  }
+
+  // Sequential counterpart of ordered_block_reduce over the same blocks
+  void ordered_block_reduce(sequenced_policy, size_type n,
+                            auto const& make_partial,
+                            auto const& process,
+                            auto const& merge)
+  {
+    auto partial = make_partial();
+    for(size_type first{}; first < n; first += parallel_block_size) //
+    {
+      auto&& result =
+      process(partial, first, std::min(n, first + parallel_block_size));
+      merge(partial, std::forward<decltype(result)>(result));
+    }
+  }
+
+  // for_each_block: Calls fn(block, first, last) for every block of
+  //                 block_size indices of [0, n). Blocks are the same
+  //                 whatever the policy, but run in no given order
+  //                 under parallel_policy.
+  void for_each_block(sequenced_policy, size_type n, size_type block_size,
+                      auto const& fn)
+  {
+    for(size_type block{}, first{}; first < n;
+        ++block, first += block_size)
+    { fn(block, first, std::min(n, first + block_size)); }
+  }
+
+  void for_each_block(parallel_policy policy, size_type n,
+                      size_type block_size, auto const& fn)
+  {
+    auto const n_blocks = (n + block_size - 1) / block_size;
+    auto const n_threads =
+    std::max(std::min(policy.threads(), n_blocks), size_type{ 1 });
+
+    std::atomic<size_type> next_block{ 0 };
+    thread_context const context;
+    std::vector<double> busy;
+    if constexpr(instrumented) busy.resize(n_threads);
+
+    run_on_threads(n_threads,
+                   [&](size_type thread_idx)
+                   {
+                     worker_clock clock{ context };
+                     for(auto block = next_block++; block < n_blocks;
+                         block = next_block++) //
+                     {
+                       auto const first = block * block_size;
+                       clock.time(
+                       [&]
+                       {
+                         fn(block, first, std::min(n, first + block_size));
+                       });
+                     }
+                     if constexpr(instrumented)
+                     { busy[thread_idx] = clock.finish(); }
+                   });
+    count_threads(context, busy);
+  }
+
+  // for_each_block: Same over blocks of parallel_block_size indices
+  void for_each_block(execution_policy auto policy, size_type n,
+                      auto const& fn)
+  { for_each_block(policy, n, parallel_block_size, fn); }
+} // namespace hlpr
+
+} // namespace kmn
+
+#endif
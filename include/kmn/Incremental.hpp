@@ -0,0 +1,315 @@
+#ifndef KMN_INCREMENTAL_HPP
+#define KMN_INCREMENTAL_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <kmn/K_means.hpp>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Incremental k_means over a dataset that changes a little between runs.
+// Per-cluster sums and counts are kept between calls, so appending or
+// removing points only adjusts them, and the passes of refine() skip the
+// distances that can't change an assignment: a point whose centroid
+// didn't move since it was assigned can only be taken over by a centroid
+// that moved, so it is only measured against these and its own.
+
+namespace kmn {
+
+template<std::floating_point V>
+class incremental_k_means
+{
+  size_type m_dims;
+  // k x dims row-major
+  std::vector<V> m_centroids;
+  // Centroids the points were last assigned against, whose
+  // assignments are therefore to their nearest one
+  std::vector<V> m_assigned;
+  // Kept in double so that sums don't drift as points
+  // are appended and removed over many updates
+  std::vector<double> m_sums;
+  std::vector<size_type> m_counts;
+
+  simd::centroid_block<V> m_block{ 0, 0 };
+  simd::centroid_block<V> m_moved_block{ 0, 0 };
+  std::vector<size_type> m_moved;
+  std::vector<V> m_moved_rows;
+  std::vector<V> m_distances;
+
+  void add_point(size_type c, V const* coords, double sign) noexcept
+  {
+    auto* sum = m_sums.data() + c * m_dims;
+    for(size_type d{}; d < m_dims; ++d) //
+    { sum[d] += sign * static_cast<double>(coords[d]); }
+  }
+
+  // move_centroids: Moves the centroids to their clusters' means, an
+  //                 emptied cluster's one staying put. Returns the largest
+  //                 squared shift of a centroid.
+  auto move_centroids() noexcept -> double
+  {
+    double max_sqr_shift{};
+    for(size_type c{}; c < m_counts.size(); ++c) //
+    {
+      if(m_counts[c] == 0) continue;
+
+      auto const count = static_cast<double>(m_counts[c]);
+      double sqr_shift{};
+      for(size_type d{}; d < m_dims; ++d) //
+      {
+        auto& coord = m_centroids[c * m_dims + d];
+        auto const mean = static_cast<V>(m_sums[c * m_dims + d] / count);
+        auto const delta = static_cast<double>(mean - coord);
+        sqr_shift += delta * delta;
+        coord = mean;
+      }
+      max_sqr_shift = std::max(max_sqr_shift, sqr_shift);
+    }
+    return max_sqr_shift;
+  }
+
+  // assign_all: Assigns every point to its nearest centroid
+  //             and rebuilds the sums and counts
+  void assign_all(auto const& rows, auto out)
+  {
+    using index_t = std::iter_value_t<decltype(out)>;
+
+    m_block.assign_rows(m_centroids.data());
+    m_distances.resize(m_block.stride());
+    std::ranges::fill(m_sums, 0.0);
+    std::ranges::fill(m_counts, size_type{ 0 });
+
+    rows.for_each(0, rows.size(),
+                  [&](size_type, V const* coords)
+                  {
+                    auto const c = m_block.nearest(coords, m_distances.data());
+                    *out++ = static_cast<index_t>(c + 1);
+                    add_point(c, coords, 1.0);
+                    ++m_counts[c];
+                  });
+    m_assigned = m_centroids;
+  }
+
+  // reassign: Pass over the points after the centroids moved.
+  //           Returns how many points changed cluster.
+  auto reassign(auto const& rows, auto out, convergence_report& counts)
+  -> size_type
+  {
+    using index_t = std::iter_value_t<decltype(out)>;
+    auto const k = m_counts.size();
+    auto const n = rows.size();
+
+    m_moved.clear();
+    for(size_type c{}; c < k; ++c) //
+    {
+      auto const first = static_cast<std::ptrdiff_t>(c * m_dims);
+      if(not std::equal(m_centroids.begin() + first,
+                        m_centroids.begin() + first
+                        + static_cast<std::ptrdiff_t>(m_dims),
+                        m_assigned.begin() + first))
+      { m_moved.push_back(c); }
+    }
+    if(m_moved.empty()) {
+      counts.skipped_distances += n * k;
+      return 0;
+    }
+
+    m_block.assign_rows(m_centroids.data());
+    m_moved_rows.clear();
+    for(auto const c: m_moved) //
+    {
+      auto const* row = m_centroids.data() + c * m_dims;
+      m_moved_rows.insert(m_moved_rows.end(), row, row + m_dims);
+    }
+    m_moved_block.reshape(m_moved.size(), m_dims);
+    m_moved_block.assign_rows(m_moved_rows.data());
+    m_distances.resize(std::max(m_block.stride(), m_moved_block.stride()));
+
+    size_type reassigned{};
+    rows.for_each(
+    0, n,
+    [&](size_type, V const* coords)
+    {
+      auto const current = static_cast<size_type>(*out) - 1;
+      auto nearest = current;
+
+      if(std::ranges::binary_search(m_moved, current)) {
+        nearest = m_block.nearest(coords, m_distances.data());
+        counts.distances += k;
+      } else {
+        // Only a moved centroid can be nearer, the first one on ties
+        auto best = hlpr::sqr_distance(
+        coords, m_centroids.data() + current * m_dims, m_dims);
+        m_moved_block.sqr_distances(coords, m_distances.data());
+        for(size_type j{}; j < m_moved.size(); ++j) //
+        {
+          auto const c = m_moved[j];
+          if(m_distances[j] < best or (m_distances[j] == best and c < nearest))
+          {
+            best = m_distances[j];
+            nearest = c;
+          }
+        }
+        counts.distances += m_moved.size() + 1;
+        counts.skipped_distances += k - m_moved.size() - 1;
+      }
+
+      if(nearest != current) {
+        *out = static_cast<index_t>(nearest + 1);
+        add_point(current, coords, -1.0);
+        add_point(nearest, coords, 1.0);
+        --m_counts[current];
+        ++m_counts[nearest];
+        ++reassigned;
+      }
+      ++out;
+    });
+
+    m_assigned = m_centroids;
+    return reassigned;
+  }
+
+  auto refine_impl(auto const& rows,
+                   auto&& out_indices,
+                   convergence_criteria const& criteria,
+                   size_type distances) -> convergence_report
+  {
+    convergence_report counts{ .distances = distances };
+    // Points appended or removed since the last pass moved the means
+    move_centroids();
+
+    auto report = iterate_until_converged(
+    criteria,
+    [&] { return reassign(rows, stdr::begin(out_indices), counts); },
+    [&] { return move_centroids(); }, [](size_type) { });
+
+    report.distances = counts.distances;
+    report.skipped_distances = counts.skipped_distances;
+    return report;
+  }
+
+  [[nodiscard]] auto matches(auto const& rows, auto const& out_indices) const
+  -> bool
+  {
+    return rows.dims() == m_dims
+           and rows.size() == static_cast<size_type>(stdr::size(out_indices));
+  }
+
+public:
+  // Starts from k >= 2 centroids of the same dimension, e.g. the
+  // centroids() of a k_means result; fit() then assigns the points
+  template<hlpr::centroids_range C_R>
+  explicit incremental_k_means(C_R const& centroids)
+  : m_dims{ static_cast<size_type>(stdr::size(*stdr::begin(centroids))) },
+    m_sums(stdr::size(centroids) * m_dims),
+    m_counts(stdr::size(centroids))
+  {
+    assert(stdr::size(centroids) >= 2
+           and hlpr::given_dims(centroids, m_dims));
+    m_centroids.reserve(m_sums.size());
+    for(auto const& centroid: centroids) {
+      for(size_type d{}; d < m_dims; ++d) //
+      { m_centroids.push_back(static_cast<V>(centroid[d])); }
+    }
+    m_assigned = m_centroids;
+    m_block.reshape(m_counts.size(), m_dims);
+  }
+
+  // clang-format off
+  [[nodiscard]] auto k() const noexcept { return m_counts.size(); }
+  [[nodiscard]] auto dims() const noexcept { return m_dims; }
+
+  [[nodiscard]] auto centroid(size_type c) const noexcept -> std::span<V const>
+  { return { m_centroids.data() + c * m_dims, m_dims }; }
+
+  [[nodiscard]] auto cluster_sizes() const noexcept
+  -> std::span<size_type const>
+  { return m_counts; }
+
+  // clang-format on
+  // fit: Assigns every point of a DataPoint range or matrix source to
+  //      its nearest centroid, then refines the clusters
+  template<hlpr::unsigned_range IDX_R>
+  auto fit(auto const& points,
+           IDX_R&& out_indices,
+           convergence_criteria const& criteria)
+  -> std::optional<convergence_report>
+  {
+    auto const rows = hlpr::rows_of<V>(points);
+    if(not matches(rows, out_indices)) return std::nullopt;
+
+    assign_all(rows, stdr::begin(out_indices));
+    return refine_impl(rows, out_indices, criteria, rows.size() * k());
+  }
+
+  // append: Assigns points appended to the dataset, out_indices being
+  //         theirs only, without moving the centroids yet
+  template<hlpr::unsigned_range IDX_R>
+  auto append(auto const& points, IDX_R&& out_indices) -> bool
+  {
+    using index_t = stdr::range_value_t<IDX_R>;
+
+    auto const rows = hlpr::rows_of<V>(points);
+    if(not matches(rows, out_indices)) return false;
+
+    // Against the centroids the other points are assigned to
+    m_block.assign_rows(m_assigned.data());
+    m_distances.resize(m_block.stride());
+    auto out = stdr::begin(out_indices);
+    rows.for_each(0, rows.size(),
+                  [&](size_type, V const* coords)
+                  {
+                    auto const c = m_block.nearest(coords, m_distances.data());
+                    *out++ = static_cast<index_t>(c + 1);
+                    add_point(c, coords, 1.0);
+                    ++m_counts[c];
+                  });
+    return true;
+  }
+
+  // remove: Takes points removed from the dataset, along with
+  //         their ids, out of their clusters' sums and counts
+  template<hlpr::unsigned_range IDX_R>
+  auto remove(auto const& points, IDX_R const& out_indices) -> bool
+  {
+    auto const rows = hlpr::rows_of<V>(points);
+    if(not matches(rows, out_indices)) return false;
+
+    auto id = stdr::begin(out_indices);
+    rows.for_each(0, rows.size(),
+                  [&](size_type, V const* coords)
+                  {
+                    auto const c = static_cast<size_type>(*id++) - 1;
+                    add_point(c, coords, -1.0);
+                    --m_counts[c];
+                  });
+    return true;
+  }
+
+  // refine: Moves the centroids to their clusters' means and runs passes
+  //         over the whole dataset, with its current ids, until the
+  //         criteria are met. Only the points of moved centroids are
+  //         measured against every centroid.
+  template<hlpr::unsigned_range IDX_R>
+  auto refine(auto const& points,
+              IDX_R&& out_indices,
+              convergence_criteria const& criteria)
+  -> std::optional<convergence_report>
+  {
+    auto const rows = hlpr::rows_of<V>(points);
+    if(not matches(rows, out_indices)) return std::nullopt;
+
+    return refine_impl(rows, out_indices, criteria, 0);
+  }
+};
+
+template<hlpr::centroids_range C_R>
+incremental_k_means(C_R const&)
+-> incremental_k_means<typename hlpr::select_centroid_t<
+   hlpr::centroid_coord_t<C_R>, 1>::value_type>;
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,462 @@
+#ifndef KMN_INSTRUMENTATION_HPP
+#define KMN_INSTRUMENTATION_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fmt/core.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Instrumentation of the k_means hot paths, compiled in when
+// KMN_INSTRUMENTATION is defined to 1 in every translation unit
+// including kmn. Without it, phase_scope and the counting functions
+// are empty inline no-ops and the run_profile of every result is empty.
+#ifndef KMN_INSTRUMENTATION
+#define KMN_INSTRUMENTATION 0
+#endif
+
+#if KMN_INSTRUMENTATION
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace kmn {
+
+using size_type = std::size_t;
+
+// phase: Stages of a k_means run the instrumentation tells apart
+enum class phase
+{
+  seeding, // Picking the initial centroids
+  assignment, // Passes assigning every point to its nearest centroid
+  update, // Moving the centroids to the means of their points
+  mini_batch, // Mini-batch steps
+  histogram // Sorting the points' positions by cluster for the result
+};
+
+inline constexpr size_type phase_count = 5;
+
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(phase stage) noexcept -> std::string_view
+{
+  switch(stage) {
+    case phase::seeding: return "seeding";
+    case phase::assignment: return "assignment";
+    case phase::update: return "update";
+    case phase::mini_batch: return "mini_batch";
+    case phase::histogram: return "histogram";
+  }
+  return "unknown";
+}
+
+// clang-format on
+// phase_stats: What the instrumentation measured of one phase
+struct phase_stats
+{
+  // Times the phase was entered, and its wall time on the thread that
+  // entered it, inner phases included
+  size_type calls{};
+  double seconds{};
+  // Point-to-centroid distances measured, as the convergence report
+  // counts them
+  size_type distances{};
+  // Estimated bytes of coordinates, centroids and ids read or written
+  size_type bytes{};
+  // Passes split over threads, and summed over them, the busy time of
+  // their busiest thread and of their threads on average
+  size_type parallel_passes{};
+  double busiest_thread_seconds{};
+  double mean_thread_seconds{};
+
+  // load_imbalance: Busiest over mean thread time, 1 when the threads
+  //                 were evenly loaded or ran no parallel pass
+  [[nodiscard]] auto load_imbalance() const noexcept -> double
+  {
+    return mean_thread_seconds > 0.0
+           ? busiest_thread_seconds / mean_thread_seconds
+           : 1.0;
+  }
+};
+
+// trace_event: A span of a phase on a thread, in seconds since
+//              the start of the run; thread 0 is the one that ran it
+struct trace_event
+{
+  phase stage{};
+  size_type thread{};
+  double start{};
+  double seconds{};
+};
+
+// run_profile: Phase statistics and trace events of an instrumented run
+struct run_profile
+{
+  std::array<phase_stats, phase_count> phases{};
+  std::vector<trace_event> events{};
+  // Events past the profiler's limit, counted but not kept
+  size_type dropped_events{};
+
+  // clang-format off
+  [[nodiscard]] auto operator[](phase stage) const noexcept
+  -> phase_stats const&
+  { return phases[static_cast<size_type>(stage)]; }
+
+  [[nodiscard]] auto operator[](phase stage) noexcept -> phase_stats&
+  { return phases[static_cast<size_type>(stage)]; }
+
+  // clang-format on
+  // summary: One line per phase entered, empty if none was
+  [[nodiscard]] auto summary() const -> std::string
+  {
+    std::string lines;
+    for(size_type p{}; p < phase_count; ++p) //
+    {
+      auto const& stats = phases[p];
+      if(stats.calls == 0) continue;
+      lines += fmt::format(
+      "{:<10} {:>6} calls {:>10.6f} s {:>14} distances {:>14} bytes"
+      "{}\n",
+      to_string(static_cast<phase>(p)), stats.calls, stats.seconds,
+      stats.distances, stats.bytes,
+      stats.parallel_passes == 0
+      ? std::string{}
+      : fmt::format(", {} parallel passes, imbalance {:.3f}",
+                    stats.parallel_passes, stats.load_imbalance()));
+    }
+    return lines;
+  }
+
+  // chrome_trace: The events in the Chrome trace event format, which
+  //               chrome://tracing and Perfetto load, one complete
+  //               event per span, in microseconds
+  [[nodiscard]] auto chrome_trace() const -> std::string
+  {
+    std::string json{ "{\"traceEvents\":[" };
+    for(bool first{ true }; auto const& event: events) //
+    {
+      json += fmt::format(
+      "{}\n{{\"name\":\"{}\",\"cat\":\"kmn\",\"ph\":\"X\",\"pid\":1,"
+      "\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+      first ? "" : ",", to_string(event.stage), event.thread,
+      event.start * 1e6, event.seconds * 1e6);
+      first = false;
+    }
+    json += fmt::format("\n],\"displayTimeUnit\":\"ms\","
+                        "\"otherData\":{{\"dropped_events\":{}}}}}\n",
+                        dropped_events);
+    return json;
+  }
+};
+
+namespace hlpr {
+  inline constexpr bool instrumented = KMN_INSTRUMENTATION != 0;
+
+#if KMN_INSTRUMENTATION
+  // profiler: Collects the run_profile of a run from every thread taking
+  //           part in it. Threads count the work of a pass or a phase
+  //           locally and hand it over once, under a lock.
+  class profiler
+  {
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point m_start{ clock::now() };
+    size_type m_event_limit;
+    std::mutex m_mutex;
+    run_profile m_profile;
+    std::vector<std::thread::id> m_threads;
+
+    // thread_index: Small index of the calling thread, by first report
+    [[nodiscard]] auto thread_index() -> size_type
+    {
+      auto const id = std::this_thread::get_id();
+      auto const it = std::ranges::find(m_threads, id);
+      if(it != m_threads.end())
+      { return static_cast<size_type>(it - m_threads.begin()); }
+      m_threads.push_back(id);
+      return m_threads.size() - 1;
+    }
+
+    void add_event(phase stage, clock::time_point start,
+                   clock::time_point end)
+    {
+      if(m_profile.events.size() >= m_event_limit) {
+        ++m_profile.dropped_events;
+        return;
+      }
+      m_profile.events.push_back(
+      { .stage = stage,
+        .thread = thread_index(),
+        .start = std::chrono::duration<double>(start - m_start).count(),
+        .seconds = std::chrono::duration<double>(end - start).count() });
+    }
+
+  public:
+    using time_point = clock::time_point;
+
+    // Keeps a run of a few hundred iterations over tens of threads
+    static constexpr size_type default_event_limit = size_type{ 1 } << 20;
+
+    explicit profiler(size_type event_limit = default_event_limit)
+    : m_event_limit{ event_limit }
+    {
+      std::scoped_lock const lock{ m_mutex };
+      (void)thread_index();
+    }
+
+    [[nodiscard]] static auto now() noexcept -> time_point
+    { return clock::now(); }
+
+    // phase_ended: Counts a call of the phase that ran from start to end
+    //              on the calling thread
+    void phase_ended(phase stage, time_point start, time_point end)
+    {
+      std::scoped_lock const lock{ m_mutex };
+      auto& stats = m_profile[stage];
+      ++stats.calls;
+      stats.seconds += std::chrono::duration<double>(end - start).count();
+      add_event(stage, start, end);
+    }
+
+    // worker_ended: Adds the span of a pass' worker thread to the trace
+    void worker_ended(phase stage, time_point start, time_point end)
+    {
+      std::scoped_lock const lock{ m_mutex };
+      add_event(stage, start, end);
+    }
+
+    void add_work(phase stage, size_type distances, size_type bytes)
+    {
+      std::scoped_lock const lock{ m_mutex };
+      m_profile[stage].distances += distances;
+      m_profile[stage].bytes += bytes;
+    }
+
+    // add_threads: Counts a parallel pass from its threads' busy seconds
+    void add_threads(phase stage, std::vector<double> const& busy)
+    {
+      if(busy.empty()) return;
+      double total{};
+      for(auto const seconds: busy) total += seconds;
+      std::scoped_lock const lock{ m_mutex };
+      auto& stats = m_profile[stage];
+      ++stats.parallel_passes;
+      stats.busiest_thread_seconds += *std::ranges::max_element(busy);
+      stats.mean_thread_seconds += total / static_cast<double>(busy.size());
+    }
+
+    [[nodiscard]] auto take() -> run_profile
+    {
+      std::scoped_lock const lock{ m_mutex };
+      return std::move(m_profile);
+    }
+  };
+
+  // The profiler and the innermost phase of the run on this thread
+  inline thread_local profiler* active_profiler = nullptr;
+  inline thread_local phase const* active_phase = nullptr;
+
+  // thread_context: What a thread a pass starts inherits from the
+  //                 thread starting it
+  struct thread_context
+  {
+    profiler* prof{ active_profiler };
+    phase const* stage{ active_phase };
+  };
+
+  // profile_scope: Makes a profiler, and the phase of a context, the
+  //                active ones on this thread for its lifetime
+  class profile_scope
+  {
+    profiler* m_previous_profiler;
+    phase const* m_previous_phase;
+
+  public:
+    explicit profile_scope(thread_context const& context) noexcept
+    : m_previous_profiler{ active_profiler },
+      m_previous_phase{ active_phase }
+    {
+      active_profiler = context.prof;
+      active_phase = context.stage;
+    }
+
+    explicit profile_scope(profiler* prof) noexcept
+    : profile_scope(thread_context{ prof, nullptr })
+    { }
+
+    profile_scope(profile_scope const&) = delete;
+    auto operator=(profile_scope const&) -> profile_scope& = delete;
+
+    ~profile_scope()
+    {
+      active_profiler = m_previous_profiler;
+      active_phase = m_previous_phase;
+    }
+  };
+
+  // outer_profiler: The active profiler if any, so that runs nested in
+  //                 a profiled one report to it, else own
+  [[nodiscard]] inline auto outer_profiler(profiler* own) noexcept
+  -> profiler*
+  { return active_profiler != nullptr ? active_profiler : own; }
+
+  // phase_scope: Times a phase on this thread, to which the work and
+  //              the passes counted meanwhile are attributed
+  class phase_scope
+  {
+    phase m_phase;
+    phase const* m_previous;
+    profiler::time_point m_start;
+
+  public:
+    explicit phase_scope(phase stage) noexcept
+    : m_phase{ stage },
+      m_previous{ active_phase },
+      m_start{ profiler::now() }
+    { active_phase = &m_phase; }
+
+    phase_scope(phase_scope const&) = delete;
+    auto operator=(phase_scope const&) -> phase_scope& = delete;
+
+    ~phase_scope()
+    {
+      active_phase = m_previous;
+      if(active_profiler != nullptr) {
+        active_profiler->phase_ended(m_phase, m_start, profiler::now());
+      }
+    }
+  };
+
+  // count_work: Adds distances and bytes to the active phase
+  inline void count_work(size_type distances, size_type bytes)
+  {
+    if(active_profiler != nullptr and active_phase != nullptr)
+    { active_profiler->add_work(*active_phase, distances, bytes); }
+  }
+
+  // worker_clock: Busy time of a pass' worker thread, counted around
+  //               each block it processes, and its span for the trace
+  class worker_clock
+  {
+    thread_context m_context;
+    profiler::time_point m_first{};
+    profiler::time_point m_last{};
+    double m_busy{};
+
+  public:
+    explicit worker_clock(thread_context const& context) noexcept
+    : m_context{ context }
+    { }
+
+    [[nodiscard]] auto enabled() const noexcept -> bool
+    { return m_context.prof != nullptr and m_context.stage != nullptr; }
+
+    // time: Runs fn(), counting its wall time as busy
+    decltype(auto) time(auto&& fn)
+    {
+      if(not enabled()) return fn();
+      auto const start = profiler::now();
+      if(m_busy == 0.0) m_first = start;
+      struct stop
+      {
+        worker_clock& self;
+        profiler::time_point start;
+        ~stop()
+        {
+          self.m_last = profiler::now();
+          self.m_busy +=
+          std::chrono::duration<double>(self.m_last - start).count();
+        }
+      } const timer{ *this, start };
+      return fn();
+    }
+
+    // finish: Hands the span to the profiler, returns the busy seconds
+    auto finish() -> double
+    {
+      if(enabled() and m_busy > 0.0) {
+        m_context.prof->worker_ended(*m_context.stage, m_first, m_last);
+      }
+      return m_busy;
+    }
+  };
+
+  // count_threads: Counts a parallel pass from its threads' busy seconds
+  inline void count_threads(thread_context const& context,
+                            std::vector<double> const& busy)
+  {
+    if(context.prof != nullptr and context.stage != nullptr)
+    { context.prof->add_threads(*context.stage, busy); }
+  }
+#else
+  // Empty stand-ins the compiler removes entirely
+  class profiler
+  {
+  public:
+    [[nodiscard]] auto take() noexcept -> run_profile { return {}; }
+  };
+
+  struct thread_context
+  { };
+
+  class profile_scope
+  {
+  public:
+    explicit profile_scope(thread_context const&) noexcept { }
+    explicit profile_scope(profiler*) noexcept { }
+  };
+
+  [[nodiscard]] inline auto outer_profiler(profiler* own) noexcept
+  -> profiler*
+  { return own; }
+
+  class phase_scope
+  {
+  public:
+    explicit phase_scope(phase) noexcept { }
+  };
+
+  inline void count_work(size_type, size_type) noexcept { }
+
+  class worker_clock
+  {
+  public:
+    explicit worker_clock(thread_context const&) noexcept { }
+
+    decltype(auto) time(auto&& fn) { return fn(); }
+
+    auto finish() noexcept -> double { return 0.0; }
+  };
+
+  inline void count_threads(thread_context const&,
+                            std::vector<double> const&) noexcept
+  { }
+#endif
+
+  // in_phase: fn() timed as a call of the phase
+  decltype(auto) in_phase(phase stage, auto&& fn)
+  {
+    phase_scope const scope{ stage };
+    return fn();
+  }
+
+  // count_pass: Counts, for the active phase, the distances a pass over
+  //             n points of dims V coordinates measured against k
+  //             centroids, and the bytes of their coordinates and ids
+  template<typename V>
+  void count_pass(size_type n, size_type k, size_type dims,
+                  size_type distances)
+  {
+    if constexpr(instrumented) {
+      count_work(distances,
+                 (n + k) * dims * sizeof(V) + n * sizeof(size_type));
+    }
+  }
+} // namespace hlpr
+
+} // namespace kmn
+
+#endif
@@ -2,11 +2,25 @@
 #define KMN_K_MEANS_HPP
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <concepts>
 #include <fmt/ranges.h>
+#include <functional>
+#include <kmn/Centroid_index.hpp>
 #include <kmn/DataPoint.hpp>
+#include <kmn/Distance_kernels.hpp>
+#include <kmn/Execution.hpp>
+#include <kmn/Instrumentation.hpp>
+#include <kmn/Matrix_view.hpp>
+#include <kmn/Mini_batch.hpp>
+#include <kmn/Seeding.hpp>
+#include <limits>
 #include <numeric> // std::transform_reduce
 #include <optional>
+#include <random>
 #include <range/v3/range/conversion.hpp> // ranges::to
 #include <range/v3/view/filter.hpp>
 #include <range/v3/view/iota.hpp>
@@ -14,6 +28,10 @@
 #include <range/v3/view/sample.hpp>
 #include <range/v3/view/transform.hpp>
 #include <range/v3/view/zip.hpp>
+#include <span>
+#include <string_view>
+#include <tuple> // std::tie
+#include <utility> // std::in_range
 #include <vector>
 
 #define FWD(x) static_cast<decltype(x)&&>(x) // NOLINT
@@ -26,6 +44,10 @@ namespace stdr = std::ranges;
 namespace r = ranges; // range-v3
 namespace rv = r::views;
 
+// Defined in kmn/Workspace.hpp, included below
+template<std::floating_point V>
+class workspace;
+
 namespace hlpr {
   /********************* select_centroid *************************/
   // clang-format off
@@ -75,175 +97,817 @@ namespace hlpr {
 
 // sqr_dist: computes euclidean square distance
 //           between two data points
+//           in the centroids' value type
 template<typename T1, typename T2, size_type D>
 [[nodiscard]] constexpr //
 auto sqr_distance(DataPoint<T1, D> const& dp1, //
                   DataPoint<T2, D> const& dp2)
 {
+  using acc_t = std::common_type_t<
+  typename hlpr::select_centroid_t<T1, D>::value_type,
+  typename hlpr::select_centroid_t<T2, D>::value_type>;
+
   return std::transform_reduce(
-  dp1.cbegin(), dp1.cend(), dp2.cbegin(), 0,
-  [](T1 a, T2 b) { return a + b; },
-  [](T1 a, T2 b) { return (a - b) * (a - b); });
+  dp1.cbegin(), dp1.cend(), dp2.cbegin(), acc_t{}, std::plus{},
+  [](T1 a, T2 b)
+  {
+    auto const diff = static_cast<acc_t>(a) - static_cast<acc_t>(b);
+    return diff * diff;
+  });
 }
 
-// distance_from: Function Object Comparator
-//                of distances from two points to a reference point
-template<typename T, size_type D> //
-class distance_from
+template<typename PTS_R>
+using centroid_t =
+hlpr::select_centroid_t<hlpr::point_value_t<PTS_R>,
+                        hlpr::data_point_size_v<stdr::range_value_t<PTS_R>>>;
+
+// match_id: Used in k_means_result
+struct match_id
 {
-  using target_point_t = DataPoint<T, D>;
-  target_point_t m_pt;
-
-  public:
+  size_type cent_id;
+  // clang-format off
+  [[nodiscard]] constexpr
+  auto operator()(auto const& indexed_point) const -> bool
+  { return cent_id == std::get<0>(indexed_point); }
+  
+}; //struct match_id
 
-  distance_from() = delete;
+// clang-format on
 
-  constexpr explicit distance_from(target_point_t const& pt) //
-  : m_pt{ pt }
-  { }
+namespace hlpr {
+  // sum_t: Type the coordinates of V centroids are summed in; at least
+  //        double, so that sums of many float points keep their precision
+  template<std::floating_point V>
+  using sum_t = std::conditional_t<(sizeof(V) < sizeof(double)), double, V>;
+
+  // coords_of: Copies a point's coordinates, converted
+  //            to the centroids' value type, into coords
+  template<typename V>
+  constexpr void coords_of(auto const& pt, V* coords) noexcept
+  {
+    for(size_type d{}; d < pt.size(); ++d) //
+    { coords[d] = static_cast<V>(pt[d]); }
+  }
 
-  // clang-format off
-  template<typename U>
-  [[nodiscard]] constexpr
-  auto operator()(DataPoint<U, D> const& c1,
-                  DataPoint<U, D> const& c2) const -> bool
-  { return sqr_distance(c1, m_pt) < sqr_distance(c2, m_pt); }
-}; // struct distance_from
+  // data_point_rows: Row source, as the seeding engines read them,
+  //                  over a range of DataPoints
+  template<std::floating_point V, typename R>
+  class data_point_rows
+  {
+    static constexpr size_type dims_v = //
+    data_point_size_v<stdr::range_value_t<R>>;
+
+    R const* m_points;
+    size_type m_size;
+
+  public:
+    data_point_rows(R const& points, size_type n) noexcept
+    : m_points{ &points }, m_size{ n }
+    { }
+
+    // clang-format off
+    [[nodiscard]] auto size() const noexcept { return m_size; }
+    [[nodiscard]] auto dims() const noexcept { return dims_v; }
+
+    void load(size_type i, V* coords) const
+    {
+      coords_of(*stdr::next(stdr::begin(*m_points),
+                            static_cast<std::ptrdiff_t>(i)), coords);
+    }
+
+    void for_each(size_type first, size_type last, auto&& fn) const
+    {
+      std::array<V, dims_v> coords{};
+      auto it = stdr::next(stdr::begin(*m_points),
+                           static_cast<std::ptrdiff_t>(first));
+      for(auto i = first; i < last; ++i, ++it) {
+        coords_of(*it, coords.data());
+        fn(i, coords.data());
+      }
+    }
+    // clang-format on
+  };
+} // namespace hlpr
+
+[[nodiscard]] //
+//Note: Maybe constexpr when it's implemented for std::vector
+auto clusters_histogram(auto const& indices,
+                        size_type k)
+-> std::vector<size_type>
+{
+  std::vector<size_type> cluster_sizes(k);
+  for(auto i: indices) ++cluster_sizes[i - 1];
+  return cluster_sizes;
+}
+
+/******************* Fused Lloyd iterations ********************/
+
+// stop_reason: Why the Lloyd iterations of k_means_impl stopped
+enum class stop_reason
+{
+  max_iterations, // The iteration cap was reached
+  tolerance, // No centroid moved farther than the tolerance
+  no_reassignment // A pass left every point in its cluster
+};
+
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(stop_reason reason) noexcept -> std::string_view
+{
+  switch(reason) {
+    case stop_reason::max_iterations: return "max_iterations";
+    case stop_reason::tolerance: return "tolerance";
+    case stop_reason::no_reassignment: return "no_reassignment";
+  }
+  return "unknown";
+}
 
 // clang-format on
-template<typename PTS_R>
-using centroid_t =
-hlpr::select_centroid_t<hlpr::point_value_t<PTS_R>,
-                        hlpr::data_point_size_v<stdr::range_value_t<PTS_R>>>;
+// assignment_algorithm: How the passes find each point's nearest centroid
+enum class assignment_algorithm
+{
+  lloyd, // Measures every point against every centroid
+  hamerly, // Keeps one lower bound per point, skips whole points
+  elkan // Keeps k lower bounds per point, skips single centroids
+};
 
-template<typename PTS_R>
-using indexed_centroids_t =
-std::vector<std::pair<size_type, centroid_t<PTS_R>>>;
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(assignment_algorithm algorithm) noexcept -> std::string_view
+{
+  switch(algorithm) {
+    case assignment_algorithm::lloyd: return "lloyd";
+    case assignment_algorithm::hamerly: return "hamerly";
+    case assignment_algorithm::elkan: return "elkan";
+  }
+  return "unknown";
+}
 
-template<typename PTS_R>
-[[nodiscard]] constexpr //
-auto init_centroids(PTS_R const& data_points, size_type k)
--> indexed_centroids_t<PTS_R>
+// clang-format on
+// centroid_search: How Lloyd passes look for a point's nearest centroid
+//                  among all k; every choice finds the same one
+enum class centroid_search
+{
+  automatic, // A k-d tree when k and dims make it pay, see search_tree
+  brute_force, // One kernel call over every centroid
+  kd_tree, // A centroid_index, rebuilt before every pass
+  ball_tree // Same, as a ball tree
+};
+
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(centroid_search search) noexcept -> std::string_view
+{
+  switch(search) {
+    case centroid_search::automatic: return "automatic";
+    case centroid_search::brute_force: return "brute_force";
+    case centroid_search::kd_tree: return "kd_tree";
+    case centroid_search::ball_tree: return "ball_tree";
+  }
+  return "unknown";
+}
+
+// empty_cluster_strategy: What an update does with a cluster
+//                         whose points the pass all took away
+enum class empty_cluster_strategy
+{
+  keep, // Its centroid stays put
+  farthest_point, // Its centroid moves to the point farthest from its own
+  largest_cluster, // Its centroid moves to the largest cluster's farthest
+  drop // It is removed from the result once iterations stop
+};
+
+[[nodiscard]] constexpr
+auto to_string(empty_cluster_strategy strategy) noexcept -> std::string_view
+{
+  switch(strategy) {
+    case empty_cluster_strategy::keep: return "keep";
+    case empty_cluster_strategy::farthest_point: return "farthest_point";
+    case empty_cluster_strategy::largest_cluster: return "largest_cluster";
+    case empty_cluster_strategy::drop: return "drop";
+  }
+  return "unknown";
+}
+
+// clang-format on
+// convergence_criteria: Stopping rules of the Lloyd iterations
+struct convergence_criteria
+{
+  // At least one iteration is always run
+  size_type max_iterations{ 300 };
+  // Largest euclidean centroid shift under which iterations stop
+  double tolerance{ 0.0 };
+};
+
+// convergence_report: How many Lloyd iterations ran and why they stopped
+struct convergence_report
+{
+  size_type iterations{};
+  stop_reason reason{ stop_reason::max_iterations };
+  // Point-to-centroid distances measured over all passes, and those
+  // the bounds of hamerly and elkan ruled out
+  size_type distances{};
+  size_type skipped_distances{};
+};
+
+// iteration_sample: What one Lloyd iteration did
+struct iteration_sample
+{
+  size_type iteration{};
+  // Restart the iteration belongs to when options.n_init > 1
+  size_type restart{};
+  // Wall time of the pass and update
+  double seconds{};
+  // Points whose id the pass changed, i.e. whose id differed from
+  // what out_indices held before the first pass
+  size_type reassigned{};
+  // Largest euclidean shift of a centroid by the update
+  double max_shift{};
+  // Sum of squared distances of the points to the centroids
+  // the pass assigned them to
+  double inertia{};
+};
+
+// k_means_options: Everything a k_means call can be tuned with
+struct k_means_options
 {
-  using pt_value_t = hlpr::point_value_t<PTS_R>;
-  using rv::sample, r::to, rv::zip;
-  using id_centroids_t = indexed_centroids_t<PTS_R>;
+  convergence_criteria convergence{};
+  seeding_options seeding{};
+  assignment_algorithm algorithm{ assignment_algorithm::lloyd };
+  // Applies to lloyd, whose passes it may speed up when k is large
+  // and dims small; hamerly and elkan measure their own way
+  centroid_search search{ centroid_search::automatic };
+  // When set, mini-batch steps replace the full passes, followed by one
+  // assignment pass; convergence.tolerance still applies to the steps.
+  // The seeds' inertia isn't measured then, as it would take a full pass.
+  std::optional<mini_batch_options> mini_batch{};
+  // Independently seeded runs, the one of least inertia being kept.
+  // Ignored by warm starts, workspaces and k_means_stream.
+  size_type n_init{ 1 };
+  // One positive weight per point, or none for all 1: a point weighs in
+  // the seeding, the centroid means and the inertia as that many copies
+  // of it would, but counts once in the cluster sizes. The weights must
+  // outlive the call. Ignored by k_means_stream.
+  std::span<double const> weights{};
+  // Applied by every Lloyd update; k_means_stream, whose ids are
+  // already handed out, keeps the clusters it would drop
+  empty_cluster_strategy empty_clusters{
+    empty_cluster_strategy::farthest_point
+  };
+  // Called after every Lloyd iteration, on the thread running it;
+  // restarts under a parallel_policy call it concurrently. Mini-batch
+  // steps have their own trace in the mini_batch_report instead.
+  std::function<void(iteration_sample const&)> on_iteration{};
+};
+
+namespace hlpr {
+  // to_options: Lifts the last argument of k_means into k_means_options,
+  //             which on_iteration keeps from being a literal type
+  [[nodiscard]] //
+  inline auto to_options(std::integral auto n) -> k_means_options
+  {
+    return { .convergence = { .max_iterations = static_cast<size_type>(n) } };
+  }
 
-  // Initialize centroid ids
-  auto const ids = rv::iota(size_type{ 1 }, k + 1);
+  [[nodiscard]] //
+  inline auto to_options(convergence_criteria const& criteria)
+  -> k_means_options
+  { return { .convergence = criteria }; }
+
+  [[nodiscard]] //
+  inline auto to_options(k_means_options const& options) -> k_means_options
+  { return options; }
+
+  template<typename C>
+  concept k_means_config = requires(C const& config) { to_options(config); };
+
+  // search_tree: Tree Lloyd passes over k centroids of dims coordinates
+  //              search, if any. Measured by kmn_bench's search phases
+  //              over Gaussian blobs, k-d trees beat brute force from
+  //              k = 128 in up to 4 dimensions, k = 1024 in 8 and
+  //              k = 4096 in 16, and ball trees nowhere k-d trees don't;
+  //              automatic searches stay brute force elsewhere.
+  [[nodiscard]] constexpr //
+  auto search_tree(centroid_search search, size_type k,
+                   size_type dims) noexcept -> std::optional<centroid_tree>
+  {
+    switch(search) {
+      case centroid_search::automatic: break;
+      case centroid_search::brute_force: return std::nullopt;
+      case centroid_search::kd_tree: return centroid_tree::kd_tree;
+      case centroid_search::ball_tree: return centroid_tree::ball_tree;
+    }
+    if((dims <= 4 and k >= 128) or (dims <= 8 and k >= 1024)
+       or (dims <= 16 and k >= 4096))
+    { return centroid_tree::kd_tree; }
+    return std::nullopt;
+  }
 
-  // Sample points for centroids
-  auto const sample_points = data_points | sample(k);
+  // centroid_finder: The blocks and indexes Lloyd passes search
+  template<typename F, typename V>
+  concept centroid_finder = std::same_as<F, simd::centroid_block<V>>
+                            or std::same_as<F, centroid_index<V>>;
+
+  // with_centroid_finder: Calls fn with a centroid_block or a
+  //                       centroid_index of k centroids of dims
+  //                       coordinates, as search_tree picks
+  template<std::floating_point V>
+  auto with_centroid_finder(centroid_search search, size_type k,
+                            size_type dims, auto&& fn)
+  {
+    if(auto const tree = search_tree(search, k, dims)) {
+      centroid_index<V> index(k, dims, *tree);
+      return fn(index);
+    }
+    simd::centroid_block<V> block(k, dims);
+    return fn(block);
+  }
 
-  // Initialize centroids with a sample of K points from data_points
-  if constexpr(std::floating_point<pt_value_t>) //
+  // find_nearest: finder.nearest(pt, distances), adding the distances
+  //               it measured, all k for a block, to measured
+  template<std::floating_point V>
+  auto find_nearest(simd::centroid_block<V> const& block, V const* pt,
+                    V* distances, size_type& measured) noexcept -> size_type
   {
-    return to<id_centroids_t>(zip(ids, sample_points));
-  } else {
-    // data_points here has integral value types 'T'
-    // centroids (which get updated with means) have floating point
-    // value types so the sampled points' value types need to match
-    auto constexpr point_size =
-    hlpr::data_point_size_v<stdr::range_value_t<PTS_R>>;
+    measured += block.size();
+    return block.nearest(pt, distances);
+  }
+
+  template<std::floating_point V>
+  auto find_nearest(centroid_index<V> const& index, V const* pt,
+                    V* distances, size_type& measured) noexcept -> size_type
+  { return index.nearest(pt, distances, measured); }
+
+  // valid_weights: Whether the options weigh either no point
+  //                or all n of them, each by a positive finite weight
+  [[nodiscard]] //
+  inline auto valid_weights(k_means_options const& options,
+                            size_type n) noexcept -> bool
+  {
+    return options.weights.empty()
+           or (options.weights.size() == n
+               and stdr::all_of(options.weights, [](double w)
+                                { return w > 0.0 and std::isfinite(w); }));
+  }
+
+  // valid_seeding: Whether the options name a seeding engine; given
+  //                centroids only come from the warm start overloads
+  [[nodiscard]] constexpr //
+  auto valid_seeding(k_means_options const& options) noexcept -> bool
+  { return options.seeding.method != seeding_method::given; }
+
+  // A range of centroids indexable by dimension,
+  // e.g. the centroids() of a k_means result
+  template<typename R>
+  concept centroids_range =
+  stdr::sized_range<R> and stdr::sized_range<stdr::range_value_t<R>>
+  and requires(stdr::range_reference_t<R const> centroid) {
+    { centroid[size_type{}] } -> std::convertible_to<double>;
+  };
+
+  template<centroids_range R>
+  using centroid_coord_t = std::remove_cvref_t<
+  decltype(std::declval<stdr::range_reference_t<R const>>()[size_type{}])>;
+
+  // given_dims: Whether every centroid of a range has dims coordinates
+  [[nodiscard]] constexpr //
+  auto given_dims(centroids_range auto const& centroids,
+                  size_type dims) noexcept -> bool
+  {
+    return stdr::all_of(centroids, [dims](auto const& centroid)
+                        { return stdr::size(centroid) == dims; });
+  }
+
+  // options_seeder: Picks the initial centroids as the seeding options say
+  struct options_seeder
+  {
+    template<std::floating_point V>
+    auto seed(auto const& policy, auto const& rows, size_type k,
+              seeding_options const& options,
+              std::span<double const> weights) const
+    -> std::pair<std::vector<V>, seeding_report>
+    { return seed_centroids<V>(policy, rows, k, options, weights); }
+  };
+
+  // given_seeder: Starts from the centroids of a range instead (warm start)
+  template<centroids_range C_R>
+  struct given_seeder
+  {
+    C_R const* centroids;
+
+    template<std::floating_point V>
+    auto seed(auto const& /*policy*/, auto const& rows, size_type k,
+              seeding_options const& /*options*/,
+              std::span<double const> /*weights*/) const
+    -> std::pair<std::vector<V>, seeding_report>
+    {
+      std::vector<V> flat;
+      flat.reserve(k * rows.dims());
+      for(auto const& centroid: *centroids) {
+        for(size_type d{}; d < rows.dims(); ++d) //
+        { flat.push_back(static_cast<V>(centroid[d])); }
+      }
+      return { std::move(flat),
+               seeding_report{ .method = seeding_method::given } };
+    }
+  };
+} // namespace hlpr
+
+// cluster_accumulator: Per-cluster sums and counts
+//                      filled by assign_and_accumulate
+template<typename CENTROID_T>
+struct cluster_accumulator
+{
+  using sum_type = hlpr::sum_t<typename CENTROID_T::value_type>;
+  using sum_row_t =
+  std::array<sum_type, hlpr::data_point_size_v<CENTROID_T>>;
+
+  // Weights of the points, indexed like them; all 1 when empty
+  std::span<double const> weights;
+  // Weighted sums of the points' coordinates, and the sum
+  // of their weights, which the sums' mean divides by
+  std::vector<sum_row_t> sums;
+  std::vector<double> masses;
+  std::vector<size_type> counts;
+  // Sum of squared distances of the points to their assigned centroid,
+  // overall and per cluster
+  double inertia{};
+  std::vector<double> sse;
+  // Each cluster's point farthest from its centroid, the first one on
+  // ties, and its squared distance; 0 while no point is off the centroid
+  std::vector<CENTROID_T> farthest;
+  std::vector<double> farthest_sqr;
+  // Point-to-centroid distances the pass measured
+  size_type distances{};
+
+  explicit cluster_accumulator(size_type k,
+                               std::span<double const> point_weights = {})
+  : weights{ point_weights },
+    sums(k),
+    masses(k),
+    counts(k),
+    sse(k),
+    farthest(k),
+    farthest_sqr(k)
+  { }
+
+  // partial: Empty accumulator for one thread's share of a pass
+  [[nodiscard]] auto partial() const -> cluster_accumulator
+  { return cluster_accumulator(sums.size(), weights); }
+
+  [[nodiscard]] auto weight(size_type i) const noexcept -> double
+  { return weights.empty() ? 1.0 : weights[i]; }
+
+  void reset() noexcept
+  {
+    stdr::fill(sums, sum_row_t{});
+    stdr::fill(masses, 0.0);
+    stdr::fill(counts, size_type{ 0 });
+    inertia = 0.0;
+    stdr::fill(sse, 0.0);
+    stdr::fill(farthest_sqr, 0.0);
+    distances = 0;
+  }
+
+  // add: Accounts for the i-th point, of the given coordinates,
+  //      assigned to cluster c at the given squared distance
+  void add(size_type c, size_type i, auto const& coords,
+           double sqr_dist) noexcept
+  {
+    auto const w = weight(i);
+    auto& sum = sums[c];
+    for(size_type d{}; d < sum.size(); ++d) //
+    {
+      sum[d] +=
+      static_cast<sum_type>(w) * static_cast<sum_type>(coords[d]);
+    }
+    masses[c] += w;
+    ++counts[c];
+    inertia += w * sqr_dist;
+    sse[c] += w * sqr_dist;
+    if(sqr_dist > farthest_sqr[c]) {
+      farthest_sqr[c] = sqr_dist;
+      for(size_type d{}; d < sum.size(); ++d) farthest[c][d] = coords[d];
+    }
+  }
+
+  void merge(cluster_accumulator const& other) noexcept
+  {
+    for(size_type c{}; c < sums.size(); ++c) //
+    {
+      for(size_type d{}; d < sums[c].size(); ++d) //
+      { sums[c][d] += other.sums[c][d]; }
+      masses[c] += other.masses[c];
+      counts[c] += other.counts[c];
+      sse[c] += other.sse[c];
+      if(other.farthest_sqr[c] > farthest_sqr[c]) {
+        farthest_sqr[c] = other.farthest_sqr[c];
+        farthest[c] = other.farthest[c];
+      }
+    }
+    inertia += other.inertia;
+    distances += other.distances;
+  }
+};
 
-    using data_pt_t = DataPoint<pt_value_t, point_size>;
+// assign_and_accumulate: In a single pass over data_points, writes the id
+//                        of each point's nearest centroid to out_indices
+//                        and adds the point to that centroid's sum and count.
+//                        Returns how many points changed cluster.
+//                        The nearest centroid is found with one blocked
+//                        kernel call per point, or per leaf an index
+//                        search visits. first is the index of the first
+//                        point among those acc's weights weigh.
+template<typename CENTROID_T>
+auto assign_and_accumulate(
+auto const& data_points,
+auto&& out_indices,
+hlpr::centroid_finder<typename CENTROID_T::value_type> auto const& centroids,
+cluster_accumulator<CENTROID_T>& acc,
+size_type first = 0) -> size_type
+{
+  using index_t = stdr::range_value_t<decltype(out_indices)>;
+  using coord_t = typename CENTROID_T::value_type;
+
+  acc.reset();
+  size_type reassigned{};
+  auto out_it = stdr::begin(out_indices);
+
+  std::vector<coord_t> distances(centroids.stride());
+  std::array<coord_t, hlpr::data_point_size_v<CENTROID_T>> coords{};
+
+  for(auto i = first; auto const& pt: data_points) //
+  {
+    hlpr::coords_of(pt, coords.data());
+    auto const idx = hlpr::find_nearest(centroids, coords.data(),
+                                        distances.data(), acc.distances);
 
-    auto const to_centroids = rv::transform(
-    [](data_pt_t const& pt) { return centroid_t<PTS_R>(pt); });
+    if(auto const id = static_cast<index_t>(idx + 1); *out_it != id) {
+      *out_it = id;
+      ++reassigned;
+    }
+    ++out_it;
 
-    return to<id_centroids_t>(zip(ids, sample_points | to_centroids));
+    acc.add(idx, i++, coords, static_cast<double>(distances[idx]));
   }
+  return reassigned;
 }
 
-// match_id: Used in update_centroids and in k_means_result
-struct match_id
+// clang-format off
+template<typename CENTROID_T>
+auto assign_and_accumulate(
+sequenced_policy,
+auto const& data_points,
+auto&& out_indices,
+hlpr::centroid_finder<typename CENTROID_T::value_type> auto const& centroids,
+cluster_accumulator<CENTROID_T>& acc) -> size_type
 {
-  size_type cent_id;
-  // clang-format off
-  [[nodiscard]] constexpr
-  auto operator()(auto const& indexed_point) const -> bool
-  { return cent_id == std::get<0>(indexed_point); }
-  
-}; //struct match_id
+  // out_indices is sized, unlike data_points maybe, and of the same size
+  auto const n = static_cast<size_type>(stdr::size(out_indices));
+  auto const reassigned =
+  assign_and_accumulate(data_points, FWD(out_indices), centroids, acc);
+  hlpr::count_pass<typename CENTROID_T::value_type>(
+  n, centroids.size(), hlpr::data_point_size_v<CENTROID_T>, acc.distances);
+  return reassigned;
+}
 
 // clang-format on
-constexpr void update_centroids(auto const& data_points,
-                                auto const& out_indices,
-                                auto&& indexed_centroids)
-{
-  auto constexpr mean_matching_points = [](auto&& points)
-  {
-    using data_point_t = stdr::range_value_t<decltype(points)>;
-    size_type count{};
-    // an elements' count is used instead of size() because
-    // the input range is a filter_view i.e. not a sized_range
-    auto const counted_sum =
-    [&count](data_point_t const& pt1, data_point_t const& pt2)
-    { return (void(++count), pt1 + pt2); };
-    // cast to void protects against "operator," overloads
-
-    // sum must be calculated separately
-    // because count is a side effect of counted_sum
-    using std::reduce, stdr::begin, stdr::end;
-
-    auto const sum = reduce(begin(points), end(points), //
-                            data_point_t(), counted_sum);
-    return sum / count;
-  };
+// assign_and_accumulate: Parallel pass over fixed-size blocks of points.
+//                        Each thread accumulates a block into its own
+//                        per-cluster sums and counts, then merges them
+//                        into acc in block order, which makes the result
+//                        independent of the number of threads.
+template<typename CENTROID_T>
+auto assign_and_accumulate(
+parallel_policy policy,
+auto const& data_points,
+auto&& out_indices,
+hlpr::centroid_finder<typename CENTROID_T::value_type> auto const& centroids,
+cluster_accumulator<CENTROID_T>& acc) -> size_type
+{
+  acc.reset();
+  size_type reassigned{};
 
-  // clang-format off
-  using stdr::transform, rv::keys, rv::values,
-        r::begin, rv::filter, rv::zip;
-  // clang-format on
+  auto const pts_begin = stdr::begin(data_points);
+  auto const out_begin = stdr::begin(out_indices);
 
-  transform(keys(indexed_centroids),
-            begin(values(indexed_centroids)),
-            [&](auto const& cent_id) { //
-              return mean_matching_points(
-              zip(out_indices, data_points)
-              | filter(match_id{ cent_id }) //
-              | values);
-            });
+  hlpr::ordered_block_reduce(
+  policy, static_cast<size_type>(stdr::size(data_points)),
+  [&] { return acc.partial(); },
+  [&](auto& partial, size_type first, size_type last)
+  {
+    auto const f = static_cast<std::ptrdiff_t>(first);
+    auto const l = static_cast<std::ptrdiff_t>(last);
+    return assign_and_accumulate(
+    stdr::subrange(pts_begin + f, pts_begin + l),
+    stdr::subrange(out_begin + f, out_begin + l), centroids, partial, first);
+  },
+  [&](auto const& partial, size_type block_reassigned)
+  {
+    acc.merge(partial);
+    reassigned += block_reassigned;
+  });
+
+  auto const n = static_cast<size_type>(stdr::size(out_indices));
+  hlpr::count_pass<typename CENTROID_T::value_type>(
+  n, centroids.size(), hlpr::data_point_size_v<CENTROID_T>, acc.distances);
+  return reassigned;
 }
 
-constexpr void index_points_by_centroids(auto&& out_indices,
-                                         auto const& data_points,
-                                         auto const& id_centroids)
+// reseed_empty_clusters: Moves the centroids of the emptied clusters,
+//                        those of no mass, to the farthest points of
+//                        other clusters, taken one per cluster from the
+//                        one whose point is the farthest, or whose mass is
+//                        the largest, on; clusters left without such a
+//                        point stay put. centroid(c) and farthest(c) index
+//                        the coordinates of the c-th cluster. Returns the
+//                        largest squared shift.
+constexpr auto reseed_empty_clusters(empty_cluster_strategy strategy,
+                                     std::span<double const> masses,
+                                     std::span<double const> farthest_sqr,
+                                     size_type dims,
+                                     auto&& centroid,
+                                     auto&& farthest) -> double
 {
-  auto constexpr dist_from_centroid = //
-  [](auto const& pt) { return distance_from{ pt }; };
+  if(strategy != empty_cluster_strategy::farthest_point
+     and strategy != empty_cluster_strategy::largest_cluster)
+  { return 0.0; }
+  if(stdr::find(masses, 0.0) == masses.end()) return 0.0;
 
-  auto constexpr proj_centroid = //
-  [](auto const& id_pt) { return id_pt.second; };
+  std::vector<size_type> donors;
+  for(size_type c{}; c < masses.size(); ++c) //
+  {
+    if(masses[c] != 0.0 and farthest_sqr[c] > 0.0) donors.push_back(c);
+  }
+  if(strategy == empty_cluster_strategy::farthest_point) {
+    stdr::stable_sort(donors, [&](size_type a, size_type b)
+                      { return farthest_sqr[a] > farthest_sqr[b]; });
+  } else {
+    stdr::stable_sort(donors, [&](size_type a, size_type b)
+                      { return masses[a] > masses[b]; });
+  }
 
-  // clang-format off
-  auto const find_id_nearest_centroid =
-  [&](auto const& pt)
-  { // stdr::borrowed_iterator has no operator->
-    return (*stdr::min_element(id_centroids,
-                               dist_from_centroid(pt),
-                               proj_centroid)).first;
-  };
-  
-  // Find the ID of the nearest centroid to each data point,
-  // and write it to the output range
-  using stdr::transform, std::begin;
+  double max_sqr_shift{};
+  auto donor = donors.begin();
+  for(size_type c{}; c < masses.size() and donor != donors.end(); ++c) //
+  {
+    if(masses[c] != 0.0) continue;
 
-  transform(data_points,
-            begin(FWD(out_indices)),
-            find_id_nearest_centroid);
+    auto&& to = centroid(c);
+    auto const& from = farthest(*donor++);
+    double sqr_shift{};
+    for(size_type d{}; d < dims; ++d) //
+    {
+      auto const delta = static_cast<double>(from[d] - to[d]);
+      sqr_shift += delta * delta;
+      to[d] = from[d];
+    }
+    max_sqr_shift = std::max(max_sqr_shift, sqr_shift);
+  }
+  return max_sqr_shift;
 }
-// clang-format on
 
-[[nodiscard]] //
-//Note: Maybe constexpr when it's implemented for std::vector
-auto clusters_histogram(auto const& indices,
-                        size_type k)
--> std::vector<size_type>
+// move_centroids: Replaces each centroid with the weighted mean of its
+//                 accumulated points, then handles the emptied clusters as the
+//                 strategy says. Returns the largest squared shift of
+//                 a centroid.
+template<typename CENTROID_T>
+constexpr auto move_centroids(std::vector<CENTROID_T>& centroids,
+                              cluster_accumulator<CENTROID_T> const& acc,
+                              empty_cluster_strategy empty_clusters =
+                              empty_cluster_strategy::keep) -> double
 {
-  std::vector<size_type> cluster_sizes(k);
-  for(auto i: indices) ++cluster_sizes[i - 1];
-  return cluster_sizes;
+  using coord_t = typename CENTROID_T::value_type;
+  using sum_type = hlpr::sum_t<coord_t>;
+
+  double max_sqr_shift{};
+  for(size_type c{}; c < centroids.size(); ++c) //
+  {
+    if(acc.counts[c] == 0) continue;
+
+    auto const mass = static_cast<sum_type>(acc.masses[c]);
+    double sqr_shift{};
+    for(size_type d{}; d < centroids[c].size(); ++d) //
+    {
+      auto const mean = static_cast<coord_t>(acc.sums[c][d] / mass);
+      auto const delta = static_cast<double>(mean - centroids[c][d]);
+      sqr_shift += delta * delta;
+      centroids[c][d] = mean;
+    }
+    max_sqr_shift = std::max(max_sqr_shift, sqr_shift);
+  }
+
+  return std::max(max_sqr_shift,
+                  reseed_empty_clusters(
+                  empty_clusters, acc.masses, acc.farthest_sqr,
+                  hlpr::data_point_size_v<CENTROID_T>,
+                  [&](size_type c) -> auto& { return centroids[c]; },
+                  [&](size_type c) -> auto const& { return acc.farthest[c]; }));
+}
+
+// iterate_until_converged: Alternates pass(), which returns how many points
+//                          changed cluster, and update(), which returns
+//                          the largest squared centroid shift, until one
+//                          of the criteria is met. on_pass(iteration) is
+//                          called between the two, and on_iteration(sample)
+//                          after them with all but the sample's inertia.
+constexpr auto iterate_until_converged(convergence_criteria const& criteria,
+                                       auto&& pass,
+                                       auto&& update,
+                                       auto&& on_pass,
+                                       auto&& on_iteration)
+-> convergence_report
+{
+  using clock = std::chrono::steady_clock;
+  auto const max_iterations =
+  std::max(criteria.max_iterations, size_type{ 1 });
+  auto const sqr_tolerance = criteria.tolerance * criteria.tolerance;
+
+  for(size_type iteration{ 1 };; ++iteration) //
+  {
+    auto const start = clock::now();
+    auto const reassigned = hlpr::in_phase(phase::assignment, pass);
+    on_pass(iteration);
+    auto const sqr_shift = hlpr::in_phase(phase::update, update);
+
+    std::chrono::duration<double> const elapsed = clock::now() - start;
+    on_iteration(iteration_sample{ .iteration = iteration,
+                                   .seconds = elapsed.count(),
+                                   .reassigned = reassigned,
+                                   .max_shift = std::sqrt(sqr_shift) });
+
+    // out_indices holds no prior assignment on the first pass
+    if(iteration > 1 and reassigned == 0)
+    { return { iteration, stop_reason::no_reassignment }; }
+
+    if(sqr_shift <= sqr_tolerance)
+    { return { iteration, stop_reason::tolerance }; }
+
+    if(iteration >= max_iterations)
+    { return { iteration, stop_reason::max_iterations }; }
+  }
+}
+
+constexpr auto iterate_until_converged(convergence_criteria const& criteria,
+                                       auto&& pass,
+                                       auto&& update,
+                                       auto&& on_pass) -> convergence_report
+{
+  return iterate_until_converged(criteria, FWD(pass), FWD(update),
+                                 FWD(on_pass), [](iteration_sample const&) {});
+}
+
+// trace_iterations: on_iteration of iterate_until_converged that
+//                   completes each sample with the inertia of acc's pass,
+//                   appends it to trace and hands it to the options'
+//                   on_iteration
+[[nodiscard]] auto trace_iterations(std::vector<iteration_sample>& trace,
+                                    auto const& acc,
+                                    k_means_options const& options)
+{
+  return [&trace, &acc, &options](iteration_sample sample)
+  {
+    sample.inertia = acc.inertia;
+    trace.push_back(sample);
+    if(options.on_iteration) options.on_iteration(sample);
+  };
+}
+
+// lloyd_iterations: Runs fused assign+accumulate passes, each followed by
+//                   a centroid update, until one of the criteria is met
+template<typename CENTROID_T>
+constexpr auto lloyd_iterations(auto const& policy,
+                                auto const& data_points,
+                                auto&& out_indices,
+                                std::vector<CENTROID_T>& centroids,
+                                cluster_accumulator<CENTROID_T>& acc,
+                                k_means_options const& options,
+                                auto&& on_pass,
+                                auto&& on_iteration)
+-> convergence_report
+{
+  size_type distances{};
+  auto report = hlpr::with_centroid_finder<typename CENTROID_T::value_type>(
+  options.search, centroids.size(), hlpr::data_point_size_v<CENTROID_T>,
+  [&](auto& finder)
+  {
+    return iterate_until_converged(
+    options.convergence,
+    [&]
+    {
+      finder.assign(centroids);
+      auto const reassigned = assign_and_accumulate(
+      policy, data_points, FWD(out_indices), finder, acc);
+      distances += acc.distances;
+      return reassigned;
+    },
+    [&]
+    { return move_centroids(centroids, acc, options.empty_clusters); },
+    FWD(on_pass), FWD(on_iteration));
+  });
+
+  report.distances = distances;
+  return report;
 }
 
 template<typename CENTROIDS_R,
@@ -255,42 +919,57 @@ class k_means_result {
   SIZES_R m_cluster_sizes;
   INPUT_R m_points;
   OUTPUT_R m_out_indices;
+  convergence_report m_convergence;
+  seeding_report m_seeding;
+  mini_batch_report m_mini_batch;
+  // Measured by the last assignment pass
+  std::vector<double> m_cluster_sse;
+  std::vector<iteration_sample> m_trace;
+  // Positions of the points sorted by cluster, those of the i-th cluster
+  // being m_order[m_offsets[i], m_offsets[i + 1]); only built over
+  // random access inputs, other ones are filtered cluster by cluster
+  std::vector<size_type> m_offsets;
+  std::vector<size_type> m_order;
+  run_profile m_profile;
+
+  static constexpr bool indexed = stdr::random_access_range<INPUT_R>;
 
   static constexpr auto filter = rv::filter;
   static constexpr auto values = rv::values;
   static constexpr auto zip = rv::zip;
 
-  using indexed_range = //
-  decltype(zip(FWD(m_out_indices), FWD(m_points)));
-
-  using filtered_indexed_range = //
-  decltype(std::declval<indexed_range>() //
-           | filter(match_id{}));
+  template<typename SATELLITES_R>
+  struct cluster_of
+  {
+    stdr::range_value_t<CENTROIDS_R> const& centroid;
+    SATELLITES_R satellites;
+  };
 
-  using filtered_range = //
-  decltype(std::declval<filtered_indexed_range>() //
-           | values);
+  // index_clusters: Stable counting sort of the points' positions
+  //                 by cluster id, in O(N + k)
+  constexpr void index_clusters()
+  {
+    auto const k = static_cast<size_type>(stdr::size(m_cluster_sizes));
+    // m_offsets[id] is the next free slot of the cluster id - 1, which
+    // leaves it at the start of cluster id once every point is placed
+    m_offsets.assign(k + 1, 0);
+    for(size_type c{ 1 }; c < k; ++c) //
+    { m_offsets[c + 1] = m_offsets[c] + m_cluster_sizes[c - 1]; }
+
+    m_order.resize(static_cast<size_type>(stdr::distance(m_out_indices)));
+    for(size_type i{}; auto const id: m_out_indices) //
+    { m_order[m_offsets[static_cast<size_type>(id)]++] = i++; }
+  }
 
   struct const_iterator
   {
     k_means_result const& parent; // NOLINT
     size_type cluster_idx; // NOLINT
 
-    struct cluster
-    {
-      stdr::range_value_t<CENTROIDS_R> const& centroid;
-      filtered_range satellites;
-    };
-
     // clang-format off
     [[nodiscard]] constexpr
-    auto operator*() const -> cluster
-    {
-      return { parent.m_centroids[cluster_idx],
-               zip(FWD(parent.m_out_indices), FWD(parent.m_points))
-               | filter(match_id{ cluster_idx + 1 })
-               | values };
-    }
+    auto operator*() const
+    { return parent.cluster(cluster_idx); }
 
     constexpr auto operator++() -> const_iterator&
     { return (void(++cluster_idx), *this); }
@@ -315,12 +994,29 @@ public:
   constexpr k_means_result(CENTROIDS_R centroids,
                            SIZES_R cluster_sizes,
                            INPUT_R points,
-                           OUTPUT_R out_indices) noexcept
+                           OUTPUT_R out_indices,
+                           convergence_report convergence = {},
+                           seeding_report seeding = {},
+                           mini_batch_report mini_batch = {},
+                           std::vector<double> cluster_sse = {},
+                           std::vector<iteration_sample> trace = {},
+                           hlpr::profiler* profiler = nullptr) noexcept
   : m_centroids{ std::move(centroids) }, //
     m_cluster_sizes{ std::move(cluster_sizes) }, //
-    m_points{ std::move(points) }, //
-    m_out_indices{ out_indices }
-  { }
+    m_points{ std::forward<INPUT_R>(points) }, //
+    m_out_indices{ out_indices }, //
+    m_convergence{ convergence }, //
+    m_seeding{ seeding }, //
+    m_mini_batch{ std::move(mini_batch) }, //
+    m_cluster_sse{ std::move(cluster_sse) }, //
+    m_trace{ std::move(trace) }
+  {
+    {
+      hlpr::phase_scope const histogram{ phase::histogram };
+      if constexpr(indexed) index_clusters();
+    }
+    if(profiler != nullptr) m_profile = profiler->take();
+  }
 
   // clang-format off
   [[nodiscard]] constexpr
@@ -339,27 +1035,97 @@ public:
   auto out_indices() const noexcept -> OUTPUT_R
   { return m_out_indices; }
 
-  [[nodiscard]]
-  auto begin() const noexcept -> const_iterator
-  { return { *this, size_type{ 0 } }; }
-  
-  [[nodiscard]]
-  auto end() const noexcept -> const_iterator
-  { return { *this, m_cluster_sizes.size() }; }
-  
-}; // class k_means_result
+  [[nodiscard]] constexpr
+  auto convergence() const noexcept -> convergence_report
+  { return m_convergence; }
 
-// clang-format on
-void print_kmn_result(auto&& optional_kmn_result)
-{
-  using fmt::print;
+  [[nodiscard]] constexpr
+  auto seeding() const noexcept -> seeding_report
+  { return m_seeding; }
 
-  auto const decorator_width = 77;
+  [[nodiscard]] constexpr
+  auto mini_batch() const noexcept -> mini_batch_report const&
+  { return m_mini_batch; }
 
-  auto constexpr print_block = //
-  [decorator_width](std::string_view title, //
-                    auto&& printable)
-  {
+  // cluster_sse: Sum of squared distances of each cluster's points to
+  //              the centroid the last pass assigned them to; the update
+  //              that followed can only have lowered it
+  [[nodiscard]] constexpr
+  auto cluster_sse() const noexcept -> std::span<double const>
+  { return m_cluster_sse; }
+
+  // inertia: Sum of the clusters' sse
+  [[nodiscard]] constexpr
+  auto inertia() const noexcept -> double
+  { return std::accumulate(m_cluster_sse.begin(), m_cluster_sse.end(), 0.0); }
+
+  // trace: One sample per Lloyd iteration, none for mini-batch steps
+  [[nodiscard]] constexpr
+  auto trace() const noexcept -> std::span<iteration_sample const>
+  { return m_trace; }
+
+  // profile: Per-phase counters and trace events of the run, empty
+  //          unless kmn was compiled with KMN_INSTRUMENTATION
+  [[nodiscard]] constexpr
+  auto profile() const noexcept -> run_profile const&
+  { return m_profile; }
+
+  // cluster: { centroid, satellites } of the i-th cluster, whose id
+  //          is i + 1. Over random access inputs, satellites reads
+  //          the cluster's points only, in input order.
+  [[nodiscard]] constexpr
+  auto cluster(size_type i) const
+  {
+    if constexpr(indexed) {
+      auto satellites =
+      rv::iota(m_offsets[i], m_offsets[i + 1])
+      | rv::transform(
+        [this](size_type j) -> decltype(auto)
+        {
+          return stdr::begin(m_points)[
+                 static_cast<std::ptrdiff_t>(m_order[j])];
+        });
+      return cluster_of<decltype(satellites)>{ m_centroids[i],
+                                               std::move(satellites) };
+    } else {
+      auto satellites = zip(FWD(m_out_indices), FWD(m_points))
+                        | filter(match_id{ i + 1 })
+                        | values;
+      return cluster_of<decltype(satellites)>{ m_centroids[i],
+                                               std::move(satellites) };
+    }
+  }
+
+  // cluster_positions: Positions in the input of the i-th cluster's points
+  [[nodiscard]] constexpr
+  auto cluster_positions(size_type i) const noexcept
+  -> std::span<size_type const> requires indexed
+  {
+    return { m_order.data() + m_offsets[i],
+             m_offsets[i + 1] - m_offsets[i] };
+  }
+
+  [[nodiscard]]
+  auto begin() const noexcept -> const_iterator
+  { return { *this, size_type{ 0 } }; }
+  
+  [[nodiscard]]
+  auto end() const noexcept -> const_iterator
+  { return { *this, m_cluster_sizes.size() }; }
+  
+}; // class k_means_result
+
+// clang-format on
+void print_kmn_result(auto&& optional_kmn_result)
+{
+  using fmt::print;
+
+  auto const decorator_width = 77;
+
+  auto constexpr print_block = //
+  [decorator_width](std::string_view title, //
+                    auto&& printable)
+  {
     print("{:-^{}}\n", title, decorator_width);
     print("\n{}\n\n", printable);
   };
@@ -375,6 +1141,36 @@ void print_kmn_result(auto&& optional_kmn_result)
   print_block(" Cluster Sizes ", //
               kmn_result.cluster_sizes());
 
+  auto const seeding = kmn_result.seeding();
+  print_block(" Seeding ", //
+              fmt::format("{} with seed {} in {:.3g} s, "
+                          "starting inertia {:.6g}",
+                          to_string(seeding.method), seeding.seed,
+                          seeding.seconds, seeding.inertia));
+
+  auto const convergence = kmn_result.convergence();
+  print_block(" Convergence ", //
+              fmt::format("{} iterations, stopped on {}, "
+                          "{} distances measured, {} skipped, "
+                          "final inertia {:.6g}",
+                          convergence.iterations,
+                          to_string(convergence.reason),
+                          convergence.distances,
+                          convergence.skipped_distances,
+                          kmn_result.inertia()));
+
+  if(auto const& mini_batch = kmn_result.mini_batch(); mini_batch.steps > 0)
+  {
+    print_block(" Mini-batch ", //
+                fmt::format("{} steps with seed {} in {:.3g} s, "
+                            "final inertia {:.6g}",
+                            mini_batch.steps, mini_batch.seed,
+                            mini_batch.seconds, mini_batch.inertia));
+  }
+
+  if(auto const profile = kmn_result.profile().summary(); not profile.empty())
+  { print_block(" Profile ", profile); }
+
   print("{:*^{}}\n\n", " CLUSTERS ", decorator_width);
 
   for(std::size_t i{ 1 }; //
@@ -404,37 +1200,1223 @@ k_means_result<std::vector<centroid_t<PTS_R>>, //
                cluster_sizes_t<IDX_R>, //
                PTS_R, IDX_R>;
 
+/************** Runtime-dimension (matrix) Lloyd iterations **************/
+
+namespace hlpr {
+  // Rows converted at once into a tile by the matrix passes
+  inline constexpr size_type tile_rows = 32;
+  // Dimensions of the centroid block swept per kernel call; a slice
+  // stays in cache while it is measured against a whole tile
+  inline constexpr size_type dims_block = 64;
+
+  // matrix_rows: Row source, as the seeding engines read them,
+  //              over a matrix source
+  template<std::floating_point V, matrix_source M>
+  class matrix_rows
+  {
+    M const* m_points;
+
+  public:
+    explicit matrix_rows(M const& points) noexcept: m_points{ &points } { }
+
+    // clang-format off
+    [[nodiscard]] auto size() const noexcept
+    { return static_cast<size_type>(m_points->rows()); }
+    [[nodiscard]] auto dims() const noexcept
+    { return static_cast<size_type>(m_points->cols()); }
+
+    void load(size_type i, V* coords) const
+    { m_points->load(i, 1, coords); }
+
+    // clang-format on
+    void for_each(size_type first, size_type last, auto&& fn) const
+    {
+      std::vector<V> tile(tile_rows * dims());
+      for(auto row = first; row < last; row += tile_rows) //
+      {
+        auto const count = std::min(tile_rows, last - row);
+        m_points->load(row, count, tile.data());
+        for(size_type r{}; r < count; ++r) //
+        { fn(row + r, tile.data() + r * dims()); }
+      }
+    }
+  };
+
+  // rows_of: Row source of V coordinates over a matrix source
+  //          or a range of DataPoints
+  template<std::floating_point V, matrix_source M>
+  [[nodiscard]] auto rows_of(M const& points) noexcept
+  { return matrix_rows<V, M>(points); }
+
+  template<std::floating_point V, data_points_range R>
+  [[nodiscard]] auto rows_of(R const& points)
+  {
+    return data_point_rows<V, R>(
+    points, static_cast<size_type>(stdr::distance(points)));
+  }
+} // namespace hlpr
+
+// matrix_centroid_value_t: Value type of a matrix source's centroids
+template<typename M>
+using matrix_centroid_value_t = typename hlpr::select_centroid_t<
+typename std::remove_cvref_t<M>::value_type, 1>::value_type;
+
+namespace hlpr {
+  // centroid_value_t: Value type of the centroids of a matrix
+  //                   source or a range of DataPoints
+  template<typename PTS>
+  struct centroid_value
+  { using type = matrix_centroid_value_t<PTS>; };
+
+  template<data_points_range R>
+  struct centroid_value<R>
+  { using type = typename centroid_t<R>::value_type; };
+
+  template<typename PTS>
+  using centroid_value_t = typename centroid_value<PTS>::type;
+} // namespace hlpr
+
+// flat_accumulator: cluster_accumulator over k x dims row-major sums
+template<std::floating_point V>
+struct flat_accumulator
+{
+  size_type dims;
+  std::span<double const> weights;
+  std::vector<hlpr::sum_t<V>> sums;
+  std::vector<double> masses;
+  std::vector<size_type> counts;
+  double inertia{};
+  std::vector<double> sse;
+  std::vector<V> farthest;
+  std::vector<double> farthest_sqr;
+  // Point-to-centroid distances the pass measured
+  size_type distances{};
+
+  flat_accumulator(size_type k, size_type n_dims,
+                   std::span<double const> point_weights = {})
+  : dims{ n_dims },
+    weights{ point_weights },
+    sums(k * n_dims),
+    masses(k),
+    counts(k),
+    sse(k),
+    farthest(k * n_dims),
+    farthest_sqr(k)
+  { }
+
+  // reshape: Resizes the sums and counts for k clusters of n_dims
+  //          coordinates, reusing their storage when it is large enough
+  void reshape(size_type k, size_type n_dims)
+  {
+    dims = n_dims;
+    sums.resize(k * n_dims);
+    masses.resize(k);
+    counts.resize(k);
+    sse.resize(k);
+    farthest.resize(k * n_dims);
+    farthest_sqr.resize(k);
+  }
+
+  [[nodiscard]] auto partial() const -> flat_accumulator
+  { return flat_accumulator(counts.size(), dims, weights); }
+
+  [[nodiscard]] auto weight(size_type i) const noexcept -> double
+  { return weights.empty() ? 1.0 : weights[i]; }
+
+  void reset() noexcept
+  {
+    stdr::fill(sums, hlpr::sum_t<V>{});
+    stdr::fill(masses, 0.0);
+    stdr::fill(counts, size_type{ 0 });
+    inertia = 0.0;
+    stdr::fill(sse, 0.0);
+    stdr::fill(farthest_sqr, 0.0);
+    distances = 0;
+  }
+
+  void add(size_type c, size_type i, V const* coords,
+           double sqr_dist) noexcept
+  {
+    auto const w = weight(i);
+    auto* sum = sums.data() + c * dims;
+    for(size_type d{}; d < dims; ++d) //
+    {
+      sum[d] += static_cast<hlpr::sum_t<V>>(w)
+                * static_cast<hlpr::sum_t<V>>(coords[d]);
+    }
+    masses[c] += w;
+    ++counts[c];
+    inertia += w * sqr_dist;
+    sse[c] += w * sqr_dist;
+    if(sqr_dist > farthest_sqr[c]) {
+      farthest_sqr[c] = sqr_dist;
+      std::copy(coords, coords + dims, farthest.data() + c * dims);
+    }
+  }
+
+  void merge(flat_accumulator const& other) noexcept
+  {
+    for(size_type i{}; i < sums.size(); ++i) sums[i] += other.sums[i];
+    for(size_type c{}; c < counts.size(); ++c) //
+    {
+      masses[c] += other.masses[c];
+      counts[c] += other.counts[c];
+      sse[c] += other.sse[c];
+      if(other.farthest_sqr[c] > farthest_sqr[c]) {
+        farthest_sqr[c] = other.farthest_sqr[c];
+        std::copy_n(other.farthest.data() + c * dims, dims,
+                    farthest.data() + c * dims);
+      }
+    }
+    inertia += other.inertia;
+    distances += other.distances;
+  }
+};
+
+// assign_and_accumulate_rows: Fused pass over the rows [first, last)
+//                             of a matrix source, converted a tile at a
+//                             time; out is the output iterator of first.
+//                             tile holds tile_rows rows of points,
+//                             distances tile_rows rows of the block's
+//                             stride and partial one.
+template<std::floating_point V>
+auto assign_and_accumulate_rows(hlpr::matrix_source auto const& points,
+                                size_type first, size_type last,
+                                auto out,
+                                simd::centroid_block<V> const& centroids,
+                                flat_accumulator<V>& acc,
+                                V* tile, V* distances, V* partial)
+-> size_type
+{
+  using index_t = std::iter_value_t<decltype(out)>;
+  using hlpr::tile_rows, hlpr::dims_block;
+
+  auto const dims = static_cast<size_type>(points.cols());
+  auto const ld = centroids.stride();
+
+  acc.reset();
+  size_type reassigned{};
+
+  for(auto row = first; row < last; row += tile_rows) //
+  {
+    auto const count = std::min(tile_rows, last - row);
+    points.load(row, count, tile);
+
+    // Sweep the centroids one slice of dimensions at a time
+    for(size_type d0{}; d0 < dims; d0 += dims_block) //
+    {
+      auto const n_dims = std::min(dims_block, dims - d0);
+      for(size_type r{}; r < count; ++r) //
+      {
+        auto const* pt = tile + r * dims + d0;
+        auto* dist = distances + r * ld;
+        if(d0 == 0) {
+          centroids.sqr_distances(pt, d0, n_dims, dist);
+        } else {
+          centroids.sqr_distances(pt, d0, n_dims, partial);
+          for(size_type j{}; j < ld; ++j) dist[j] += partial[j];
+        }
+      }
+    }
+    acc.distances += count * centroids.size();
+
+    for(size_type r{}; r < count; ++r) //
+    {
+      auto const* dist = distances + r * ld;
+      auto const idx = static_cast<size_type>(
+      std::min_element(dist, dist + centroids.size()) - dist);
+
+      if(auto const id = static_cast<index_t>(idx + 1); *out != id) {
+        *out = id;
+        ++reassigned;
+      }
+      ++out;
+
+      acc.add(idx, row + r, tile + r * dims,
+              static_cast<double>(dist[idx]));
+    }
+  }
+  return reassigned;
+}
+
+template<std::floating_point V>
+auto assign_and_accumulate_rows(hlpr::matrix_source auto const& points,
+                                size_type first, size_type last,
+                                auto out,
+                                simd::centroid_block<V> const& centroids,
+                                flat_accumulator<V>& acc) -> size_type
+{
+  auto const dims = static_cast<size_type>(points.cols());
+  std::vector<V> tile(hlpr::tile_rows * dims);
+  std::vector<V> distances(hlpr::tile_rows * centroids.stride());
+  std::vector<V> partial(centroids.stride());
+  return assign_and_accumulate_rows(points, first, last, out, centroids,
+                                    acc, tile.data(), distances.data(),
+                                    partial.data());
+}
+
+// assign_and_accumulate_rows: Same, searching an index row by row for
+//                             the distances the block's slices would sum
+template<std::floating_point V>
+auto assign_and_accumulate_rows(hlpr::matrix_source auto const& points,
+                                size_type first, size_type last,
+                                auto out,
+                                centroid_index<V> const& centroids,
+                                flat_accumulator<V>& acc) -> size_type
+{
+  using index_t = std::iter_value_t<decltype(out)>;
+  using hlpr::tile_rows, hlpr::dims_block;
+
+  auto const dims = static_cast<size_type>(points.cols());
+
+  acc.reset();
+  size_type reassigned{};
+
+  std::vector<V> tile(tile_rows * dims);
+  std::vector<V> distances(centroids.stride());
+  std::vector<V> partial(centroid_index<V>::leaf_size);
+
+  for(auto row = first; row < last; row += tile_rows) //
+  {
+    auto const count = std::min(tile_rows, last - row);
+    points.load(row, count, tile.data());
+
+    for(size_type r{}; r < count; ++r) //
+    {
+      auto const* pt = tile.data() + r * dims;
+      auto const idx =
+      centroids.nearest(pt, dims_block, distances.data(), partial.data(),
+                        acc.distances);
+
+      if(auto const id = static_cast<index_t>(idx + 1); *out != id) {
+        *out = id;
+        ++reassigned;
+      }
+      ++out;
+
+      acc.add(idx, row + r, pt, static_cast<double>(distances[idx]));
+    }
+  }
+  return reassigned;
+}
+
+template<std::floating_point V>
+auto assign_and_accumulate_rows(sequenced_policy,
+                                hlpr::matrix_source auto const& points,
+                                auto&& out_indices,
+                                hlpr::centroid_finder<V> auto const& centroids,
+                                flat_accumulator<V>& acc) -> size_type
+{
+  auto const reassigned =
+  assign_and_accumulate_rows(points, 0, points.rows(),
+                             stdr::begin(out_indices), centroids, acc);
+  hlpr::count_pass<V>(points.rows(), centroids.size(), acc.dims,
+                      acc.distances);
+  return reassigned;
+}
+
+template<std::floating_point V>
+auto assign_and_accumulate_rows(parallel_policy policy,
+                                hlpr::matrix_source auto const& points,
+                                auto&& out_indices,
+                                hlpr::centroid_finder<V> auto const& centroids,
+                                flat_accumulator<V>& acc) -> size_type
+{
+  acc.reset();
+  size_type reassigned{};
+  auto const out_begin = stdr::begin(out_indices);
+
+  hlpr::ordered_block_reduce(
+  policy, points.rows(),
+  [&] { return acc.partial(); },
+  [&](auto& partial, size_type first, size_type last)
+  {
+    return assign_and_accumulate_rows(
+    points, first, last, out_begin + static_cast<std::ptrdiff_t>(first),
+    centroids, partial);
+  },
+  [&](auto const& partial, size_type block_reassigned)
+  {
+    acc.merge(partial);
+    reassigned += block_reassigned;
+  });
+
+  hlpr::count_pass<V>(points.rows(), centroids.size(), acc.dims,
+                      acc.distances);
+  return reassigned;
+}
+
+// move_flat_centroids: move_centroids over k x dims row-major centroids
+template<std::floating_point V>
+auto move_flat_centroids(std::vector<V>& centroids,
+                         flat_accumulator<V> const& acc,
+                         empty_cluster_strategy empty_clusters =
+                         empty_cluster_strategy::keep) -> double
+{
+  double max_sqr_shift{};
+  for(size_type c{}; c < acc.counts.size(); ++c) //
+  {
+    if(acc.counts[c] == 0) continue;
+
+    auto const mass = static_cast<hlpr::sum_t<V>>(acc.masses[c]);
+    double sqr_shift{};
+    for(size_type d{}; d < acc.dims; ++d) //
+    {
+      auto& coord = centroids[c * acc.dims + d];
+      auto const mean = static_cast<V>(acc.sums[c * acc.dims + d] / mass);
+      auto const delta = static_cast<double>(mean - coord);
+      sqr_shift += delta * delta;
+      coord = mean;
+    }
+    max_sqr_shift = std::max(max_sqr_shift, sqr_shift);
+  }
+
+  return std::max(max_sqr_shift,
+                  reseed_empty_clusters(
+                  empty_clusters, acc.masses, acc.farthest_sqr, acc.dims,
+                  [&](size_type c) { return centroids.data() + c * acc.dims; },
+                  [&](size_type c)
+                  { return acc.farthest.data() + c * acc.dims; }));
+}
+
+// drop_empty_clusters: Removes the clusters without points from the
+//                      centroids, of per values each, and the per-cluster
+//                      sse and counts, and renumbers the ids to match
+template<typename C>
+void drop_empty_clusters(auto&& out_indices,
+                         std::vector<C>& centroids,
+                         size_type per,
+                         std::vector<double>& sse,
+                         std::vector<size_type>& counts)
+{
+  using index_t = stdr::range_value_t<decltype(out_indices)>;
+
+  std::vector<index_t> new_ids(counts.size());
+  size_type kept{};
+  for(size_type c{}; c < counts.size(); ++c) //
+  {
+    if(counts[c] == 0) continue;
+
+    std::move(centroids.begin() + static_cast<std::ptrdiff_t>(c * per),
+              centroids.begin() + static_cast<std::ptrdiff_t>((c + 1) * per),
+              centroids.begin() + static_cast<std::ptrdiff_t>(kept * per));
+    sse[kept] = sse[c];
+    counts[kept] = counts[c];
+    new_ids[c] = static_cast<index_t>(++kept);
+  }
+  if(kept == counts.size()) return;
+
+  centroids.resize(kept * per);
+  sse.resize(kept);
+  counts.resize(kept);
+  for(auto& id: out_indices) id = new_ids[static_cast<size_type>(id) - 1];
+}
+
+/********* Bound-accelerated (hamerly and elkan) iterations **********/
+
+// distance_bounds: Lower bounds on the distances from each point to the
+//                  centroids, kept valid across passes by subtracting how
+//                  far the centroids moved: one per point for hamerly,
+//                  on the distance to its second nearest centroid, and k
+//                  per point for elkan. The upper bound, the distance to
+//                  the assigned centroid, is measured afresh on every pass
+//                  since the inertia needs it anyway. Bounds are padded by
+//                  twice the rounding error of a distance so that a test
+//                  passing in floating point also holds in exact arithmetic.
+template<std::floating_point V>
+struct distance_bounds
+{
+  assignment_algorithm algorithm;
+  size_type k;
+  size_type dims;
+  // Dimensions per kernel call in the Lloyd pass over the same input
+  size_type slice;
+  V margin;
+  std::vector<V> lower;
+  // Half distances between centroids, k x k, and to the nearest other one
+  std::vector<V> half_gaps;
+  std::vector<V> nearest_gap;
+  // Distance each centroid moved on the last update, and the two largest
+  std::vector<V> shifts;
+  V max_shift{};
+  V second_shift{};
+  size_type max_shift_idx{};
+  // Whether a first pass has measured every distance
+  bool measured{};
+  std::vector<V> scratch;
+
+  distance_bounds(assignment_algorithm algo, size_type n, size_type n_centroids,
+                  size_type n_dims, size_type dims_slice, size_type stride)
+  : algorithm{ algo },
+    k{ n_centroids },
+    dims{ n_dims },
+    slice{ dims_slice },
+    margin{ V{ 2 } * static_cast<V>(n_dims + 4)
+            * std::numeric_limits<V>::epsilon() },
+    lower(n * per_point()),
+    half_gaps(n_centroids * n_centroids),
+    nearest_gap(n_centroids),
+    shifts(n_centroids),
+    scratch(stride)
+  { }
+
+  // clang-format off
+  [[nodiscard]] auto per_point() const noexcept -> size_type
+  { return algorithm == assignment_algorithm::elkan ? k : 1; }
+
+  // above, below: Bounds on a distance from its computed square
+  [[nodiscard]] auto above(V sqr_dist) const noexcept -> V
+  { return std::sqrt(sqr_dist) * (V{ 1 } + margin); }
+  [[nodiscard]] auto below(V sqr_dist) const noexcept -> V
+  { return std::sqrt(sqr_dist) * (V{ 1 } - margin); }
+
+  // too_close: Whether two computed squared distances may compare
+  //            differently once computed by the Lloyd pass' kernel
+  [[nodiscard]] auto too_close(V lhs, V rhs) const noexcept -> bool
+  { return std::abs(lhs - rhs) <= V{ 2 } * margin * std::max(lhs, rhs); }
+
+  // shrink: A lower bound once its centroid moved by shift,
+  //         rounded down
+  [[nodiscard]] static auto shrink(V bound, V shift) noexcept -> V
+  { return (bound - shift) * (V{ 1 } - V{ 4 } * std::numeric_limits<V>::epsilon()); }
+
+  // clang-format on
+  // measure_centroids: Half distances between the centroids of a pass
+  void measure_centroids(V const* centroids,
+                         simd::centroid_block<V> const& block) noexcept
+  {
+    for(size_type a{}; a < k; ++a) //
+    {
+      block.sqr_distances(centroids + a * dims, scratch.data());
+      auto nearest = std::numeric_limits<V>::max();
+      for(size_type j{}; j < k; ++j) //
+      {
+        if(j == a) continue;
+        auto const gap = below(scratch[j]) / V{ 2 };
+        half_gaps[a * k + j] = gap;
+        nearest = std::min(nearest, gap);
+      }
+      nearest_gap[a] = nearest;
+    }
+  }
+
+  // record_shifts: How far each centroid moved on an update
+  void record_shifts(V const* previous, V const* current) noexcept
+  {
+    max_shift = second_shift = V{};
+    max_shift_idx = 0;
+    for(size_type c{}; c < k; ++c) //
+    {
+      auto const shift =
+      above(hlpr::sqr_distance(previous + c * dims, current + c * dims, dims));
+      shifts[c] = shift;
+      if(shift > max_shift) {
+        second_shift = max_shift;
+        max_shift = shift;
+        max_shift_idx = c;
+      } else {
+        second_shift = std::max(second_shift, shift);
+      }
+    }
+  }
+
+  // move_lower: Brings a point's lower bounds up to date with the shifts
+  void move_lower(V* point_lower, size_type assigned) const noexcept
+  {
+    if(algorithm == assignment_algorithm::elkan) {
+      for(size_type j{}; j < k; ++j) //
+      { point_lower[j] = shrink(point_lower[j], shifts[j]); }
+    } else {
+      auto const shift =
+      assigned == max_shift_idx ? second_shift : max_shift;
+      point_lower[0] = shrink(point_lower[0], shift);
+    }
+  }
+};
+
+// pass_counts: What a bound-accelerated pass did
+struct pass_counts
+{
+  size_type reassigned{};
+  size_type distances{};
+  size_type skipped{};
+};
+
+// sweep_distances: Squared distances from pt to all centroids, measured
+//                  slice dimensions at a time like the Lloyd pass over the
+//                  same input so that both agree to the last bit
+template<std::floating_point V>
+void sweep_distances(simd::centroid_block<V> const& centroids,
+                     V const* pt,
+                     size_type slice,
+                     V* distances,
+                     V* partial) noexcept
+{
+  auto const dims = centroids.dims();
+  centroids.sqr_distances(pt, 0, std::min(slice, dims), distances);
+  for(auto d0 = slice; d0 < dims; d0 += slice) //
+  {
+    centroids.sqr_distances(pt + d0, d0, std::min(slice, dims - d0), partial);
+    for(size_type j{}; j < centroids.stride(); ++j) distances[j] += partial[j];
+  }
+}
+
+// assign_and_accumulate_bounded: Fused pass over the rows [first, last)
+//                                of a row source, measuring only the
+//                                distances the bounds can't rule out.
+//                                A point is swept against all centroids,
+//                                as by the Lloyd pass, on the first pass
+//                                and whenever two of its candidates are
+//                                too close to call, so assignments are
+//                                the same as Lloyd's.
+template<std::floating_point V>
+auto assign_and_accumulate_bounded(auto const& rows,
+                                   size_type first, size_type last,
+                                   auto out,
+                                   simd::centroid_block<V> const& block,
+                                   V const* centroids,
+                                   distance_bounds<V>& bounds,
+                                   flat_accumulator<V>& acc) -> pass_counts
+{
+  using index_t = std::iter_value_t<decltype(out)>;
+  auto const k = block.size();
+  auto const dims = block.dims();
+  auto const elkan = bounds.algorithm == assignment_algorithm::elkan;
+
+  acc.reset();
+  pass_counts counts;
+
+  std::vector<V> distances(block.stride());
+  std::vector<V> partial(block.stride());
+
+  rows.for_each(
+  first, last,
+  [&](size_type i, V const* pt)
+  {
+    auto* lower = bounds.lower.data() + i * bounds.per_point();
+    size_type idx{};
+    size_type measured{};
+    V sqr_dist{};
+
+    auto const sweep = [&]
+    {
+      sweep_distances(block, pt, bounds.slice, distances.data(),
+                      partial.data());
+      measured += k;
+      idx = static_cast<size_type>(
+      std::min_element(distances.data(), distances.data() + k)
+      - distances.data());
+      sqr_dist = distances[idx];
+
+      if(elkan) {
+        for(size_type j{}; j < k; ++j) lower[j] = bounds.below(distances[j]);
+      } else {
+        auto second = std::numeric_limits<V>::max();
+        for(size_type j{}; j < k; ++j) //
+        { if(j != idx) second = std::min(second, distances[j]); }
+        lower[0] = bounds.below(second);
+      }
+    };
+
+    if(not bounds.measured) {
+      sweep();
+    } else {
+      idx = static_cast<size_type>(*out) - 1;
+      bounds.move_lower(lower, idx);
+
+      sqr_dist = hlpr::sqr_distance(pt, centroids + idx * dims, dims);
+      ++measured;
+      auto upper = bounds.above(sqr_dist);
+
+      if(not elkan) {
+        if(not(upper < std::max(lower[0], bounds.nearest_gap[idx]))) sweep();
+      } else if(not(upper < bounds.nearest_gap[idx])) {
+        bool tied{};
+        for(size_type j{}; j < k; ++j) //
+        {
+          if(j == idx or upper < lower[j]
+             or upper < bounds.half_gaps[idx * k + j])
+          { continue; }
+
+          auto const dist_j =
+          hlpr::sqr_distance(pt, centroids + j * dims, dims);
+          ++measured;
+          lower[j] = bounds.below(dist_j);
+          tied = tied or bounds.too_close(dist_j, sqr_dist);
+
+          if(dist_j < sqr_dist) {
+            lower[idx] = bounds.below(sqr_dist);
+            idx = j;
+            sqr_dist = dist_j;
+            upper = bounds.above(dist_j);
+          }
+        }
+        if(tied) sweep();
+      }
+    }
+
+    counts.distances += measured;
+    counts.skipped += measured < k ? k - measured : 0;
+
+    if(auto const id = static_cast<index_t>(idx + 1); *out != id) {
+      *out = id;
+      ++counts.reassigned;
+    }
+    ++out;
+
+    acc.add(idx, i, pt, static_cast<double>(sqr_dist));
+  });
+
+  return counts;
+}
+
+template<std::floating_point V>
+auto assign_and_accumulate_bounded(sequenced_policy,
+                                   auto const& rows,
+                                   auto&& out_indices,
+                                   simd::centroid_block<V> const& block,
+                                   V const* centroids,
+                                   distance_bounds<V>& bounds,
+                                   flat_accumulator<V>& acc) -> pass_counts
+{
+  return assign_and_accumulate_bounded(rows, 0, rows.size(),
+                                       stdr::begin(out_indices), block,
+                                       centroids, bounds, acc);
+}
+
+template<std::floating_point V>
+auto assign_and_accumulate_bounded(parallel_policy policy,
+                                   auto const& rows,
+                                   auto&& out_indices,
+                                   simd::centroid_block<V> const& block,
+                                   V const* centroids,
+                                   distance_bounds<V>& bounds,
+                                   flat_accumulator<V>& acc) -> pass_counts
+{
+  acc.reset();
+  pass_counts counts;
+  auto const out_begin = stdr::begin(out_indices);
+
+  hlpr::ordered_block_reduce(
+  policy, rows.size(),
+  [&] { return acc.partial(); },
+  [&](auto& partial, size_type first, size_type last)
+  {
+    return assign_and_accumulate_bounded(
+    rows, first, last, out_begin + static_cast<std::ptrdiff_t>(first),
+    block, centroids, bounds, partial);
+  },
+  [&](auto const& partial, pass_counts const& block_counts)
+  {
+    acc.merge(partial);
+    counts.reassigned += block_counts.reassigned;
+    counts.distances += block_counts.distances;
+    counts.skipped += block_counts.skipped;
+  });
+
+  return counts;
+}
+
+// bounded_iterations: Lloyd iterations over k x dims row-major centroids
+//                     with the hamerly or elkan passes; slice is how many
+//                     dimensions the Lloyd pass over the same input
+//                     measures per kernel call
+template<std::floating_point V>
+auto bounded_iterations(auto const& policy,
+                        auto const& rows,
+                        auto&& out_indices,
+                        std::vector<V>& centroids,
+                        flat_accumulator<V>& acc,
+                        k_means_options const& options,
+                        size_type slice,
+                        auto&& on_pass,
+                        auto&& on_iteration) -> convergence_report
+{
+  auto const k = acc.counts.size();
+  simd::centroid_block<V> block(k, acc.dims);
+  distance_bounds<V> bounds(options.algorithm, rows.size(), k, acc.dims,
+                            slice, block.stride());
+  std::vector<V> previous(centroids.size());
+  pass_counts total;
+
+  auto report = iterate_until_converged(
+  options.convergence,
+  [&]
+  {
+    block.assign_rows(centroids.data());
+    if(bounds.measured) bounds.measure_centroids(centroids.data(), block);
+
+    auto const counts = assign_and_accumulate_bounded(
+    policy, rows, out_indices, block, centroids.data(), bounds, acc);
+    bounds.measured = true;
+
+    hlpr::count_pass<V>(rows.size(), k, acc.dims, counts.distances);
+    total.distances += counts.distances;
+    total.skipped += counts.skipped;
+    return counts.reassigned;
+  },
+  [&]
+  {
+    stdr::copy(centroids, previous.begin());
+    auto const sqr_shift =
+    move_flat_centroids(centroids, acc, options.empty_clusters);
+    bounds.record_shifts(previous.data(), centroids.data());
+    return sqr_shift;
+  },
+  FWD(on_pass), FWD(on_iteration));
+
+  report.distances = total.distances;
+  report.skipped_distances = total.skipped;
+  return report;
+}
+
+/*********************** Mini-batch iterations ***********************/
+
+// run_mini_batch: Runs the mini-batch steps of options over a row source,
+//                 then final_pass(), which assigns every point to the
+//                 moved centroids and returns the pass' inertia and the
+//                 distances it measured
+template<std::floating_point V>
+auto run_mini_batch(auto const& policy,
+                    auto const& rows,
+                    std::vector<V>& centroids,
+                    size_type k,
+                    k_means_options const& options,
+                    std::uint64_t seeding_seed,
+                    auto&& final_pass)
+-> std::pair<convergence_report, mini_batch_report>
+{
+  auto const& mini_batch = *options.mini_batch;
+  auto const batch_size = std::max(mini_batch.batch_size, size_type{ 1 });
+  auto report = hlpr::in_phase(
+  phase::mini_batch,
+  [&]
+  {
+    auto steps = mini_batch_steps<V>(
+    policy, rows, centroids, k, mini_batch,
+    mini_batch.seed.value_or(seeding_seed), options.convergence.tolerance,
+    options.weights);
+    hlpr::count_pass<V>(steps.steps * batch_size, k, rows.dims(),
+                        steps.steps * batch_size * k);
+    return steps;
+  });
+  auto const [inertia, final_distances] =
+  hlpr::in_phase(phase::assignment, final_pass);
+  report.inertia = inertia;
+
+  convergence_report convergence{
+    .iterations = report.steps,
+    .reason = report.steps < mini_batch.steps ? stop_reason::tolerance
+                                              : stop_reason::max_iterations,
+    .distances = report.steps * batch_size * k + final_distances
+  };
+  return { convergence, std::move(report) };
+}
+
+/************************* Restarts *************************/
+
+// best_restart: The run of least inertia among restarts,
+//               its centroids k x dims row-major
+template<std::floating_point V>
+struct best_restart
+{
+  double inertia{ std::numeric_limits<double>::infinity() };
+  size_type restart{};
+  std::vector<V> centroids;
+  std::vector<size_type> cluster_sizes;
+  std::vector<double> cluster_sse;
+  std::vector<iteration_sample> trace;
+  convergence_report convergence;
+  seeding_report seeding;
+  mini_batch_report mini_batch;
+};
+
+// labelled_inertia: Sum of squared distances from the rows to their
+//                   ids' centroid, times the rows' weights if any
+template<std::floating_point V>
+[[nodiscard]] auto labelled_inertia(auto const& rows,
+                                    auto const& ids,
+                                    std::span<V const> centroids,
+                                    std::span<double const> weights) -> double
+{
+  auto const dims = rows.dims();
+  double inertia{};
+  rows.for_each(0, rows.size(),
+                [&](size_type i, V const* coords)
+                {
+                  auto const c = static_cast<size_type>(ids[i]) - 1;
+                  inertia += (weights.empty() ? 1.0 : weights[i])
+                             * static_cast<double>(hlpr::sqr_distance(
+                             coords, centroids.data() + c * dims, dims));
+                });
+  return inertia;
+}
+
+// run_restarts: Runs options.n_init clusterings of the points, restart r
+//               seeded with the seed of options + r, and writes the ids
+//               of the one of least inertia to out_indices. Restarts are
+//               handed out to the policy's threads, each running them
+//               sequentially in its own workspace over the shared points.
+//               Ties go to the first restart, so the pick doesn't depend
+//               on the thread count.
+template<std::floating_point V>
+auto run_restarts(auto const& policy,
+                  auto const& points,
+                  auto&& out_indices,
+                  size_type k,
+                  k_means_options const& options) -> best_restart<V>
+{
+  using index_t = stdr::range_value_t<decltype(out_indices)>;
+
+  auto const n = static_cast<size_type>(stdr::size(out_indices));
+  auto const n_init = options.n_init;
+  auto const base_seed = options.seeding.seed.value_or(
+  (std::uint64_t{ std::random_device{}() } << 32U) | std::random_device{}());
+
+  size_type n_threads{ 1 };
+  if constexpr(std::same_as<std::remove_cvref_t<decltype(policy)>,
+                            parallel_policy>)
+  { n_threads = std::min(policy.threads(), n_init); }
+
+  // Each thread's best run and its ids
+  std::vector<best_restart<V>> bests(n_threads);
+  std::vector<std::vector<index_t>> best_ids(n_threads);
+  std::atomic<size_type> next_restart{ 0 };
+
+  hlpr::run_on_threads(
+  n_threads,
+  [&](size_type thread_idx)
+  {
+    auto const rows = hlpr::rows_of<V>(points);
+    workspace<V> ws;
+    std::vector<index_t> ids(n);
+    auto& best = bests[thread_idx];
+    auto& kept_ids = best_ids[thread_idx];
+
+    for(auto r = next_restart++; r < n_init; r = next_restart++) //
+    {
+      auto run_options = options;
+      run_options.n_init = 1;
+      run_options.seeding.seed = base_seed + r;
+      // The winner's clusters are dropped once it is picked
+      if(options.empty_clusters == empty_cluster_strategy::drop)
+      { run_options.empty_clusters = empty_cluster_strategy::keep; }
+      if(options.on_iteration) {
+        run_options.on_iteration = [&options, r](iteration_sample sample)
+        {
+          sample.restart = r;
+          options.on_iteration(sample);
+        };
+      }
+
+      // The arguments were checked by k_means
+      auto const result = *ws.run(points, ids, k, run_options);
+      auto const inertia =
+      labelled_inertia(rows, ids, result.centroids, options.weights);
+      // A thread's restarts come in increasing order
+      if(not best.centroids.empty() and not(inertia < best.inertia))
+      { continue; }
+
+      best.inertia = inertia;
+      best.restart = r;
+      best.centroids.assign(result.centroids.begin(),
+                            result.centroids.end());
+      best.cluster_sizes.assign(result.cluster_sizes.begin(),
+                                result.cluster_sizes.end());
+      best.cluster_sse.assign(result.cluster_sse.begin(),
+                              result.cluster_sse.end());
+      best.trace.assign(result.trace.begin(), result.trace.end());
+      for(auto& sample: best.trace) sample.restart = r;
+      best.convergence = result.convergence;
+      best.seeding = result.seeding;
+      if(result.mini_batch) best.mini_batch = *result.mini_batch;
+      std::swap(ids, kept_ids);
+      ids.resize(n);
+    }
+  });
+
+  size_type winner{};
+  for(size_type t{ 1 }; t < n_threads; ++t) //
+  {
+    auto const& best = bests[t];
+    if(best.inertia < bests[winner].inertia
+       or (best.inertia == bests[winner].inertia
+           and best.restart < bests[winner].restart))
+    { winner = t; }
+  }
+
+  stdr::copy(best_ids[winner], stdr::begin(out_indices));
+  return std::move(bests[winner]);
+}
+
 template<typename PTS_R, typename IDX_R>
 [[nodiscard]] constexpr //
-auto k_means_impl(PTS_R&& data_points, //
+auto k_means_impl(auto const& policy,
+                  PTS_R&& data_points, //
                   IDX_R&& out_indices, //
-                  size_type k, size_type n)
+                  size_type k,
+                  k_means_options const& options,
+                  auto const& seeder)
 -> k_means_impl_t<PTS_R, IDX_R>
-{ // Initialize centroids and their ids
-  auto&& indexed_centroids = init_centroids(FWD(data_points), k);
+{
+  using centroid_type = centroid_t<PTS_R>;
+  using coord_t = typename centroid_type::value_type;
+  auto constexpr dims = hlpr::data_point_size_v<centroid_type>;
+
+  // Outlives the result, which takes the profile once built
+  hlpr::profiler prof;
+  hlpr::profile_scope const profiling{ &prof };
+
+  std::vector<centroid_type> centroids(k);
+  auto const copy_centroids = [&](std::vector<coord_t> const& flat)
+  {
+    centroids.resize(flat.size() / dims);
+    for(size_type c{}; c < centroids.size(); ++c) //
+    {
+      for(size_type d{}; d < dims; ++d) //
+      { centroids[c][d] = flat[c * dims + d]; }
+    }
+  };
+
+  if constexpr(std::same_as<std::remove_cvref_t<decltype(seeder)>,
+                            hlpr::options_seeder>)
+  {
+    if(options.n_init > 1) {
+      auto best =
+      run_restarts<coord_t>(policy, data_points, out_indices, k, options);
+      if(options.empty_clusters == empty_cluster_strategy::drop) {
+        drop_empty_clusters(out_indices, best.centroids, dims,
+                            best.cluster_sse, best.cluster_sizes);
+      }
+      copy_centroids(best.centroids);
+      return { std::move(centroids), //
+               std::move(best.cluster_sizes), //
+               FWD(data_points), //
+               FWD(out_indices), //
+               best.convergence, //
+               best.seeding, //
+               std::move(best.mini_batch), //
+               std::move(best.cluster_sse), //
+               std::move(best.trace), //
+               &prof };
+    }
+  }
 
-  index_points_by_centroids(FWD(out_indices), FWD(data_points),
-                            FWD(indexed_centroids));
+  // Seed the centroids, their ids are their positions + 1
+  auto const n_points = static_cast<size_type>(stdr::distance(data_points));
+  auto const rows =
+  hlpr::data_point_rows<coord_t, std::remove_cvref_t<PTS_R>>(data_points,
+                                                             n_points);
+  auto [seeds, seeding] = seeder.template seed<coord_t>(
+  policy, rows, k, options.seeding, options.weights);
 
-  // Update the centroids with means, repeat n times
-  while(n--) //
+  // The first pass measures the seeds
+  auto const measure_seeds = [&](auto const& acc)
   {
-    update_centroids(data_points, out_indices, //
-                     FWD(indexed_centroids));
+    return [&](size_type iteration)
+    { if(iteration == 1) seeding.inertia = acc.inertia; };
+  };
+
+  convergence_report convergence;
+  std::vector<size_type> cluster_sizes;
+  std::vector<double> cluster_sse;
+  std::vector<iteration_sample> trace;
+  mini_batch_report mini_batch;
+
+  if(options.mini_batch) {
+    cluster_accumulator<centroid_type> acc(k, options.weights);
+    std::tie(convergence, mini_batch) = run_mini_batch(
+    policy, rows, seeds, k, options, seeding.seed,
+    [&]
+    {
+      copy_centroids(seeds);
+      hlpr::with_centroid_finder<coord_t>(
+      options.search, k, dims,
+      [&](auto& finder)
+      {
+        finder.assign(centroids);
+        assign_and_accumulate(policy, data_points, out_indices, finder,
+                              acc);
+      });
+      return std::pair{ acc.inertia, acc.distances };
+    });
+    cluster_sizes = std::move(acc.counts);
+    cluster_sse = std::move(acc.sse);
+  } else if(options.algorithm == assignment_algorithm::lloyd) {
+    copy_centroids(seeds);
+    cluster_accumulator<centroid_type> acc(k, options.weights);
+    convergence = lloyd_iterations(policy, data_points, out_indices,
+                                   centroids, acc, options,
+                                   measure_seeds(acc),
+                                   trace_iterations(trace, acc, options));
+    cluster_sizes = std::move(acc.counts);
+    cluster_sse = std::move(acc.sse);
+  } else {
+    flat_accumulator<coord_t> acc(k, dims, options.weights);
+    convergence = bounded_iterations(policy, rows, out_indices, seeds, acc,
+                                     options, dims, measure_seeds(acc),
+                                     trace_iterations(trace, acc, options));
+    copy_centroids(seeds);
+    cluster_sizes = std::move(acc.counts);
+    cluster_sse = std::move(acc.sse);
   }
 
-  using rv::values, r::to, std::vector;
+  if(options.empty_clusters == empty_cluster_strategy::drop) {
+    drop_empty_clusters(out_indices, centroids, 1, cluster_sse,
+                        cluster_sizes);
+  }
 
-  return { (values(indexed_centroids) //
-            | to<vector<centroid_t<PTS_R>>>()),
-           clusters_histogram(FWD(out_indices), k), //
+  // The last pass' counts are the clusters' histogram
+  return { std::move(centroids), //
+           std::move(cluster_sizes), //
            FWD(data_points), //
-           FWD(out_indices) };
+           FWD(out_indices), //
+           convergence, //
+           seeding, //
+           std::move(mini_batch), //
+           std::move(cluster_sse), //
+           std::move(trace), //
+           &prof };
+}
+
+// The result holds a copy of the matrix view
+template<typename M, typename IDX_R>
+using matrix_k_means_t = //
+k_means_result<std::vector<std::vector<matrix_centroid_value_t<M>>>,
+               std::vector<size_type>, //
+               std::remove_cvref_t<M> const, IDX_R>;
+
+template<hlpr::matrix_source M, typename IDX_R>
+[[nodiscard]] //
+auto matrix_k_means_impl(auto const& policy,
+                         M const& points,
+                         IDX_R&& out_indices,
+                         size_type k,
+                         k_means_options const& options,
+                         auto const& seeder)
+-> matrix_k_means_t<M, IDX_R>
+{
+  using value_t = matrix_centroid_value_t<M>;
+  auto const dims = static_cast<size_type>(points.cols());
+  hlpr::profiler prof;
+  hlpr::profile_scope const profiling{ &prof };
+
+  auto const split_rows = [&](std::vector<value_t> const& flat)
+  {
+    std::vector<std::vector<value_t>> centroid_rows;
+    centroid_rows.reserve(flat.size() / dims);
+    for(size_type c{}; c < flat.size() / dims; ++c) //
+    {
+      auto const first = flat.begin() + static_cast<std::ptrdiff_t>(c * dims);
+      centroid_rows.emplace_back(first,
+                                 first + static_cast<std::ptrdiff_t>(dims));
+    }
+    return centroid_rows;
+  };
+
+  if constexpr(std::same_as<std::remove_cvref_t<decltype(seeder)>,
+                            hlpr::options_seeder>)
+  {
+    if(options.n_init > 1) {
+      auto best =
+      run_restarts<value_t>(policy, points, out_indices, k, options);
+      if(options.empty_clusters == empty_cluster_strategy::drop) {
+        drop_empty_clusters(out_indices, best.centroids, dims,
+                            best.cluster_sse, best.cluster_sizes);
+      }
+      return { split_rows(best.centroids), //
+               std::move(best.cluster_sizes), //
+               points, //
+               FWD(out_indices), //
+               best.convergence, //
+               best.seeding, //
+               std::move(best.mini_batch), //
+               std::move(best.cluster_sse), //
+               std::move(best.trace), //
+               &prof };
+    }
+  }
+
+  auto const rows = hlpr::matrix_rows<value_t, M>(points);
+  auto [centroids, seeding] = seeder.template seed<value_t>(
+  policy, rows, k, options.seeding, options.weights);
+
+  flat_accumulator<value_t> acc(k, dims, options.weights);
+  auto const measure_seeds = [&](size_type iteration)
+  { // The first pass measures the seeds
+    if(iteration == 1) seeding.inertia = acc.inertia;
+  };
+
+  convergence_report convergence;
+  std::vector<iteration_sample> trace;
+  mini_batch_report mini_batch;
+
+  if(options.mini_batch) {
+    std::tie(convergence, mini_batch) = run_mini_batch(
+    policy, rows, centroids, k, options, seeding.seed,
+    [&]
+    {
+      hlpr::with_centroid_finder<value_t>(
+      options.search, k, dims,
+      [&](auto& finder)
+      {
+        finder.assign_rows(centroids.data());
+        assign_and_accumulate_rows(policy, points, out_indices, finder,
+                                   acc);
+      });
+      return std::pair{ acc.inertia, acc.distances };
+    });
+  } else if(options.algorithm == assignment_algorithm::lloyd) {
+    size_type distances{};
+    convergence = hlpr::with_centroid_finder<value_t>(
+    options.search, k, dims,
+    [&](auto& finder)
+    {
+      return iterate_until_converged(
+      options.convergence,
+      [&]
+      {
+        finder.assign_rows(centroids.data());
+        auto const reassigned = assign_and_accumulate_rows(
+        policy, points, out_indices, finder, acc);
+        distances += acc.distances;
+        return reassigned;
+      },
+      [&]
+      {
+        return move_flat_centroids(centroids, acc,
+                                   options.empty_clusters);
+      },
+      measure_seeds, trace_iterations(trace, acc, options));
+    });
+    convergence.distances = distances;
+  } else {
+    convergence = bounded_iterations(
+    policy, rows, out_indices, centroids, acc, options, hlpr::dims_block,
+    measure_seeds, trace_iterations(trace, acc, options));
+  }
+
+  if(options.empty_clusters == empty_cluster_strategy::drop) {
+    drop_empty_clusters(out_indices, centroids, dims, acc.sse, acc.counts);
+  }
+
+  return { split_rows(centroids), //
+           std::move(acc.counts), //
+           points, //
+           FWD(out_indices), //
+           convergence, //
+           seeding, //
+           std::move(mini_batch), //
+           std::move(acc.sse), //
+           std::move(trace), //
+           &prof };
 }
 
 // clang-format off
 struct k_means_fn
-{ 
+{
+  // The last argument is either n, the maximum number of iterations,
+  // a convergence_criteria or a k_means_options
   template<hlpr::data_points_range PTS_R, hlpr::unsigned_range IDX_R>
   [[nodiscard]] constexpr
   auto operator()(PTS_R&& data_points,
@@ -444,24 +2426,198 @@ struct k_means_fn
                   IDX_R&& out_indices,
                   // Is an rvalue ref instead of lvalue ref
                   // to handle rvalue args such as views-like objects
-                  size_type k, size_type n) const noexcept
+                  size_type k,
+                  hlpr::k_means_config auto const& config) const
   -> std::optional<k_means_impl_t<PTS_R, IDX_R>>
   {
-    if(k < 2) return std::nullopt;
+    auto const options = hlpr::to_options(config);
+    if(not valid_arguments(data_points, out_indices, k, options)
+       or not hlpr::valid_seeding(options))
+    { return std::nullopt; }
 
-    // distance() is used over size() to support non-sized range
-    // arguments such as "data_points_arg | filter(...)"
-    if(auto const pts_dist = stdr::distance(data_points);
-       not std::in_range<size_type>(pts_dist) // Fall if distance is signed
-       or static_cast<size_type>(pts_dist) < k
-       or static_cast<size_type>(pts_dist) != stdr::size(out_indices))
-    { return std::nullopt; } 
-    
-    return { k_means_impl<PTS_R, IDX_R>(FWD(data_points),
+    return { k_means_impl<PTS_R, IDX_R>(seq,
+                                        FWD(data_points),
+                                        FWD(out_indices),
+                                        k, options,
+                                        hlpr::options_seeder{})
+           };
+  }
+
+  // Parallel overload; the passes index into both ranges by blocks
+  template<hlpr::data_points_range PTS_R, hlpr::unsigned_range IDX_R>
+    requires stdr::random_access_range<PTS_R>
+             and stdr::random_access_range<IDX_R>
+             and stdr::sized_range<PTS_R>
+  [[nodiscard]]
+  auto operator()(parallel_policy policy,
+                  PTS_R&& data_points,
+                  IDX_R&& out_indices,
+                  size_type k,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<k_means_impl_t<PTS_R, IDX_R>>
+  {
+    auto const options = hlpr::to_options(config);
+    if(not valid_arguments(data_points, out_indices, k, options)
+       or not hlpr::valid_seeding(options))
+    { return std::nullopt; }
+
+    return { k_means_impl<PTS_R, IDX_R>(policy,
+                                        FWD(data_points),
+                                        FWD(out_indices),
+                                        k, options,
+                                        hlpr::options_seeder{})
+           };
+  }
+
+  // Warm start overloads: initial_centroids, e.g. the centroids() of a
+  // previous result, replace the seeding and their count sets k
+  template<hlpr::data_points_range PTS_R,
+           hlpr::unsigned_range IDX_R,
+           hlpr::centroids_range C_R>
+  [[nodiscard]] constexpr
+  auto operator()(PTS_R&& data_points,
+                  IDX_R&& out_indices,
+                  C_R const& initial_centroids,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<k_means_impl_t<PTS_R, IDX_R>>
+  {
+    auto const k = static_cast<size_type>(stdr::size(initial_centroids));
+    auto const options = hlpr::to_options(config);
+    if(not valid_arguments(data_points, out_indices, k, options)
+       or not hlpr::given_dims(initial_centroids,
+                               hlpr::data_point_size_v<
+                               stdr::range_value_t<PTS_R>>))
+    { return std::nullopt; }
+
+    return { k_means_impl<PTS_R, IDX_R>(seq,
+                                        FWD(data_points),
                                         FWD(out_indices),
-                                        k, n)
+                                        k, options,
+                                        hlpr::given_seeder<C_R>{
+                                          &initial_centroids })
            };
   }
+
+  template<hlpr::data_points_range PTS_R,
+           hlpr::unsigned_range IDX_R,
+           hlpr::centroids_range C_R>
+    requires stdr::random_access_range<PTS_R>
+             and stdr::random_access_range<IDX_R>
+             and stdr::sized_range<PTS_R>
+  [[nodiscard]]
+  auto operator()(parallel_policy policy,
+                  PTS_R&& data_points,
+                  IDX_R&& out_indices,
+                  C_R const& initial_centroids,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<k_means_impl_t<PTS_R, IDX_R>>
+  {
+    auto const k = static_cast<size_type>(stdr::size(initial_centroids));
+    auto const options = hlpr::to_options(config);
+    if(not valid_arguments(data_points, out_indices, k, options)
+       or not hlpr::given_dims(initial_centroids,
+                               hlpr::data_point_size_v<
+                               stdr::range_value_t<PTS_R>>))
+    { return std::nullopt; }
+
+    return { k_means_impl<PTS_R, IDX_R>(policy,
+                                        FWD(data_points),
+                                        FWD(out_indices),
+                                        k, options,
+                                        hlpr::given_seeder<C_R>{
+                                          &initial_centroids })
+           };
+  }
+
+  // Runtime-dimension overloads over matrix_view and columns_view
+  template<hlpr::matrix_source M, hlpr::unsigned_range IDX_R>
+    requires stdr::random_access_range<IDX_R>
+  [[nodiscard]]
+  auto operator()(M const& points,
+                  IDX_R&& out_indices,
+                  size_type k,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<matrix_k_means_t<M, IDX_R>>
+  { return (*this)(seq, points, FWD(out_indices), k, config); }
+
+  template<hlpr::matrix_source M, hlpr::unsigned_range IDX_R>
+    requires stdr::random_access_range<IDX_R>
+  [[nodiscard]]
+  auto operator()(hlpr::execution_policy auto policy,
+                  M const& points,
+                  IDX_R&& out_indices,
+                  size_type k,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<matrix_k_means_t<M, IDX_R>>
+  {
+    auto const options = hlpr::to_options(config);
+    if(k < 2 or points.cols() == 0 or points.rows() < k
+       or points.rows() != stdr::size(out_indices)
+       or not hlpr::valid_weights(options, points.rows())
+       or not hlpr::valid_seeding(options))
+    { return std::nullopt; }
+
+    return { matrix_k_means_impl(policy, points, FWD(out_indices),
+                                 k, options,
+                                 hlpr::options_seeder{}) };
+  }
+
+  template<hlpr::matrix_source M,
+           hlpr::unsigned_range IDX_R,
+           hlpr::centroids_range C_R>
+    requires stdr::random_access_range<IDX_R>
+  [[nodiscard]]
+  auto operator()(M const& points,
+                  IDX_R&& out_indices,
+                  C_R const& initial_centroids,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<matrix_k_means_t<M, IDX_R>>
+  { return (*this)(seq, points, FWD(out_indices), initial_centroids, config); }
+
+  template<hlpr::matrix_source M,
+           hlpr::unsigned_range IDX_R,
+           hlpr::centroids_range C_R>
+    requires stdr::random_access_range<IDX_R>
+  [[nodiscard]]
+  auto operator()(hlpr::execution_policy auto policy,
+                  M const& points,
+                  IDX_R&& out_indices,
+                  C_R const& initial_centroids,
+                  hlpr::k_means_config auto const& config) const
+  -> std::optional<matrix_k_means_t<M, IDX_R>>
+  {
+    auto const k = static_cast<size_type>(stdr::size(initial_centroids));
+    auto const options = hlpr::to_options(config);
+    if(k < 2 or points.cols() == 0 or points.rows() < k
+       or points.rows() != stdr::size(out_indices)
+       or not hlpr::valid_weights(options, points.rows())
+       or not hlpr::given_dims(initial_centroids,
+                               static_cast<size_type>(points.cols())))
+    { return std::nullopt; }
+
+    return { matrix_k_means_impl(policy, points, FWD(out_indices),
+                                 k, options,
+                                 hlpr::given_seeder<C_R>{
+                                   &initial_centroids }) };
+  }
+
+private:
+  [[nodiscard]] static constexpr
+  auto valid_arguments(auto&& data_points,
+                       auto&& out_indices,
+                       size_type k,
+                       k_means_options const& options) noexcept -> bool
+  {
+    if(k < 2) return false;
+
+    // distance() is used over size() to support non-sized range
+    // arguments such as "data_points_arg | filter(...)"
+    auto const pts_dist = stdr::distance(data_points);
+    return std::in_range<size_type>(pts_dist) // Fall if distance is signed
+           and static_cast<size_type>(pts_dist) >= k
+           and static_cast<size_type>(pts_dist) == stdr::size(out_indices)
+           and hlpr::valid_weights(options, stdr::size(out_indices));
+  }
 };
 
 // k_means: Callable object that the user can call or pass around
@@ -469,4 +2625,7 @@ constexpr inline k_means_fn k_means{};
 
 } // namespace kmn
 
+// Restarts run in workspaces
+#include <kmn/Workspace.hpp>
+
 #endif
@@ -0,0 +1,248 @@
+#ifndef KMN_MATRIX_VIEW_HPP
+#define KMN_MATRIX_VIEW_HPP
+
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <kmn/DataPoint.hpp>
+#include <ranges>
+#include <span>
+
+namespace kmn {
+
+using size_type = std::size_t;
+
+namespace hlpr {
+  // index_iterator: Random access iterator over the elements
+  //                 (*parent)[0], (*parent)[1], ... of an indexable type
+  template<typename PARENT>
+  class index_iterator
+  {
+    PARENT const* m_parent{};
+    std::ptrdiff_t m_idx{};
+
+  public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = std::remove_cvref_t<
+    decltype(std::declval<PARENT const&>()[size_type{}])>;
+    using iterator_concept = std::random_access_iterator_tag;
+
+    index_iterator() = default;
+    constexpr index_iterator(PARENT const* parent, std::ptrdiff_t idx) noexcept
+    : m_parent{ parent }, m_idx{ idx }
+    { }
+
+    // clang-format off
+    [[nodiscard]] constexpr auto operator*() const -> value_type
+    { return (*m_parent)[static_cast<size_type>(m_idx)]; }
+
+    [[nodiscard]] constexpr
+    auto operator[](difference_type n) const -> value_type
+    { return *(*this + n); }
+
+    constexpr auto operator++() noexcept -> index_iterator&
+    { return (void(++m_idx), *this); }
+    constexpr auto operator--() noexcept -> index_iterator&
+    { return (void(--m_idx), *this); }
+    constexpr auto operator++(int) noexcept -> index_iterator
+    { auto tmp = *this; ++m_idx; return tmp; }
+    constexpr auto operator--(int) noexcept -> index_iterator
+    { auto tmp = *this; --m_idx; return tmp; }
+
+    constexpr auto operator+=(difference_type n) noexcept -> index_iterator&
+    { return (void(m_idx += n), *this); }
+    constexpr auto operator-=(difference_type n) noexcept -> index_iterator&
+    { return (void(m_idx -= n), *this); }
+
+    [[nodiscard]] friend constexpr
+    auto operator+(index_iterator it, difference_type n) noexcept
+    -> index_iterator
+    { return it += n; }
+    [[nodiscard]] friend constexpr
+    auto operator+(difference_type n, index_iterator it) noexcept
+    -> index_iterator
+    { return it += n; }
+    [[nodiscard]] friend constexpr
+    auto operator-(index_iterator it, difference_type n) noexcept
+    -> index_iterator
+    { return it -= n; }
+    [[nodiscard]] friend constexpr
+    auto operator-(index_iterator lhs, index_iterator rhs) noexcept
+    -> difference_type
+    { return lhs.m_idx - rhs.m_idx; }
+
+    [[nodiscard]] friend constexpr
+    auto operator==(index_iterator lhs, index_iterator rhs) noexcept -> bool
+    { return lhs.m_idx == rhs.m_idx; }
+    [[nodiscard]] friend constexpr
+    auto operator<=>(index_iterator lhs, index_iterator rhs) noexcept
+    { return lhs.m_idx <=> rhs.m_idx; }
+    // clang-format on
+  };
+} // namespace hlpr
+
+// matrix_view: Non-owning view over a row-major buffer of rows x cols
+//              values, consecutive rows being stride values apart.
+//              It is a range of its rows, each one a std::span.
+template<arithmetic T>
+class matrix_view: public std::ranges::view_interface<matrix_view<T>>
+{
+  T const* m_data{};
+  size_type m_rows{};
+  size_type m_cols{};
+  size_type m_stride{};
+
+public:
+  using value_type = T;
+
+  matrix_view() = default;
+
+  constexpr matrix_view(T const* data, size_type rows, //
+                        size_type cols, size_type stride) noexcept
+  : m_data{ data }, m_rows{ rows }, m_cols{ cols }, m_stride{ stride }
+  { assert(stride >= cols); }
+
+  constexpr matrix_view(T const* data, size_type rows, size_type cols) noexcept
+  : matrix_view(data, rows, cols, cols)
+  { }
+
+  // clang-format off
+  [[nodiscard]] constexpr auto rows() const noexcept { return m_rows; }
+  [[nodiscard]] constexpr auto cols() const noexcept { return m_cols; }
+  [[nodiscard]] constexpr auto stride() const noexcept { return m_stride; }
+  [[nodiscard]] constexpr auto data() const noexcept { return m_data; }
+
+  [[nodiscard]] constexpr
+  auto operator[](size_type row) const noexcept -> std::span<T const>
+  { return { m_data + row * m_stride, m_cols }; }
+
+  [[nodiscard]] constexpr auto begin() const noexcept
+  { return hlpr::index_iterator<matrix_view>{ this, 0 }; }
+
+  [[nodiscard]] constexpr auto end() const noexcept
+  {
+    return hlpr::index_iterator<matrix_view>{
+      this, static_cast<std::ptrdiff_t>(m_rows) };
+  }
+
+  [[nodiscard]] constexpr auto size() const noexcept { return m_rows; }
+
+  // clang-format on
+  // load: Converts count rows starting at first into a
+  //       row-major tile of count x cols() values of type V
+  template<typename V>
+  constexpr void load(size_type first, size_type count, V* tile) const noexcept
+  {
+    for(size_type r{}; r < count; ++r) //
+    {
+      auto const* row = m_data + (first + r) * m_stride;
+      for(size_type d{}; d < m_cols; ++d) //
+      { tile[r * m_cols + d] = static_cast<V>(row[d]); }
+    }
+  }
+};
+
+// column_row: A row of a columns_view, gathered from every column
+template<arithmetic T>
+class column_row
+{
+  T const* const* m_columns{};
+  size_type m_cols{};
+  size_type m_row{};
+
+public:
+  using value_type = T;
+
+  column_row() = default;
+  constexpr column_row(T const* const* columns, //
+                       size_type cols, size_type row) noexcept
+  : m_columns{ columns }, m_cols{ cols }, m_row{ row }
+  { }
+
+  // clang-format off
+  [[nodiscard]] constexpr auto size() const noexcept { return m_cols; }
+
+  [[nodiscard]] constexpr auto operator[](size_type d) const noexcept -> T
+  { return m_columns[d][m_row]; }
+
+  [[nodiscard]] constexpr auto begin() const noexcept
+  { return hlpr::index_iterator<column_row>{ this, 0 }; }
+
+  [[nodiscard]] constexpr auto end() const noexcept
+  {
+    return hlpr::index_iterator<column_row>{
+      this, static_cast<std::ptrdiff_t>(m_cols) };
+  }
+  // clang-format on
+};
+
+// columns_view: Non-owning view over columnar data, one pointer to rows
+//               values per column. It is a range of its rows,
+//               each one a column_row.
+template<arithmetic T>
+class columns_view: public std::ranges::view_interface<columns_view<T>>
+{
+  std::span<T const* const> m_columns{};
+  size_type m_rows{};
+
+public:
+  using value_type = T;
+
+  columns_view() = default;
+
+  constexpr columns_view(std::span<T const* const> columns,
+                         size_type rows) noexcept
+  : m_columns{ columns }, m_rows{ rows }
+  { }
+
+  // clang-format off
+  [[nodiscard]] constexpr auto rows() const noexcept { return m_rows; }
+  [[nodiscard]] constexpr auto cols() const noexcept { return m_columns.size(); }
+
+  [[nodiscard]] constexpr
+  auto operator[](size_type row) const noexcept -> column_row<T>
+  { return { m_columns.data(), m_columns.size(), row }; }
+
+  [[nodiscard]] constexpr auto begin() const noexcept
+  { return hlpr::index_iterator<columns_view>{ this, 0 }; }
+
+  [[nodiscard]] constexpr auto end() const noexcept
+  {
+    return hlpr::index_iterator<columns_view>{
+      this, static_cast<std::ptrdiff_t>(m_rows) };
+  }
+
+  [[nodiscard]] constexpr auto size() const noexcept { return m_rows; }
+
+  // clang-format on
+  // load: Converts count rows starting at first into a
+  //       row-major tile of count x cols() values of type V,
+  //       reading each column contiguously
+  template<typename V>
+  constexpr void load(size_type first, size_type count, V* tile) const noexcept
+  {
+    auto const cols = m_columns.size();
+    for(size_type d{}; d < cols; ++d) //
+    {
+      auto const* column = m_columns[d] + first;
+      for(size_type r{}; r < count; ++r) //
+      { tile[r * cols + d] = static_cast<V>(column[r]); }
+    }
+  }
+};
+
+namespace hlpr {
+  // matrix_source: Runtime-dimension inputs of k_means
+  template<typename M>
+  concept matrix_source = requires(M const& m, double* tile) {
+    typename M::value_type;
+    { m.rows() } -> std::convertible_to<size_type>;
+    { m.cols() } -> std::convertible_to<size_type>;
+    m.load(size_type{}, size_type{}, tile);
+  };
+} // namespace hlpr
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef KMN_MINI_BATCH_HPP
+#define KMN_MINI_BATCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <kmn/Distance_kernels.hpp>
+#include <kmn/Execution.hpp>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+// Mini-batch steps (Sculley, "Web-scale k-means clustering"), reading
+// points through a row source as described in Seeding.hpp.
+
+namespace kmn {
+
+using size_type = std::size_t;
+
+// mini_batch_options: Size, count and seed of the sampled batches
+struct mini_batch_options
+{
+  size_type batch_size{ 1024 };
+  size_type steps{ 100 };
+  // Defaults to the seed the centroids were seeded with
+  std::optional<std::uint64_t> seed{};
+  // Steps between two samples of the report's trace, 0 for none
+  size_type trace_interval{ 1 };
+};
+
+// mini_batch_sample: Where the steps stood after a given step
+struct mini_batch_sample
+{
+  size_type step{};
+  // Since the first step
+  double seconds{};
+  // Mean squared distance of the step's batch to the centroids,
+  // before the step moved them
+  double batch_inertia{};
+};
+
+// mini_batch_report: What the steps did, and the inertia
+//                    of the final assignment pass
+struct mini_batch_report
+{
+  std::uint64_t seed{};
+  size_type steps{};
+  double seconds{};
+  double inertia{};
+  std::vector<mini_batch_sample> trace{};
+};
+
+namespace hlpr {
+  // mini_batch_block_size: Batch points per block of a parallel step,
+  //                        enough for each block to measure about 2^16
+  //                        coordinate differences, so that a batch of
+  //                        1024 points is split once k x dims exceeds 64
+  //                        and steps too small to keep threads busy run
+  //                        on the calling thread
+  [[nodiscard]] constexpr //
+  auto mini_batch_block_size(size_type k, size_type dims) noexcept
+  -> size_type
+  {
+    auto const work = std::max(k * dims, size_type{ 1 });
+    return std::clamp((size_type{ 1 } << 16U) / work, size_type{ 64 },
+                      parallel_block_size);
+  }
+} // namespace hlpr
+
+// mini_batch_steps: Moves k x dims row-major centroids through the steps
+//                   of options. Each step samples batch_size points with
+//                   replacement and moves every centroid towards the mean
+//                   of the sampled points nearest to it, at a rate of
+//                   their share of all the points it has been moved
+//                   towards, so that a centroid is the running mean of its
+//                   samples. Steps stop early once no centroid moves
+//                   farther than tolerance. Given weights, one per row,
+//                   rows are sampled with probability proportional to
+//                   their weight, which keeps every step's mean unbiased.
+template<std::floating_point V>
+auto mini_batch_steps(auto const& policy,
+                      auto const& rows,
+                      std::vector<V>& centroids,
+                      size_type k,
+                      mini_batch_options const& options,
+                      std::uint64_t seed,
+                      double tolerance,
+                      std::span<double const> weights = {})
+-> mini_batch_report
+{
+  using clock = std::chrono::steady_clock;
+  auto const start = clock::now();
+  auto const elapsed = [&]
+  { return std::chrono::duration<double>(clock::now() - start).count(); };
+
+  auto const n = rows.size();
+  auto const dims = rows.dims();
+  auto const batch_size = std::max(options.batch_size, size_type{ 1 });
+  auto const sqr_tolerance = tolerance * tolerance;
+  auto const block_size = hlpr::mini_batch_block_size(k, dims);
+
+  std::mt19937_64 gen{ seed };
+  std::uniform_int_distribution<size_type> draw_uniform{ 0, n - 1 };
+
+  // Weighted draws search the running sums of the weights
+  std::vector<double> cumulative(weights.size());
+  std::partial_sum(weights.begin(), weights.end(), cumulative.begin());
+  auto const draw = [&]
+  {
+    if(cumulative.empty()) return draw_uniform(gen);
+    auto const r = std::uniform_real_distribution<double>{
+      0.0, cumulative.back()
+    }(gen);
+    return std::min(static_cast<size_type>(
+                    std::ranges::upper_bound(cumulative, r)
+                    - cumulative.begin()),
+                    n - 1);
+  };
+
+  simd::centroid_block<V> block(k, dims);
+  std::vector<size_type> indices(batch_size);
+  std::vector<V> batch(batch_size * dims);
+  std::vector<size_type> nearest(batch_size);
+  std::vector<V> batch_distances(batch_size);
+  std::vector<V> sums(k * dims);
+  std::vector<size_type> batch_counts(k);
+  std::vector<size_type> seen(k);
+
+  mini_batch_report report{ .seed = seed };
+
+  for(size_type step{}; step < options.steps; ++step) //
+  {
+    // Rows are read in index order
+    for(auto& i: indices) i = draw();
+    std::ranges::sort(indices);
+    for(size_type j{}; j < batch_size; ++j) //
+    { rows.load(indices[j], batch.data() + j * dims); }
+
+    block.assign_rows(centroids.data());
+    hlpr::for_each_block(
+    policy, batch_size, block_size,
+    [&](size_type /*block*/, size_type first, size_type last)
+    {
+      std::vector<V> distances(block.stride());
+      for(auto j = first; j < last; ++j) //
+      {
+        nearest[j] = block.nearest(batch.data() + j * dims, distances.data());
+        batch_distances[j] = distances[nearest[j]];
+      }
+    });
+
+    std::ranges::fill(sums, V{});
+    std::ranges::fill(batch_counts, size_type{ 0 });
+    double batch_inertia{};
+    for(size_type j{}; j < batch_size; ++j) //
+    {
+      auto* sum = sums.data() + nearest[j] * dims;
+      auto const* pt = batch.data() + j * dims;
+      for(size_type d{}; d < dims; ++d) sum[d] += pt[d];
+      ++batch_counts[nearest[j]];
+      batch_inertia += static_cast<double>(batch_distances[j]);
+    }
+
+    // Per-centroid learning rates
+    double max_sqr_shift{};
+    for(size_type c{}; c < k; ++c) //
+    {
+      if(batch_counts[c] == 0) continue;
+
+      seen[c] += batch_counts[c];
+      auto const rate = V{ 1 } / static_cast<V>(seen[c]);
+      auto const count = static_cast<V>(batch_counts[c]);
+      double sqr_shift{};
+      for(size_type d{}; d < dims; ++d) //
+      {
+        auto& coord = centroids[c * dims + d];
+        auto const delta = (sums[c * dims + d] - count * coord) * rate;
+        coord += delta;
+        sqr_shift += static_cast<double>(delta) * static_cast<double>(delta);
+      }
+      max_sqr_shift = std::max(max_sqr_shift, sqr_shift);
+    }
+
+    ++report.steps;
+    if(options.trace_interval != 0 and step % options.trace_interval == 0) {
+      report.trace.push_back(
+      { .step = report.steps,
+        .seconds = elapsed(),
+        .batch_inertia = batch_inertia / static_cast<double>(batch_size) });
+    }
+
+    if(max_sqr_shift <= sqr_tolerance) break;
+  }
+
+  report.seconds = elapsed();
+  return report;
+}
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef KMN_MODEL_HPP
+#define KMN_MODEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <kmn/K_means.hpp>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Trained centroids, kept to label new points. A model serializes to a
+// blob of a 32-byte header followed by the centroids and their counts:
+//
+//   offset  bytes  field
+//        0      8  magic "KMNMODEL"
+//        8      4  version
+//       12      1  size of a coordinate, 4 or 8 (float or double)
+//       13      1  byte order, 1 little endian, 2 big endian
+//       14      2  reserved
+//       16      8  k
+//       24      8  dims
+//       32         k x dims coordinates, row-major, then k u64 counts
+
+namespace kmn {
+
+namespace hlpr {
+  inline constexpr std::array<char, 8> model_magic{ 'K', 'M', 'N', 'M',
+                                                    'O', 'D', 'E', 'L' };
+  inline constexpr size_type model_header_size = 32;
+  inline constexpr std::uint32_t model_version = 1;
+
+  // read_value: Reads a T at bytes, whose byte order is reversed if swap
+  template<typename T>
+  [[nodiscard]] auto read_value(std::byte const* bytes, bool swap) noexcept
+  -> T
+  {
+    std::array<std::byte, sizeof(T)> raw;
+    std::memcpy(raw.data(), bytes, sizeof(T));
+    if(swap) std::ranges::reverse(raw);
+    return std::bit_cast<T>(raw);
+  }
+
+  // write_values: Appends the bytes of values to blob, in native byte order
+  template<typename T>
+  void write_values(std::vector<std::byte>& blob, std::span<T const> values)
+  {
+    auto const bytes = std::as_bytes(values);
+    blob.insert(blob.end(), bytes.begin(), bytes.end());
+  }
+
+  // write_value: Appends the bytes of value to blob
+  void write_value(std::vector<std::byte>& blob, auto value)
+  { write_values(blob, std::span{ &std::as_const(value), 1 }); }
+
+  // write_header: Appends magic, the format version, the coordinates' size,
+  //               the byte order, the reserved bytes, k and dims to blob
+  template<std::floating_point V>
+  void write_header(std::vector<std::byte>& blob,
+                    std::array<char, 8> const& magic,
+                    std::uint32_t version,
+                    size_type k,
+                    size_type dims)
+  {
+    write_values(blob, std::span<char const>{ magic });
+    write_value(blob, version);
+    write_value(blob, static_cast<std::uint8_t>(sizeof(V)));
+    write_value(blob, std::uint8_t{ std::endian::native == std::endian::little
+                                    ? 1
+                                    : 2 });
+    write_value(blob, std::uint16_t{}); // Reserved
+    write_value(blob, std::uint64_t{ k });
+    write_value(blob, std::uint64_t{ dims });
+  }
+
+  template<typename R>
+  concept k_means_result_like = requires(R const& result) {
+    { result.centroids() } -> centroids_range;
+    { result.cluster_sizes() } -> stdr::sized_range;
+  };
+} // namespace hlpr
+
+template<std::floating_point V>
+class model
+{
+  size_type m_dims;
+  // k x dims row-major
+  std::vector<V> m_centroids;
+  // Points each centroid is the mean of, as far as partial_fit knows
+  std::vector<std::uint64_t> m_counts;
+  simd::centroid_block<V> m_block;
+
+  model(size_type dims,
+        std::vector<V> centroids,
+        std::vector<std::uint64_t> counts)
+  : m_dims{ dims },
+    m_centroids{ std::move(centroids) },
+    m_counts{ std::move(counts) },
+    m_block(m_counts.size(), dims)
+  { m_block.assign_rows(m_centroids.data()); }
+
+  [[nodiscard]] static auto flatten(auto const& centroids) -> std::vector<V>
+  {
+    std::vector<V> flat;
+    for(auto const& centroid: centroids) {
+      for(auto const coord: centroid) flat.push_back(static_cast<V>(coord));
+    }
+    return flat;
+  }
+
+  [[nodiscard]] auto matches(auto const& rows, auto const& out_indices) const
+  -> bool
+  {
+    return rows.dims() == m_dims
+           and rows.size() == static_cast<size_type>(stdr::size(out_indices));
+  }
+
+public:
+  // Bare centroids each weigh as one point in partial_fit
+  template<hlpr::centroids_range C_R>
+  explicit model(C_R const& centroids)
+  : model(centroids, std::vector<std::uint64_t>(stdr::size(centroids), 1))
+  { }
+
+  // counts: Points each centroid is the mean of, e.g. cluster sizes
+  template<hlpr::centroids_range C_R, stdr::sized_range COUNTS_R>
+  model(C_R const& centroids, COUNTS_R const& counts)
+  : model(static_cast<size_type>(stdr::size(*stdr::begin(centroids))),
+          flatten(centroids),
+          std::vector<std::uint64_t>(stdr::begin(counts), stdr::end(counts)))
+  {
+    assert(stdr::size(centroids) == m_counts.size()
+           and hlpr::given_dims(centroids, m_dims));
+  }
+
+  // From a k_means result: its centroids, weighing their cluster's size
+  template<hlpr::k_means_result_like R>
+  explicit model(R const& result)
+  : model(result.centroids(), result.cluster_sizes())
+  { }
+
+  // clang-format off
+  [[nodiscard]] auto k() const noexcept { return m_counts.size(); }
+  [[nodiscard]] auto dims() const noexcept { return m_dims; }
+
+  [[nodiscard]] auto centroid(size_type c) const noexcept
+  -> std::span<V const>
+  { return { m_centroids.data() + c * m_dims, m_dims }; }
+
+  [[nodiscard]] auto counts() const noexcept
+  -> std::span<std::uint64_t const>
+  { return m_counts; }
+
+  // clang-format on
+  // predict: Writes the 1-based id of the centroid nearest to each point
+  //          of a DataPoint range or matrix source to out_indices, with
+  //          one blocked kernel call per point. Returns false, writing
+  //          nothing, if the points' dimension or count don't match.
+  template<hlpr::unsigned_range IDX_R>
+    requires stdr::random_access_range<IDX_R>
+  auto predict(hlpr::execution_policy auto policy,
+               auto const& points,
+               IDX_R&& out_indices) const -> bool
+  {
+    using index_t = stdr::range_value_t<IDX_R>;
+
+    auto const rows = hlpr::rows_of<V>(points);
+    if(not matches(rows, out_indices)) return false;
+
+    auto const out = stdr::begin(out_indices);
+    hlpr::for_each_block(
+    policy, rows.size(),
+    [&](size_type /*block*/, size_type first, size_type last)
+    {
+      std::vector<V> distances(m_block.stride());
+      rows.for_each(first, last,
+                    [&](size_type i, V const* coords)
+                    {
+                      auto const c =
+                      m_block.nearest(coords, distances.data());
+                      out[static_cast<std::ptrdiff_t>(i)] =
+                      static_cast<index_t>(c + 1);
+                    });
+    });
+    return true;
+  }
+
+  template<hlpr::unsigned_range IDX_R>
+    requires stdr::random_access_range<IDX_R>
+  auto predict(auto const& points, IDX_R&& out_indices) const -> bool
+  { return predict(seq, points, FWD(out_indices)); }
+
+  // partial_fit: Sequential k-means (MacQueen): each point in turn moves
+  //              its nearest centroid to the mean of the points it has
+  //              seen, i.e. by 1 / count of the way towards the point
+  auto partial_fit(auto const& points) -> bool
+  {
+    auto const rows = hlpr::rows_of<V>(points);
+    if(rows.dims() != m_dims) return false;
+
+    std::vector<V> distances(m_block.stride());
+    rows.for_each(0, rows.size(),
+                  [&](size_type, V const* coords)
+                  {
+                    auto const c = m_block.nearest(coords, distances.data());
+                    auto const rate =
+                    V{ 1 } / static_cast<V>(++m_counts[c]);
+                    auto* centroid = m_centroids.data() + c * m_dims;
+                    for(size_type d{}; d < m_dims; ++d) //
+                    { centroid[d] += (coords[d] - centroid[d]) * rate; }
+                    m_block.set(c, centroid);
+                  });
+    return true;
+  }
+
+  // to_blob: Serializes the model, in native byte order
+  [[nodiscard]] auto to_blob() const -> std::vector<std::byte>
+  {
+    std::vector<std::byte> blob;
+    blob.reserve(hlpr::model_header_size + m_centroids.size() * sizeof(V)
+                 + m_counts.size() * sizeof(std::uint64_t));
+    hlpr::write_header<V>(blob, hlpr::model_magic, hlpr::model_version, k(),
+                          m_dims);
+    hlpr::write_values(blob, std::span{ m_centroids });
+    hlpr::write_values(blob, std::span{ m_counts });
+    return blob;
+  }
+
+  // from_blob: Model serialized by to_blob, on this machine or not, and
+  //            with float or double coordinates; nullopt if blob isn't one
+  [[nodiscard]] static auto from_blob(std::span<std::byte const> blob)
+  -> std::optional<model>
+  {
+    using hlpr::read_value;
+
+    if(blob.size() < hlpr::model_header_size
+       or std::memcmp(blob.data(), hlpr::model_magic.data(),
+                      hlpr::model_magic.size())
+          != 0)
+    { return std::nullopt; }
+
+    auto const* bytes = blob.data();
+    auto const order = read_value<std::uint8_t>(bytes + 13, false);
+    if(order != 1 and order != 2) return std::nullopt;
+    auto const swap =
+    (order == 1) != (std::endian::native == std::endian::little);
+
+    auto const version = read_value<std::uint32_t>(bytes + 8, swap);
+    auto const value_size = read_value<std::uint8_t>(bytes + 12, false);
+    auto const k = read_value<std::uint64_t>(bytes + 16, swap);
+    auto const dims = read_value<std::uint64_t>(bytes + 24, swap);
+    // Checked by division, so that no product of them overflows
+    auto const payload = blob.size() - hlpr::model_header_size;
+    if(version != hlpr::model_version
+       or (value_size != sizeof(float) and value_size != sizeof(double))
+       or k < 2 or dims == 0 or dims > payload / value_size)
+    { return std::nullopt; }
+    auto const centroid_bytes = dims * value_size + sizeof(std::uint64_t);
+    if(payload % centroid_bytes != 0 or payload / centroid_bytes != k)
+    { return std::nullopt; }
+
+    std::vector<V> centroids(k * dims);
+    auto const* coords = bytes + hlpr::model_header_size;
+    for(size_type i{}; i < centroids.size(); ++i) //
+    {
+      auto const* at = coords + i * value_size;
+      centroids[i] = value_size == sizeof(float)
+                     ? static_cast<V>(read_value<float>(at, swap))
+                     : static_cast<V>(read_value<double>(at, swap));
+    }
+
+    std::vector<std::uint64_t> counts(k);
+    auto const* raw_counts = coords + centroids.size() * value_size;
+    for(size_type c{}; c < k; ++c) //
+    {
+      counts[c] = read_value<std::uint64_t>(
+      raw_counts + c * sizeof(std::uint64_t), swap);
+    }
+
+    return model(dims, std::move(centroids), std::move(counts));
+  }
+};
+
+template<hlpr::centroids_range C_R>
+model(C_R const&) -> model<typename hlpr::select_centroid_t<
+                    hlpr::centroid_coord_t<C_R>, 1>::value_type>;
+
+template<hlpr::centroids_range C_R, stdr::sized_range COUNTS_R>
+model(C_R const&, COUNTS_R const&)
+-> model<typename hlpr::select_centroid_t<hlpr::centroid_coord_t<C_R>,
+                                          1>::value_type>;
+
+template<hlpr::k_means_result_like R>
+model(R const&) -> model<typename hlpr::select_centroid_t<
+                  hlpr::centroid_coord_t<decltype(std::declval<R const&>()
+                                                  .centroids())>,
+                  1>::value_type>;
+
+} // namespace kmn
+
+#endif
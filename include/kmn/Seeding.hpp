@@ -0,0 +1,560 @@
+#ifndef KMN_SEEDING_HPP
+#define KMN_SEEDING_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <kmn/Distance_kernels.hpp>
+#include <kmn/Execution.hpp>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Seeding engines picking the initial centroids of k_means. Points may
+// carry weights, which scale their odds of being drawn.
+//
+// They read points through a row source, which provides:
+//   size(), dims(),
+//   load(i, V* coords): copies the i-th point's coordinates, as V,
+//   for_each(first, last, fn): calls fn(i, V const* coords)
+//                              for every i in [first, last).
+
+namespace kmn {
+
+using size_type = std::size_t;
+
+// seeding_method: How the initial centroids are picked
+enum class seeding_method
+{
+  uniform, // k distinct points drawn uniformly
+  k_means_plus_plus, // Each next point drawn with D² weighting
+  k_means_parallel, // k-means||: oversampled D² rounds, then k-means++
+  // Centroids handed to k_means to warm start it; only reported,
+  // options asking for it make k_means return std::nullopt
+  given
+};
+
+// clang-format off
+[[nodiscard]] constexpr
+auto to_string(seeding_method method) noexcept -> std::string_view
+{
+  switch(method) {
+    case seeding_method::uniform: return "uniform";
+    case seeding_method::k_means_plus_plus: return "k-means++";
+    case seeding_method::k_means_parallel: return "k-means||";
+    case seeding_method::given: return "given";
+  }
+  return "unknown";
+}
+
+// clang-format on
+// seeding_options: Strategy and seed of the initial centroids
+struct seeding_options
+{
+  seeding_method method{ seeding_method::k_means_plus_plus };
+  // Drawn from std::random_device when empty
+  std::optional<std::uint64_t> seed{};
+  // k-means|| only: sampling rounds, and the number of
+  // points expected to be sampled per round, as a multiple of k
+  size_type rounds{ 5 };
+  double oversampling{ 2.0 };
+  // Inputs read in chunks are seeded from a uniform sample of this
+  // many points, taken in the same pass that counts them
+  size_type sample_size{ 16384 };
+};
+
+// seeding_report: How the initial centroids were picked
+struct seeding_report
+{
+  seeding_method method{};
+  std::uint64_t seed{};
+  double seconds{};
+  // Sum of squared distances from the points to their nearest initial
+  // centroid, as measured by the first full pass; left 0 by mini-batch
+  // runs, whose steps only read samples of the points
+  double inertia{};
+};
+
+namespace hlpr {
+  // sample_indices: k distinct indices drawn uniformly from [0, n),
+  //                 with Floyd's algorithm in O(k) time and memory
+  auto sample_indices(size_type n, size_type k, auto& gen)
+  -> std::vector<size_type>
+  {
+    std::vector<size_type> indices;
+    indices.reserve(k);
+    std::unordered_set<size_type> drawn;
+    drawn.reserve(k);
+
+    for(auto j = n - k; j < n; ++j) //
+    {
+      auto const t = std::uniform_int_distribution<size_type>{ 0, j }(gen);
+      auto const pick = drawn.contains(t) ? j : t;
+      drawn.insert(pick);
+      indices.push_back(pick);
+    }
+    return indices;
+  }
+
+  // sample_indices: Same draws into indices, whose storage is reused.
+  //                 Drawn indices are searched linearly, in O(k²) time,
+  //                 which only suits small k.
+  void sample_indices(size_type n, size_type k, auto& gen,
+                      std::vector<size_type>& indices)
+  {
+    indices.clear();
+    for(auto j = n - k; j < n; ++j) //
+    {
+      auto const t = std::uniform_int_distribution<size_type>{ 0, j }(gen);
+      indices.push_back(std::ranges::find(indices, t) != indices.end() ? j
+                                                                       : t);
+    }
+  }
+
+  // draw_index: Index in [0, n) drawn with probability proportional to
+  //             its weight, or uniformly when there are no weights
+  auto draw_index(std::span<double const> weights, size_type n, auto& gen)
+  -> size_type
+  {
+    if(weights.empty())
+    { return std::uniform_int_distribution<size_type>{ 0, n - 1 }(gen); }
+
+    auto r = std::uniform_real_distribution<double>{
+      0.0, std::accumulate(weights.begin(), weights.end(), 0.0)
+    }(gen);
+    for(size_type i{}; i < n; ++i) //
+    {
+      if((r -= weights[i]) < 0.0) return i;
+    }
+    return n - 1;
+  }
+
+  // counter_uniform: Uniform draw in [0, 1) that is a pure function of
+  //                  (seed, stream, i), so that a point's draw does not
+  //                  depend on which thread makes it (splitmix64)
+  [[nodiscard]] constexpr //
+  auto counter_uniform(std::uint64_t seed,
+                       std::uint64_t stream,
+                       std::uint64_t i) noexcept -> double
+  {
+    auto z = seed + 0x9e3779b97f4a7c15ULL * (stream + 1) + i;
+    z = (z ^ (z >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27U)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31U;
+    return static_cast<double>(z >> 11U) * 0x1.0p-53;
+  }
+
+  template<std::floating_point V>
+  [[nodiscard]] constexpr //
+  auto sqr_distance(V const* a, V const* b, size_type dims) noexcept -> V
+  {
+    V sum{};
+    for(size_type d{}; d < dims; ++d) //
+    {
+      auto const diff = a[d] - b[d];
+      sum += diff * diff;
+    }
+    return sum;
+  }
+
+  // flat_rows: Row source over n rows of dims values stored row-major
+  template<std::floating_point V>
+  class flat_rows
+  {
+    V const* m_data;
+    size_type m_size;
+    size_type m_dims;
+
+  public:
+    flat_rows(V const* data, size_type n, size_type dims) noexcept
+    : m_data{ data }, m_size{ n }, m_dims{ dims }
+    { }
+
+    // clang-format off
+    [[nodiscard]] auto size() const noexcept { return m_size; }
+    [[nodiscard]] auto dims() const noexcept { return m_dims; }
+
+    void load(size_type i, V* coords) const noexcept
+    { std::copy_n(m_data + i * m_dims, m_dims, coords); }
+
+    void for_each(size_type first, size_type last, auto&& fn) const
+    { for(auto i = first; i < last; ++i) fn(i, m_data + i * m_dims); }
+    // clang-format on
+  };
+
+  // d2_weights: Squared distance of every point to its nearest centroid
+  //             so far, times its weight, with per-block sums
+  template<std::floating_point V>
+  struct d2_weights
+  {
+    std::vector<V> min_sqr_dist;
+    std::vector<double> block_sums;
+    // Per-point weights, all 1 when empty
+    std::vector<V> weights;
+
+    d2_weights() = default;
+
+    explicit d2_weights(size_type n, std::vector<V> point_weights = {})
+    : min_sqr_dist(n, std::numeric_limits<V>::max()),
+      block_sums((n + parallel_block_size - 1) / parallel_block_size),
+      weights{ std::move(point_weights) }
+    { }
+
+    // resize: Sizes the buffers for n unweighted points,
+    //         reusing their storage when it is large enough
+    void resize(size_type n)
+    {
+      min_sqr_dist.resize(n);
+      block_sums.resize((n + parallel_block_size - 1) / parallel_block_size);
+      weights.clear();
+    }
+
+    // set_weights: Weighs the points, all 1 for empty point_weights
+    void set_weights(std::span<double const> point_weights)
+    {
+      weights.resize(point_weights.size());
+      std::transform(point_weights.begin(), point_weights.end(),
+                     weights.begin(),
+                     [](double w) { return static_cast<V>(w); });
+    }
+
+    [[nodiscard]] auto weight(size_type i) const noexcept -> V
+    { return weights.empty() ? V{ 1 } : weights[i]; }
+
+    // sum_block: Recomputes the sum of the b-th block
+    void sum_block(size_type b)
+    {
+      auto const first = b * parallel_block_size;
+      auto const last =
+      std::min(min_sqr_dist.size(), first + parallel_block_size);
+      double sum{};
+      for(auto i = first; i < last; ++i) //
+      { sum += static_cast<double>(weight(i) * min_sqr_dist[i]); }
+      block_sums[b] = sum;
+    }
+
+    [[nodiscard]] auto total() const noexcept -> double
+    { return std::accumulate(block_sums.begin(), block_sums.end(), 0.0); }
+
+    // update: Lowers each point's distance with count new centroids
+    //         stored row-major, in one pass over the rows
+    void update(auto const& policy, auto const& rows,
+                V const* centroids, size_type count)
+    {
+      auto const dims = rows.dims();
+
+      // A single centroid would waste the lanes of the blocked kernel
+      std::optional<simd::centroid_block<V>> block;
+      if(count > 1) {
+        block.emplace(count, dims);
+        block->assign_rows(centroids);
+      }
+
+      for_each_block(
+      policy, min_sqr_dist.size(),
+      [&](size_type b, size_type first, size_type last)
+      {
+        std::vector<V> distances(block ? block->stride() : 0);
+        double block_sum{};
+
+        rows.for_each(first, last,
+                      [&](size_type i, V const* coords)
+                      {
+                        auto& min_d2 = min_sqr_dist[i];
+                        if(block) {
+                          block->sqr_distances(coords, distances.data());
+                          min_d2 = std::min(
+                          min_d2, *std::min_element(distances.data(),
+                                                    distances.data() + count));
+                        } else {
+                          min_d2 = std::min(
+                          min_d2, sqr_distance(coords, centroids, dims));
+                        }
+                        block_sum += static_cast<double>(weight(i) * min_d2);
+                      });
+        block_sums[b] = block_sum;
+      });
+    }
+
+    // draw: Index drawn with probability weight * min_sqr_dist / total;
+    //       uniformly if every point sits on a centroid
+    auto draw(auto& gen) const -> size_type
+    {
+      auto const n = min_sqr_dist.size();
+      auto const sum = total();
+      if(not(sum > 0.0))
+      { return std::uniform_int_distribution<size_type>{ 0, n - 1 }(gen); }
+
+      auto r = std::uniform_real_distribution<double>{ 0.0, sum }(gen);
+      for(size_type b{}; b < block_sums.size(); ++b) //
+      {
+        if(r >= block_sums[b] and b + 1 < block_sums.size()) {
+          r -= block_sums[b];
+          continue;
+        }
+        auto const first = b * parallel_block_size;
+        auto const last = std::min(n, first + parallel_block_size);
+        size_type pick{ first };
+        for(auto i = first; i < last; ++i) //
+        {
+          auto const w = static_cast<double>(weight(i) * min_sqr_dist[i]);
+          if(w <= 0.0) continue;
+          pick = i; // Last positive weight, in case of rounding
+          if((r -= w) < 0.0) break;
+        }
+        return pick;
+      }
+      return n - 1;
+    }
+  };
+
+  // seed_uniform: k distinct rows drawn uniformly
+  template<std::floating_point V>
+  auto seed_uniform(auto const& rows, size_type k, auto& gen)
+  -> std::vector<V>
+  {
+    auto const dims = rows.dims();
+    std::vector<V> centroids(k * dims);
+    for(size_type c{}; auto i: sample_indices(rows.size(), k, gen)) //
+    { rows.load(i, centroids.data() + c++ * dims); }
+    return centroids;
+  }
+
+  // seed_weighted_uniform: k distinct rows, each drawn with probability
+  //                        proportional to its weight among the rows not
+  //                        drawn yet. Writes k x dims row-major centroids;
+  //                        d2 must be sized and weighted for the rows.
+  template<std::floating_point V>
+  void seed_weighted_uniform(auto const& rows, size_type k, auto& gen,
+                             d2_weights<V>& d2, V* centroids)
+  {
+    d2.min_sqr_dist.assign(rows.size(), V{ 1 });
+    for(size_type b{}; b < d2.block_sums.size(); ++b) d2.sum_block(b);
+
+    for(size_type c{}; c < k; ++c) //
+    {
+      auto const pick = d2.draw(gen);
+      rows.load(pick, centroids + c * rows.dims());
+      d2.min_sqr_dist[pick] = V{};
+      d2.sum_block(pick / parallel_block_size);
+    }
+  }
+
+  // seed_k_means_plus_plus: The first centroid is drawn uniformly
+  //                         (by weight), each next one with probability
+  //                         proportional to its weighted squared distance
+  //                         to the nearest centroid drawn so far. Writes
+  //                         k x dims row-major centroids; d2 must be
+  //                         sized for the rows.
+  template<std::floating_point V>
+  void seed_k_means_plus_plus(auto const& policy, auto const& rows,
+                              size_type k, auto& gen, d2_weights<V>& d2,
+                              V* centroids)
+  {
+    auto const dims = rows.dims();
+
+    // Until the first centroid is picked, every draw weight is the same
+    d2.min_sqr_dist.assign(rows.size(), V{ 1 });
+    std::fill(d2.block_sums.begin(), d2.block_sums.end(), 0.0);
+    for(size_type i{}; i < rows.size(); ++i) //
+    {
+      d2.block_sums[i / parallel_block_size] +=
+      static_cast<double>(d2.weight(i));
+    }
+    rows.load(d2.draw(gen), centroids);
+    d2.min_sqr_dist.assign(rows.size(), std::numeric_limits<V>::max());
+
+    for(size_type c{ 1 }; c < k; ++c) //
+    {
+      d2.update(policy, rows, centroids + (c - 1) * dims, 1);
+      rows.load(d2.draw(gen), centroids + c * dims);
+    }
+  }
+
+  template<std::floating_point V>
+  auto seed_k_means_plus_plus(auto const& policy, auto const& rows,
+                              size_type k, auto& gen,
+                              std::vector<V> weights = {}) -> std::vector<V>
+  {
+    std::vector<V> centroids(k * rows.dims());
+    d2_weights<V> d2(rows.size(), std::move(weights));
+    seed_k_means_plus_plus(policy, rows, k, gen, d2, centroids.data());
+    return centroids;
+  }
+
+  // seed_k_means_parallel: k-means|| (Bahmani et al.). Starting from one
+  //                        uniform point, each round samples every point
+  //                        independently with probability
+  //                        oversampling * k * D²(x) / total D². The
+  //                        candidates, weighted by how many points are
+  //                        nearest to them, are reduced to k centroids
+  //                        with k-means++. Weighted points count as many
+  //                        times as their weight throughout.
+  template<std::floating_point V>
+  auto seed_k_means_parallel(auto const& policy, auto const& rows,
+                             size_type k, seeding_options const& options,
+                             std::uint64_t seed, auto& gen,
+                             std::span<double const> point_weights = {})
+  -> std::vector<V>
+  {
+    auto const n = rows.size();
+    auto const dims = rows.dims();
+    auto const expected_picks =
+    options.oversampling * static_cast<double>(k);
+
+    std::vector<V> candidates(dims);
+    rows.load(draw_index(point_weights, n, gen), candidates.data());
+
+    d2_weights<V> d2(n);
+    d2.set_weights(point_weights);
+    d2.update(policy, rows, candidates.data(), 1);
+
+    for(size_type round{}; round < options.rounds; ++round) //
+    {
+      auto const phi = d2.total();
+      if(not(phi > 0.0)) break;
+
+      // Picks are gathered per block, then appended in block order
+      std::vector<std::vector<size_type>> picks(d2.block_sums.size());
+      for_each_block(
+      policy, n,
+      [&](size_type b, size_type first, size_type last)
+      {
+        for(auto i = first; i < last; ++i) //
+        {
+          auto const p =
+          expected_picks
+          * static_cast<double>(d2.weight(i) * d2.min_sqr_dist[i]) / phi;
+          if(counter_uniform(seed, round, i) < p) picks[b].push_back(i);
+        }
+      });
+
+      auto const first_new = candidates.size() / dims;
+      for(auto const& block_picks: picks) //
+      {
+        for(auto i: block_picks) //
+        {
+          candidates.resize(candidates.size() + dims);
+          rows.load(i, candidates.data() + candidates.size() - dims);
+        }
+      }
+      auto const n_new = candidates.size() / dims - first_new;
+      if(n_new != 0)
+      { d2.update(policy, rows, candidates.data() + first_new * dims, n_new); }
+    }
+
+    auto const n_candidates = candidates.size() / dims;
+    if(n_candidates <= k) //
+    { // Too few candidates: complete them with uniform (by weight) draws
+      // among the points on no seed yet, so that seeds only repeat when
+      // fewer than k points are distinct
+      for(auto& min_d2: d2.min_sqr_dist) //
+      { min_d2 = min_d2 > V{} ? V{ 1 } : V{}; }
+
+      candidates.resize(k * dims);
+      for(auto c = n_candidates; c < k; ++c) //
+      {
+        for(size_type b{}; b < d2.block_sums.size(); ++b) d2.sum_block(b);
+        auto* const next = candidates.data() + c * dims;
+        rows.load(d2.draw(gen), next);
+        rows.for_each(0, n,
+                      [&](size_type i, V const* coords)
+                      {
+                        if(sqr_distance(coords, next, dims) == V{})
+                        { d2.min_sqr_dist[i] = V{}; }
+                      });
+      }
+      return candidates;
+    }
+
+    // Weigh each candidate by the weight of the points nearest to it
+    simd::centroid_block<V> block(n_candidates, dims);
+    block.assign_rows(candidates.data());
+
+    std::vector<V> weights(n_candidates);
+    ordered_block_reduce(
+    policy, n,
+    [&] { return std::vector<double>(n_candidates); },
+    [&](auto& masses, size_type first, size_type last)
+    {
+      std::fill(masses.begin(), masses.end(), 0.0);
+      std::vector<V> distances(block.stride());
+      rows.for_each(first, last,
+                    [&](size_type i, V const* coords)
+                    {
+                      masses[block.nearest(coords, distances.data())] +=
+                      static_cast<double>(d2.weight(i));
+                    });
+      return 0;
+    },
+    [&](auto const& masses, int)
+    {
+      for(size_type c{}; c < n_candidates; ++c) //
+      { weights[c] += static_cast<V>(masses[c]); }
+    });
+
+    return seed_k_means_plus_plus<V>(
+    seq, flat_rows<V>(candidates.data(), n_candidates, dims), k, gen,
+    std::move(weights));
+  }
+} // namespace hlpr
+
+// seed_centroids: Picks k initial centroids, stored row-major,
+//                 from a row source, and reports how. Given weights,
+//                 one per row, scale the odds of each row being drawn.
+template<std::floating_point V>
+auto seed_centroids(auto const& policy, auto const& rows, size_type k,
+                    seeding_options const& options,
+                    std::span<double const> weights = {})
+-> std::pair<std::vector<V>, seeding_report>
+{
+  using clock = std::chrono::steady_clock;
+  hlpr::phase_scope const scope{ phase::seeding };
+  auto const start = clock::now();
+
+  auto const seed = options.seed.value_or(
+  (std::uint64_t{ std::random_device{}() } << 32U) | std::random_device{}());
+  std::mt19937_64 gen{ seed };
+
+  auto centroids = [&]
+  {
+    switch(options.method) {
+      case seeding_method::uniform:
+        if(weights.empty()) return hlpr::seed_uniform<V>(rows, k, gen);
+        break;
+      case seeding_method::k_means_parallel:
+        return hlpr::seed_k_means_parallel<V>(policy, rows, k, options,
+                                              seed, gen, weights);
+      // Given centroids don't go through the engines, whose callers
+      // reject the method
+      case seeding_method::given:
+      case seeding_method::k_means_plus_plus: break;
+    }
+
+    hlpr::d2_weights<V> d2(rows.size());
+    d2.set_weights(weights);
+    std::vector<V> seeds(k * rows.dims());
+    if(options.method == seeding_method::uniform) {
+      hlpr::seed_weighted_uniform(rows, k, gen, d2, seeds.data());
+    } else {
+      hlpr::seed_k_means_plus_plus(policy, rows, k, gen, d2, seeds.data());
+    }
+    return seeds;
+  }();
+
+  std::chrono::duration<double> const elapsed = clock::now() - start;
+  return { std::move(centroids),
+           seeding_report{ .method = options.method,
+                           .seed = seed,
+                           .seconds = elapsed.count() } };
+}
+
+} // namespace kmn
+
+#endif
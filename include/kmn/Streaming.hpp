@@ -0,0 +1,280 @@
+#ifndef KMN_STREAMING_HPP
+#define KMN_STREAMING_HPP
+
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <kmn/K_means.hpp>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+// Out-of-core k_means: the points are replayed chunk by chunk on every
+// pass and never held in memory at once, so memory use depends on the
+// chunk size and k, not on the number of points.
+
+namespace kmn {
+
+// chunk_producer: Input of k_means_stream, a producer of dims-dimensional
+//                 points called once per pass as produce(consume). It
+//                 must call consume(chunk) for every chunk of points, in
+//                 the same order on every pass, chunk being either a
+//                 matrix_source (e.g. matrix_view) of dims columns or a
+//                 std::span<T const> of row-major values
+template<arithmetic T, typename F>
+class chunk_producer
+{
+  size_type m_dims;
+  F m_produce;
+
+public:
+  using value_type = T;
+
+  chunk_producer(size_type dims, F produce)
+  : m_dims{ dims }, m_produce{ std::move(produce) }
+  { }
+
+  // clang-format off
+  [[nodiscard]] auto dims() const noexcept { return m_dims; }
+
+  // clang-format on
+  // for_each_chunk: Replays the points as matrix sources
+  void for_each_chunk(auto&& fn) const
+  {
+    m_produce(
+    [&](auto const& chunk)
+    {
+      if constexpr(hlpr::matrix_source<std::remove_cvref_t<decltype(chunk)>>)
+      {
+        fn(chunk);
+      } else {
+        std::span<T const> const values{ chunk };
+        fn(matrix_view<T>(values.data(), values.size() / m_dims, m_dims));
+      }
+    });
+  }
+};
+
+// make_chunk_producer: chunk_producer of T values from a produce callable
+template<arithmetic T, typename F>
+[[nodiscard]] auto make_chunk_producer(size_type dims, F produce)
+-> chunk_producer<T, F>
+{ return { dims, std::move(produce) }; }
+
+namespace hlpr {
+  template<typename S>
+  concept chunk_source = requires(S const& source) {
+    typename S::value_type;
+    { source.dims() } -> std::convertible_to<size_type>;
+  };
+
+  // reservoir_sample: Counts the points of a chunk source and keeps a
+  //                   uniform sample of up to size of them, converted
+  //                   to V and stored row-major (algorithm R)
+  template<std::floating_point V>
+  auto reservoir_sample(chunk_source auto const& source,
+                        size_type size,
+                        std::uint64_t seed)
+  -> std::pair<std::vector<V>, size_type>
+  {
+    auto const dims = static_cast<size_type>(source.dims());
+    std::vector<V> sample;
+    sample.reserve(size * dims);
+    std::mt19937_64 gen{ seed };
+    size_type seen{};
+
+    source.for_each_chunk(
+    [&](auto const& chunk)
+    {
+      for(size_type r{}; r < chunk.rows(); ++r, ++seen) //
+      {
+        if(seen < size) {
+          sample.resize(sample.size() + dims);
+          chunk.load(r, 1, sample.data() + seen * dims);
+        } else if(auto const j =
+                  std::uniform_int_distribution<size_type>{ 0, seen }(gen);
+                  j < size)
+        { chunk.load(r, 1, sample.data() + j * dims); }
+      }
+    });
+
+    return { std::move(sample), seen };
+  }
+} // namespace hlpr
+
+// stream_k_means_result: What k_means_stream found; the assignments
+//                        themselves went to the sink
+template<std::floating_point V>
+struct stream_k_means_result
+{
+  std::vector<std::vector<V>> centroids;
+  std::vector<size_type> cluster_sizes;
+  size_type points{};
+  // Sum of squared distances of the points to their final centroid
+  double inertia{};
+  std::vector<double> cluster_sse;
+  // One sample per Lloyd iteration
+  std::vector<iteration_sample> trace;
+  convergence_report convergence;
+  seeding_report seeding;
+  // Empty unless kmn was compiled with KMN_INSTRUMENTATION
+  run_profile profile;
+};
+
+template<typename S>
+using stream_centroid_value_t =
+typename hlpr::select_centroid_t<typename S::value_type, 1>::value_type;
+
+template<typename S>
+using stream_k_means_t = stream_k_means_result<stream_centroid_value_t<S>>;
+
+// stream_k_means_impl: Seeds from a sample of the source, then runs Lloyd
+//                      passes chunk by chunk and a final assignment pass
+//                      whose ids are handed to sink(first_row, ids)
+template<hlpr::chunk_source S>
+auto stream_k_means_impl(auto const& policy,
+                         S const& source,
+                         size_type k,
+                         k_means_options const& options,
+                         auto&& sink) -> std::optional<stream_k_means_t<S>>
+{
+  using value_t = stream_centroid_value_t<S>;
+  using clock = std::chrono::steady_clock;
+  auto const dims = static_cast<size_type>(source.dims());
+  hlpr::profiler prof;
+  hlpr::profile_scope const profiling{ &prof };
+
+  // Seed from a uniform sample, drawn in the pass that counts the points
+  auto const start = clock::now();
+  auto seeding_opts = options.seeding;
+  seeding_opts.seed = options.seeding.seed.value_or(
+  (std::uint64_t{ std::random_device{}() } << 32U) | std::random_device{}());
+
+  auto const [sample, n_points] = hlpr::in_phase(
+  phase::seeding,
+  [&]
+  {
+    return hlpr::reservoir_sample<value_t>(
+    source, std::max(options.seeding.sample_size, k), *seeding_opts.seed);
+  });
+  if(n_points < k) return std::nullopt;
+
+  auto [centroids, seeding] = seed_centroids<value_t>(
+  policy, hlpr::flat_rows<value_t>(sample.data(), sample.size() / dims, dims),
+  k, seeding_opts);
+  seeding.seconds =
+  std::chrono::duration<double>(clock::now() - start).count();
+
+  flat_accumulator<value_t> acc(k, dims);
+  flat_accumulator<value_t> chunk_acc(k, dims);
+  std::vector<size_type> ids;
+  std::vector<iteration_sample> trace;
+
+  size_type distances{};
+  auto convergence = hlpr::with_centroid_finder<value_t>(
+  options.search, k, dims,
+  [&](auto& finder)
+  {
+    // One fused pass over every chunk, then on_chunk(first_row, ids)
+    auto const pass = [&](auto&& on_chunk)
+    {
+      finder.assign_rows(centroids.data());
+      acc.reset();
+      size_type first_row{};
+      source.for_each_chunk(
+      [&](auto const& chunk)
+      {
+        auto const rows = static_cast<size_type>(chunk.rows());
+        ids.resize(rows);
+        assign_and_accumulate_rows(policy, chunk, ids, finder, chunk_acc);
+        acc.merge(chunk_acc);
+        on_chunk(first_row, std::span<size_type const>{ ids });
+        first_row += rows;
+      });
+      distances += acc.distances;
+    };
+
+    // Telling reassigned points apart would take every point's id, so
+    // passes count them all as moved and stop on the tolerance instead
+    auto report = iterate_until_converged(
+    options.convergence,
+    [&]
+    {
+      pass([](size_type, std::span<size_type const>) { });
+      return n_points;
+    },
+    [&]
+    { return move_flat_centroids(centroids, acc, options.empty_clusters); },
+    [&](size_type iteration)
+    { // The first pass measures the seeds
+      if(iteration == 1) seeding.inertia = acc.inertia;
+    },
+    trace_iterations(trace, acc, options));
+
+    hlpr::in_phase(phase::assignment, [&] { pass(sink); });
+    return report;
+  });
+  convergence.distances = distances;
+
+  std::vector<std::vector<value_t>> centroid_rows;
+  centroid_rows.reserve(k);
+  for(size_type c{}; c < k; ++c) //
+  {
+    auto const first =
+    centroids.begin() + static_cast<std::ptrdiff_t>(c * dims);
+    centroid_rows.emplace_back(first,
+                               first + static_cast<std::ptrdiff_t>(dims));
+  }
+
+  return stream_k_means_t<S>{ .centroids = std::move(centroid_rows),
+                              .cluster_sizes = std::move(acc.counts),
+                              .points = n_points,
+                              .inertia = acc.inertia,
+                              .cluster_sse = std::move(acc.sse),
+                              .trace = std::move(trace),
+                              .convergence = convergence,
+                              .seeding = seeding,
+                              .profile = prof.take() };
+}
+
+// clang-format off
+struct k_means_stream_fn
+{
+  // sink(first_row, ids) receives the 1-based centroid ids of
+  // every chunk's points on the final pass, in chunk order.
+  // Only Lloyd passes are run; options.algorithm,
+  // options.mini_batch and options.weights are ignored.
+  template<hlpr::chunk_source S>
+  [[nodiscard]]
+  auto operator()(S const& source,
+                  size_type k,
+                  hlpr::k_means_config auto const& config,
+                  auto&& sink) const
+  -> std::optional<stream_k_means_t<S>>
+  { return (*this)(seq, source, k, config, FWD(sink)); }
+
+  template<hlpr::chunk_source S>
+  [[nodiscard]]
+  auto operator()(hlpr::execution_policy auto policy,
+                  S const& source,
+                  size_type k,
+                  hlpr::k_means_config auto const& config,
+                  auto&& sink) const
+  -> std::optional<stream_k_means_t<S>>
+  {
+    auto const options = hlpr::to_options(config);
+    if(k < 2 or source.dims() == 0 or not hlpr::valid_seeding(options))
+    { return std::nullopt; }
+
+    return stream_k_means_impl(policy, source, k, options, FWD(sink));
+  }
+};
+
+// clang-format on
+// k_means_stream: Callable object running k_means over a chunk source
+constexpr inline k_means_stream_fn k_means_stream{};
+
+} // namespace kmn
+
+#endif
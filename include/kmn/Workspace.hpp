@@ -0,0 +1,373 @@
+#ifndef KMN_WORKSPACE_HPP
+#define KMN_WORKSPACE_HPP
+
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <kmn/K_means.hpp>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+// Reusable scratch buffers for repeated sequential k_means calls. Once a
+// workspace has served a call, calls over as many or fewer points, dims
+// and centroids reuse its buffers and, with Lloyd passes and uniform or
+// k-means++ seeding, make no heap allocation, unless they run more
+// iterations than its trace has held so far. k-means|| seeding, hamerly
+// and elkan passes and mini-batch steps still allocate their own state,
+// as does weighted seeding the first time it copies the weights.
+// Instrumented builds allocate the profile of every run too.
+
+namespace kmn {
+
+namespace hlpr {
+  // buffered_rows: Row source over a matrix source whose for_each loads
+  //                tiles into a caller-owned buffer of tile_rows rows;
+  //                it must not be shared between threads
+  template<std::floating_point V, matrix_source M>
+  class buffered_rows
+  {
+    M const* m_points;
+    V* m_tile;
+
+  public:
+    buffered_rows(M const& points, V* tile) noexcept
+    : m_points{ &points }, m_tile{ tile }
+    { }
+
+    // clang-format off
+    [[nodiscard]] auto size() const noexcept
+    { return static_cast<size_type>(m_points->rows()); }
+    [[nodiscard]] auto dims() const noexcept
+    { return static_cast<size_type>(m_points->cols()); }
+    [[nodiscard]] auto source() const noexcept -> M const&
+    { return *m_points; }
+    [[nodiscard]] auto tile() const noexcept { return m_tile; }
+
+    void load(size_type i, V* coords) const
+    { m_points->load(i, 1, coords); }
+
+    // clang-format on
+    void for_each(size_type first, size_type last, auto&& fn) const
+    {
+      for(auto row = first; row < last; row += tile_rows) //
+      {
+        auto const count = std::min(tile_rows, last - row);
+        m_points->load(row, count, m_tile);
+        for(size_type r{}; r < count; ++r) //
+        { fn(row + r, m_tile + r * dims()); }
+      }
+    }
+  };
+} // namespace hlpr
+
+// workspace_result: What a workspace run found. The spans point into the
+//                   workspace and are valid until its next run.
+template<std::floating_point V>
+struct workspace_result
+{
+  // k x dims row-major
+  std::span<V const> centroids;
+  size_type dims{};
+  std::span<size_type const> cluster_sizes;
+  std::span<double const> cluster_sse;
+  // One sample per Lloyd iteration
+  std::span<iteration_sample const> trace;
+  convergence_report convergence;
+  seeding_report seeding;
+  // Set when options.mini_batch was
+  mini_batch_report const* mini_batch{};
+  // Empty unless kmn was compiled with KMN_INSTRUMENTATION
+  run_profile const* profile{};
+
+  // clang-format off
+  [[nodiscard]] auto centroid(size_type c) const noexcept -> std::span<V const>
+  { return centroids.subspan(c * dims, dims); }
+  // clang-format on
+};
+
+// workspace: Owns the buffers of sequential k_means runs over points whose
+//            centroids have V coordinates, i.e. V is float or double for
+//            floating points of that type and double for integral ones
+template<std::floating_point V>
+class workspace
+{
+  std::vector<V> m_centroids;
+  std::vector<V> m_tile;
+  std::vector<V> m_distances;
+  std::vector<V> m_partial;
+  std::vector<size_type> m_sample;
+  hlpr::d2_weights<V> m_d2;
+  simd::centroid_block<V> m_block{ 0, 0 };
+  centroid_index<V> m_index{ 0, 0 };
+  flat_accumulator<V> m_acc{ 0, 0 };
+  mini_batch_report m_mini_batch;
+  std::vector<iteration_sample> m_trace;
+  run_profile m_profile;
+
+  // seed: Fills m_centroids from the rows, weighted if weights
+  //       are given, and reports how
+  auto seed(auto const& rows, size_type k, seeding_options const& options,
+            std::span<double const> weights) -> seeding_report
+  {
+    using clock = std::chrono::steady_clock;
+    hlpr::phase_scope const scope{ phase::seeding };
+    auto const start = clock::now();
+    auto const dims = rows.dims();
+
+    auto const seed = options.seed.value_or(
+    (std::uint64_t{ std::random_device{}() } << 32U) | std::random_device{}());
+    std::mt19937_64 gen{ seed };
+
+    switch(options.method) {
+      case seeding_method::uniform:
+        if(not weights.empty()) {
+          m_d2.resize(rows.size());
+          m_d2.set_weights(weights);
+          hlpr::seed_weighted_uniform(rows, k, gen, m_d2, m_centroids.data());
+          break;
+        }
+        hlpr::sample_indices(rows.size(), k, gen, m_sample);
+        for(size_type c{}; c < k; ++c) //
+        { rows.load(m_sample[c], m_centroids.data() + c * dims); }
+        break;
+      case seeding_method::given: // Rejected by run
+      case seeding_method::k_means_plus_plus:
+        m_d2.resize(rows.size());
+        m_d2.set_weights(weights);
+        hlpr::seed_k_means_plus_plus(seq, rows, k, gen, m_d2,
+                                     m_centroids.data());
+        break;
+      case seeding_method::k_means_parallel:
+        stdr::copy(hlpr::seed_k_means_parallel<V>(seq, rows, k, options,
+                                                  seed, gen, weights),
+                   m_centroids.begin());
+        break;
+    }
+
+    std::chrono::duration<double> const elapsed = clock::now() - start;
+    return { .method = options.method,
+             .seed = seed,
+             .seconds = elapsed.count() };
+  }
+
+  // assign_and_accumulate: Fused pass over every row, with one blocked
+  //                        kernel call per row, or per leaf an index
+  //                        search visits
+  auto assign_and_accumulate(auto const& finder, auto const& rows, auto out)
+  -> size_type
+  {
+    using index_t = std::iter_value_t<decltype(out)>;
+
+    m_acc.reset();
+    size_type reassigned{};
+
+    rows.for_each(0, rows.size(),
+                  [&](size_type i, V const* coords)
+                  {
+                    auto const idx = hlpr::find_nearest(
+                    finder, coords, m_distances.data(), m_acc.distances);
+
+                    if(auto const id = static_cast<index_t>(idx + 1);
+                       *out != id) {
+                      *out = id;
+                      ++reassigned;
+                    }
+                    ++out;
+
+                    m_acc.add(idx, i, coords,
+                              static_cast<double>(m_distances[idx]));
+                  });
+    hlpr::count_pass<V>(rows.size(), finder.size(), rows.dims(),
+                        m_acc.distances);
+    return reassigned;
+  }
+
+  // assign_and_accumulate: Over a matrix source, the tiled pass of
+  //                        k_means, in the workspace's buffers
+  template<typename M>
+  auto assign_and_accumulate(simd::centroid_block<V> const& block,
+                             hlpr::buffered_rows<V, M> const& rows,
+                             auto out) -> size_type
+  {
+    auto const reassigned = assign_and_accumulate_rows(
+    rows.source(), 0, rows.size(), out, block, m_acc, rows.tile(),
+    m_distances.data(), m_partial.data());
+    hlpr::count_pass<V>(rows.size(), block.size(), rows.dims(),
+                        m_acc.distances);
+    return reassigned;
+  }
+
+  auto run_impl(auto const& rows,
+                auto&& out_indices,
+                size_type k,
+                k_means_options const& options) -> workspace_result<V>
+  {
+    // Restarts run through workspaces report to the run they are part of
+    hlpr::profiler prof;
+    hlpr::profile_scope const profiling{ hlpr::outer_profiler(&prof) };
+    auto const dims = rows.dims();
+    m_centroids.resize(k * dims);
+    m_acc.reshape(k, dims);
+    m_acc.weights = options.weights;
+
+    // An index's stride depends on k alone, not on the centroids
+    auto const tree = hlpr::search_tree(options.search, k, dims);
+    auto const indexed = tree.has_value();
+    if(indexed) {
+      m_index.reshape(k, dims, *tree);
+      m_distances.resize(m_index.stride());
+    } else {
+      // Tiled passes over matrix sources keep a tile of distances
+      m_block.reshape(k, dims);
+      m_distances.resize(hlpr::tile_rows * m_block.stride());
+      m_partial.resize(m_block.stride());
+    }
+    auto const with_finder = [&](auto&& fn)
+    { return indexed ? fn(m_index) : fn(m_block); };
+
+    auto seeding = seed(rows, k, options.seeding, options.weights);
+    auto const measure_seeds = [&](size_type iteration)
+    { // The first pass measures the seeds
+      if(iteration == 1) seeding.inertia = m_acc.inertia;
+    };
+
+    convergence_report convergence;
+    auto const* mini_batch = &m_mini_batch;
+    m_trace.clear();
+
+    if(options.mini_batch) {
+      std::tie(convergence, m_mini_batch) = run_mini_batch(
+      seq, rows, m_centroids, k, options, seeding.seed,
+      [&]
+      {
+        return with_finder(
+        [&](auto& finder)
+        {
+          finder.assign_rows(m_centroids.data());
+          assign_and_accumulate(finder, rows, stdr::begin(out_indices));
+          return std::pair{ m_acc.inertia, m_acc.distances };
+        });
+      });
+    } else if(options.algorithm == assignment_algorithm::lloyd) {
+      mini_batch = nullptr;
+      size_type distances{};
+      convergence = with_finder(
+      [&](auto& finder)
+      {
+        return iterate_until_converged(
+        options.convergence,
+        [&]
+        {
+          finder.assign_rows(m_centroids.data());
+          auto const reassigned =
+          assign_and_accumulate(finder, rows, stdr::begin(out_indices));
+          distances += m_acc.distances;
+          return reassigned;
+        },
+        [&]
+        {
+          return move_flat_centroids(m_centroids, m_acc,
+                                     options.empty_clusters);
+        },
+        measure_seeds, trace_iterations(m_trace, m_acc, options));
+      });
+      convergence.distances = distances;
+    } else {
+      mini_batch = nullptr;
+      convergence = bounded_iterations(
+      seq, rows, out_indices, m_centroids, m_acc, options, dims,
+      measure_seeds, trace_iterations(m_trace, m_acc, options));
+    }
+
+    if(options.empty_clusters == empty_cluster_strategy::drop) {
+      drop_empty_clusters(out_indices, m_centroids, dims, m_acc.sse,
+                          m_acc.counts);
+    }
+    if constexpr(hlpr::instrumented) m_profile = prof.take();
+
+    return { .centroids = m_centroids,
+             .dims = dims,
+             .cluster_sizes = m_acc.counts,
+             .cluster_sse = m_acc.sse,
+             .trace = m_trace,
+             .convergence = convergence,
+             .seeding = seeding,
+             .mini_batch = mini_batch,
+             .profile = &m_profile };
+  }
+
+public:
+  workspace() = default;
+
+  // reserve: Sizes the buffers for runs over up to n points of dims
+  //          coordinates into k clusters, so that the first run
+  //          doesn't allocate either
+  void reserve(size_type n, size_type dims, size_type k)
+  {
+    m_centroids.reserve(k * dims);
+    m_tile.reserve(hlpr::tile_rows * dims);
+    m_sample.reserve(k);
+    m_d2.min_sqr_dist.reserve(n);
+    m_d2.block_sums.reserve(
+    (n + hlpr::parallel_block_size - 1) / hlpr::parallel_block_size);
+    m_block.reshape(k, dims);
+    m_index.reshape(k, dims);
+    m_distances.reserve(
+    std::max(hlpr::tile_rows * m_block.stride(), m_index.stride()));
+    m_partial.reserve(m_block.stride());
+    m_acc.reshape(k, dims);
+  }
+
+  // clang-format off
+  // run: k_means over a range of DataPoints, run sequentially
+  template<hlpr::data_points_range PTS_R, hlpr::unsigned_range IDX_R>
+  [[nodiscard]]
+  auto run(PTS_R const& data_points,
+           IDX_R&& out_indices,
+           size_type k,
+           hlpr::k_means_config auto const& config)
+  -> std::optional<workspace_result<V>>
+  {
+    auto const n = stdr::distance(data_points);
+    auto const options = hlpr::to_options(config);
+    if(k < 2 or not std::in_range<size_type>(n)
+       or static_cast<size_type>(n) < k
+       or static_cast<size_type>(n) != stdr::size(out_indices)
+       or not hlpr::valid_weights(options, static_cast<size_type>(n))
+       or not hlpr::valid_seeding(options))
+    { return std::nullopt; }
+
+    hlpr::data_point_rows<V, PTS_R> const rows(data_points,
+                                               static_cast<size_type>(n));
+    return run_impl(rows, out_indices, k, options);
+  }
+
+  // run: k_means over a matrix_view or columns_view, run sequentially
+  template<hlpr::matrix_source M, hlpr::unsigned_range IDX_R>
+    requires stdr::random_access_range<IDX_R>
+  [[nodiscard]]
+  auto run(M const& points,
+           IDX_R&& out_indices,
+           size_type k,
+           hlpr::k_means_config auto const& config)
+  -> std::optional<workspace_result<V>>
+  {
+    auto const options = hlpr::to_options(config);
+    if(k < 2 or points.cols() == 0 or points.rows() < k
+       or points.rows() != stdr::size(out_indices)
+       or not hlpr::valid_weights(options, points.rows())
+       or not hlpr::valid_seeding(options))
+    { return std::nullopt; }
+
+    m_tile.resize(hlpr::tile_rows * static_cast<size_type>(points.cols()));
+    hlpr::buffered_rows<V, M> const rows(points, m_tile.data());
+    return run_impl(rows, out_indices, k, options);
+  }
+  // clang-format on
+};
+
+} // namespace kmn
+
+#endif
@@ -0,0 +1,664 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/core.h>
+#include <fmt/os.h>
+#include <kmn/Batch.hpp>
+#include <kmn/Compact_storage.hpp>
+#include <kmn/K_means.hpp>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// kmn_bench: Times seeding, assignment passes, centroid updates and whole
+//            k_means runs over synthetic Gaussian blobs, and prints the
+//            timings as JSON so that runs of two versions can be diffed.
+//            The distance kernels unrolled for a dimension are also timed
+//            against the one reading it at runtime, float points
+//            stored as float16, bfloat16 and int8 against float, and
+//            centroid searches through k-d and ball trees against brute
+//            force, from small k to thousands of centroids, and
+//            k_means_batch against a loop of k_means calls over many
+//            small problems, also from 1 thread up to all hardware
+//            threads.
+//
+//   kmn_bench [--quick] [--repetitions 5] [--threads 0] [--output f.json]
+//             [--trace trace.json]
+//
+// Without --threads the passes run sequentially, --threads 0 uses every
+// hardware thread. Built with KMN_INSTRUMENTATION, --trace also writes the
+// Chrome trace of one float k_means run, viewable in chrome://tracing or
+// Perfetto, and prints its phase summary.
+
+namespace {
+
+using kmn::size_type;
+
+// Seed of every generated dataset and of the seeding
+constexpr std::uint64_t bench_seed = 42;
+// Iteration cap of the timed k_means runs
+constexpr size_type bench_iterations = 10;
+
+struct bench_options
+{
+  bool quick{ false };
+  size_type repetitions{ 5 };
+  std::optional<size_type> threads{};
+  std::optional<std::string> output{};
+  std::optional<std::string> trace{};
+};
+
+struct bench_case
+{
+  size_type n;
+  size_type dims;
+  size_type k;
+};
+
+// timing: Wall time of the repetitions of a phase, in seconds
+struct timing
+{
+  double min{};
+  double median{};
+  double mean{};
+};
+
+// storage_accuracy: How far a run over compactly stored points
+//                   lands from the same run over the float points
+struct storage_accuracy
+{
+  size_type bytes_per_point{};
+  // Inertia over the float points of the run's centroids,
+  // over that of the float run's
+  double inertia_ratio{};
+  // Share of float points nearest to the same centroid
+  // as with the float run's centroids
+  double agreement{};
+};
+
+[[nodiscard]] auto summarize(std::vector<double> seconds) -> timing
+{
+  std::ranges::sort(seconds);
+  auto const n = seconds.size();
+  auto const median = n % 2 == 1
+                      ? seconds[n / 2]
+                      : (seconds[n / 2 - 1] + seconds[n / 2]) / 2;
+  return { .min = seconds.front(),
+           .median = median,
+           .mean = std::accumulate(seconds.begin(), seconds.end(), 0.0)
+                   / static_cast<double>(n) };
+}
+
+// make_blobs: n x dims row-major points around k centers drawn uniformly in
+//             [-100, 100)^dims, with a standard deviation of 5. Draws are
+//             counter-based, so a dataset only depends on its parameters.
+template<typename T>
+[[nodiscard]] auto make_blobs(bench_case const& bc) -> std::vector<T>
+{
+  using kmn::hlpr::counter_uniform;
+
+  std::vector<double> centers(bc.k * bc.dims);
+  for(size_type i{}; i < centers.size(); ++i) //
+  { centers[i] = 200.0 * counter_uniform(bench_seed, 0, i) - 100.0; }
+
+  constexpr auto two_pi = 6.283185307179586;
+  std::vector<T> points(bc.n * bc.dims);
+  for(size_type i{}; i < points.size(); ++i) //
+  {
+    // Box-Muller, 1 - u keeps the logarithm finite
+    auto const u1 = 1.0 - counter_uniform(bench_seed, 1, i);
+    auto const u2 = counter_uniform(bench_seed, 2, i);
+    auto const noise = 5.0 * std::sqrt(-2.0 * std::log(u1))
+                       * std::cos(two_pi * u2);
+    auto const center = centers[(i / bc.dims) % bc.k * bc.dims + i % bc.dims];
+    if constexpr(std::integral<T>) {
+      points[i] = static_cast<T>(std::lround(center + noise));
+    } else {
+      points[i] = static_cast<T>(center + noise);
+    }
+  }
+  return points;
+}
+
+// time_repetitions: Times fn() repetitions times, after calling
+//                   prepare() untimed before each of them
+[[nodiscard]] auto time_repetitions(size_type repetitions,
+                                    auto&& prepare,
+                                    auto&& fn) -> timing
+{
+  using clock = std::chrono::steady_clock;
+  std::vector<double> seconds;
+  for(size_type r{}; r < repetitions; ++r) //
+  {
+    prepare();
+    auto const start = clock::now();
+    fn();
+    seconds.push_back(
+    std::chrono::duration<double>(clock::now() - start).count());
+  }
+  return summarize(std::move(seconds));
+}
+
+class json_writer
+{
+  std::string m_json;
+  bool m_first{ true };
+
+public:
+  json_writer(bench_options const& options, std::string_view policy)
+  {
+    m_json = fmt::format(
+    "{{\n  \"context\": {{\n"
+    "    \"isa\": \"{}\",\n    \"policy\": \"{}\",\n"
+    "    \"repetitions\": {},\n    \"seed\": {},\n"
+    "    \"k_means_max_iterations\": {}\n  }},\n  \"benchmarks\": [",
+    kmn::simd::to_string(kmn::simd::active_isa()), policy,
+    options.repetitions, bench_seed, bench_iterations);
+  }
+
+  void add(std::string_view phase, std::string_view type,
+           bench_case const& bc, timing const& t,
+           std::optional<size_type> iterations = std::nullopt,
+           std::optional<storage_accuracy> accuracy = std::nullopt)
+  {
+    m_json += fmt::format(
+    "{}\n    {{ \"name\": \"{}/{}/n={}/d={}/k={}\", \"phase\": \"{}\", "
+    "\"type\": \"{}\", \"n\": {}, \"dims\": {}, \"k\": {}, "
+    "\"min_seconds\": {:.9f}, \"median_seconds\": {:.9f}, "
+    "\"mean_seconds\": {:.9f}",
+    m_first ? "" : ",", phase, type, bc.n, bc.dims, bc.k, phase, type,
+    bc.n, bc.dims, bc.k, t.min, t.median, t.mean);
+    if(iterations) m_json += fmt::format(", \"iterations\": {}", *iterations);
+    if(accuracy) {
+      m_json += fmt::format(
+      ", \"bytes_per_point\": {}, \"inertia_ratio\": {:.9f}, "
+      "\"agreement\": {:.9f}",
+      accuracy->bytes_per_point, accuracy->inertia_ratio,
+      accuracy->agreement);
+    }
+    m_json += " }";
+    m_first = false;
+  }
+
+  [[nodiscard]] auto finish() -> std::string
+  { return std::move(m_json) + "\n  ]\n}\n"; }
+};
+
+// Options of the timed k_means runs
+[[nodiscard]] auto run_options() -> kmn::k_means_options
+{
+  return { .convergence = { .max_iterations = bench_iterations,
+                            .tolerance = 0.0 },
+           .seeding = { .seed = bench_seed } };
+}
+
+template<typename T>
+void bench_type(auto const& policy,
+                std::string_view type,
+                bench_case const& bc,
+                bench_options const& options,
+                json_writer& json)
+{
+  using value_t = kmn::matrix_centroid_value_t<kmn::matrix_view<T>>;
+
+  auto const data = make_blobs<T>(bc);
+  kmn::matrix_view<T> const points{ data.data(), bc.n, bc.dims };
+  kmn::hlpr::matrix_rows<value_t, kmn::matrix_view<T>> const rows{ points };
+  std::vector<size_type> out_indices(bc.n);
+
+  kmn::seeding_options const seeding{ .seed = bench_seed };
+
+  // Seeding: k-means++ over all the points
+  std::vector<value_t> seeds;
+  json.add("seeding", type, bc,
+           time_repetitions(
+           options.repetitions, [] { },
+           [&]
+           {
+             seeds = kmn::seed_centroids<value_t>(policy, rows, bc.k, seeding)
+                     .first;
+           }));
+
+  // Assignment: one fused assign and accumulate pass
+  kmn::simd::centroid_block<value_t> block(bc.k, bc.dims);
+  kmn::flat_accumulator<value_t> acc(bc.k, bc.dims);
+  block.assign_rows(seeds.data());
+  json.add("assignment", type, bc,
+           time_repetitions(
+           options.repetitions, [] { },
+           [&]
+           {
+             (void)kmn::assign_and_accumulate_rows(policy, points,
+                                                   out_indices, block, acc);
+           }));
+
+  // Update: moving the seeds to the means of the pass above
+  std::vector<value_t> centroids;
+  json.add("update", type, bc,
+           time_repetitions(
+           options.repetitions, [&] { centroids = seeds; },
+           [&] { (void)kmn::move_flat_centroids(centroids, acc); }));
+
+  // Whole run, seeding included
+  size_type iterations{};
+  auto const run_timing = time_repetitions(
+  options.repetitions, [] { },
+  [&]
+  {
+    auto const result =
+    kmn::k_means(policy, points, out_indices, bc.k, run_options());
+    iterations = result ? result->convergence().iterations : 0;
+  });
+  json.add("k_means", type, bc, run_timing, iterations);
+}
+
+// float_fit: Nearest centroids of float points and their inertia
+struct float_fit
+{
+  std::vector<size_type> ids{};
+  double inertia{};
+};
+
+[[nodiscard]] auto fit_floats(auto const& policy,
+                              kmn::matrix_view<float> const& points,
+                              auto const& centroid_rows,
+                              size_type k) -> float_fit
+{
+  std::vector<float> centroids;
+  for(auto const& centroid: centroid_rows)
+  { centroids.insert(centroids.end(), centroid.begin(), centroid.end()); }
+
+  kmn::simd::centroid_block<float> block(k, points.cols());
+  kmn::flat_accumulator<float> acc(k, points.cols());
+  block.assign_rows(centroids.data());
+  float_fit fit{ .ids = std::vector<size_type>(points.rows()) };
+  (void)kmn::assign_and_accumulate_rows(policy, points, fit.ids, block, acc);
+  fit.inertia = acc.inertia;
+  return fit;
+}
+
+// bench_storage: Times an assignment pass and a k_means run, from the
+//                initial centroids, over float points stored as stored,
+//                and measures how far the run lands from the reference
+//                fit of the float run's centroids
+void bench_storage(auto const& policy,
+                   std::string_view type,
+                   bench_case const& bc,
+                   kmn::matrix_view<float> const& points,
+                   auto const& stored,
+                   std::vector<std::vector<float>> const& initial,
+                   float_fit const& reference,
+                   bench_options const& options,
+                   json_writer& json)
+{
+  using storage_t = std::remove_cvref_t<decltype(*stored.data())>;
+
+  std::vector<size_type> out_indices(bc.n);
+  std::vector<float> centroids;
+  for(auto const& centroid: initial)
+  { centroids.insert(centroids.end(), centroid.begin(), centroid.end()); }
+
+  kmn::simd::centroid_block<float> block(bc.k, bc.dims);
+  kmn::flat_accumulator<float> acc(bc.k, bc.dims);
+  block.assign_rows(centroids.data());
+  json.add("storage_assignment", type, bc,
+           time_repetitions(
+           options.repetitions, [] { },
+           [&]
+           {
+             (void)kmn::assign_and_accumulate_rows(policy, stored,
+                                                   out_indices, block, acc);
+           }));
+
+  std::vector<std::vector<float>> final_centroids;
+  size_type iterations{};
+  auto const run_timing = time_repetitions(
+  options.repetitions, [] { },
+  [&]
+  {
+    auto const result =
+    kmn::k_means(policy, stored, out_indices, initial, run_options());
+    if(not result) return;
+    iterations = result->convergence().iterations;
+    final_centroids = result->centroids();
+  });
+
+  auto const fit = fit_floats(policy, points, final_centroids, bc.k);
+  auto const same = static_cast<size_type>(std::ranges::count_if(
+  std::views::iota(size_type{ 0 }, bc.n),
+  [&](auto i) { return fit.ids[i] == reference.ids[i]; }));
+
+  json.add("storage_k_means", type, bc, run_timing, iterations,
+           storage_accuracy{
+           .bytes_per_point = bc.dims * sizeof(storage_t),
+           .inertia_ratio = fit.inertia / reference.inertia,
+           .agreement = static_cast<double>(same)
+                        / static_cast<double>(bc.n) });
+}
+
+// bench_storages: bench_storage over float points and their float16,
+//                 bfloat16 and int8 copies, all from the same seeds
+void bench_storages(auto const& policy,
+                    bench_case const& bc,
+                    bench_options const& options,
+                    json_writer& json)
+{
+  auto const data = make_blobs<float>(bc);
+  kmn::matrix_view<float> const points{ data.data(), bc.n, bc.dims };
+
+  auto const seeds =
+  kmn::seed_centroids<float>(policy, kmn::hlpr::rows_of<float>(points),
+                             bc.k, { .seed = bench_seed })
+  .first;
+  std::vector<std::vector<float>> initial;
+  for(size_type c{}; c < bc.k; ++c) //
+  {
+    auto const first = seeds.begin() + static_cast<std::ptrdiff_t>(c * bc.dims);
+    initial.emplace_back(first, first + static_cast<std::ptrdiff_t>(bc.dims));
+  }
+
+  std::vector<size_type> out_indices(bc.n);
+  auto const float_run =
+  kmn::k_means(policy, points, out_indices, initial, run_options());
+  if(not float_run) return;
+  auto const reference =
+  fit_floats(policy, points, float_run->centroids(), bc.k);
+
+  bench_storage(policy, "float", bc, points, points, initial, reference,
+                options, json);
+  auto const halves = kmn::make_compact<kmn::float16>(points);
+  bench_storage(policy, "float16", bc, points, halves.view(), initial,
+                reference, options, json);
+  auto const truncated = kmn::make_compact<kmn::bfloat16>(points);
+  bench_storage(policy, "bfloat16", bc, points, truncated.view(), initial,
+                reference, options, json);
+  auto const codes = kmn::make_quantized(points);
+  bench_storage(policy, "int8", bc, points, codes.view(), initial,
+                reference, options, json);
+}
+
+// time_kernel: Times one call of kernel per point, against
+//              the centroids of the block
+template<std::floating_point V>
+[[nodiscard]] auto time_kernel(kmn::simd::sqr_distances_fn<V> kernel,
+                               kmn::simd::centroid_block<V> const& block,
+                               std::vector<V> const& points,
+                               bench_options const& options) -> timing
+{
+  std::vector<V> distances(block.stride());
+  V checksum{};
+  auto const t = time_repetitions(
+  options.repetitions, [] { },
+  [&]
+  {
+    for(size_type i{}; i < points.size(); i += block.dims()) //
+    {
+      kernel(points.data() + i, block.data(), block.dims(), block.stride(),
+             distances.data());
+      checksum += distances.front();
+    }
+  });
+  // Keeps the calls from being optimized out
+  if(checksum < V{}) fmt::print(stderr, "{}\n", checksum);
+  return t;
+}
+
+// bench_kernels: Times, for every dimension with an unrolled kernel,
+//                that kernel and the one reading its dims argument
+template<std::floating_point V>
+void bench_kernels(std::string_view type,
+                   std::vector<size_type> const& ks,
+                   size_type n,
+                   bench_options const& options,
+                   json_writer& json)
+{
+  auto const set = kmn::simd::active_isa();
+  for(auto const d: kmn::simd::specialized_dims) {
+    for(auto const k: ks) //
+    {
+      bench_case const bc{ .n = n, .dims = d, .k = k };
+      auto const points = make_blobs<V>(bc);
+      kmn::simd::centroid_block<V> block(k, d, set);
+      block.assign_rows(points.data());
+
+      json.add("kernel_generic", type, bc,
+               time_kernel(kmn::simd::sqr_distances_kernel<V>(set), block,
+                           points, options));
+      json.add("kernel_specialized", type, bc,
+               time_kernel(kmn::simd::sqr_distances_kernel<V>(set, d),
+                           block, points, options));
+    }
+  }
+}
+
+// bench_searches: Times Lloyd assignment passes over float points
+//                 searching k centroids by brute force, then a k-d and
+//                 a ball tree built before each pass, as they would be,
+//                 to find where the trees start to pay off
+void bench_searches(auto const& policy,
+                    std::vector<size_type> const& dims,
+                    std::vector<size_type> const& ks,
+                    size_type n,
+                    bench_options const& options,
+                    json_writer& json)
+{
+  for(auto const d: dims) {
+    for(auto const k: ks) //
+    {
+      bench_case const bc{ .n = n, .dims = d, .k = k };
+      auto const data = make_blobs<float>(bc);
+      kmn::matrix_view<float> const points{ data.data(), n, d };
+      auto const seeds = kmn::seed_centroids<float>(
+      kmn::seq, kmn::hlpr::rows_of<float>(points), k,
+      { .method = kmn::seeding_method::uniform, .seed = bench_seed })
+      .first;
+      std::vector<size_type> out_indices(n);
+      kmn::flat_accumulator<float> acc(k, d);
+
+      auto const time_search = [&](auto& finder)
+      {
+        return time_repetitions(
+        options.repetitions, [] { },
+        [&]
+        {
+          finder.assign_rows(seeds.data());
+          (void)kmn::assign_and_accumulate_rows(policy, points,
+                                                out_indices, finder, acc);
+        });
+      };
+
+      kmn::simd::centroid_block<float> block(k, d);
+      json.add("search_brute_force", "float", bc, time_search(block));
+      for(auto const tree:
+          { kmn::centroid_tree::kd_tree, kmn::centroid_tree::ball_tree })
+      {
+        kmn::centroid_index<float> index(k, d, tree);
+        json.add(fmt::format("search_{}", kmn::to_string(tree)), "float",
+                 bc, time_search(index));
+      }
+    }
+  }
+}
+
+// bench_batch: Many problems of n points, as one k_means_batch call
+//              against a loop of k_means calls with the same seeds, under
+//              policy and then from 1 thread up to all hardware threads
+void bench_batch(auto const& policy,
+                 size_type problems,
+                 bench_options const& options,
+                 json_writer& json)
+{
+  bench_case const bc{ .n = 500, .dims = 4, .k = 8 };
+  auto const data = make_blobs<float>(
+  { .n = bc.n * problems, .dims = bc.dims, .k = bc.k });
+  std::span<float const> const values{ data };
+
+  kmn::problem_batch<float> batch(bc.dims);
+  batch.reserve(problems, bc.n * problems);
+  for(size_type p{}; p < problems; ++p) //
+  { batch.add(values.subspan(p * bc.n * bc.dims, bc.n * bc.dims), bc.k); }
+
+  std::vector<size_type> out_indices(bc.n);
+  auto const time_batch = [&](auto const& batch_policy,
+                              std::string_view suffix)
+  {
+    json.add(fmt::format("batch_loop{}", suffix), "float", bc,
+             time_repetitions(
+             options.repetitions, [] { },
+             [&]
+             {
+               for(size_type p{}; p < problems; ++p) //
+               {
+                 auto problem_options = run_options();
+                 problem_options.seeding.seed = bench_seed + p;
+                 (void)kmn::k_means(batch_policy, batch.problem(p),
+                                    out_indices, bc.k, problem_options);
+               }
+             }));
+    json.add(fmt::format("batch_k_means{}", suffix), "float", bc,
+             time_repetitions(options.repetitions, [] { },
+                              [&]
+                              {
+                                (void)kmn::k_means_batch(batch_policy,
+                                                         batch,
+                                                         run_options());
+                              }));
+  };
+  time_batch(policy, "");
+
+  for(auto const threads:
+      kmn::hlpr::scaling_thread_counts(kmn::parallel_policy{}.threads())) //
+  {
+    time_batch(kmn::parallel_policy{ threads },
+               fmt::format("_threads_{}", threads));
+  }
+}
+
+// write_trace: Runs k_means once over float blobs and writes the Chrome
+//              trace of its phases
+void write_trace(auto const& policy, bench_case const& bc,
+                 std::string const& path)
+{
+  auto const data = make_blobs<float>(bc);
+  kmn::matrix_view<float> const points{ data.data(), bc.n, bc.dims };
+  std::vector<size_type> out_indices(bc.n);
+  auto const result =
+  kmn::k_means(policy, points, out_indices, bc.k, run_options());
+  if(not result) return;
+
+  fmt::print(stderr, "trace n={} d={} k={}\n{}", bc.n, bc.dims, bc.k,
+             result->profile().summary());
+  auto file = fmt::output_file(path);
+  file.print("{}", result->profile().chrome_trace());
+}
+
+void run_all(auto const& policy,
+             std::string_view policy_name,
+             bench_options const& options)
+{
+  auto const ns = options.quick ? std::vector<size_type>{ 10'000 }
+                                : std::vector<size_type>{ 10'000, 100'000 };
+  auto const dims = options.quick ? std::vector<size_type>{ 2, 16 }
+                                  : std::vector<size_type>{ 2, 16, 64 };
+  auto const ks = options.quick ? std::vector<size_type>{ 8 }
+                                : std::vector<size_type>{ 8, 64 };
+
+  json_writer json{ options, policy_name };
+  for(auto const n: ns) {
+    for(auto const d: dims) {
+      for(auto const k: ks) //
+      {
+        bench_case const bc{ .n = n, .dims = d, .k = k };
+        fmt::print(stderr, "n={} d={} k={}\n", n, d, k);
+        bench_type<int>(policy, "int", bc, options, json);
+        bench_type<float>(policy, "float", bc, options, json);
+        bench_type<double>(policy, "double", bc, options, json);
+        bench_storages(policy, bc, options, json);
+      }
+    }
+  }
+  // Kernel calls are sequential whatever the policy
+  bench_kernels<float>("float", ks, ns.front(), options, json);
+  bench_kernels<double>("double", ks, ns.front(), options, json);
+  bench_searches(policy,
+                 options.quick ? std::vector<size_type>{ 2, 16 }
+                               : std::vector<size_type>{ 2, 4, 8, 16, 32,
+                                                         64 },
+                 options.quick ? std::vector<size_type>{ 64, 1024 }
+                               : std::vector<size_type>{ 64, 256, 1024,
+                                                         4096 },
+                 ns.front(), options, json);
+  bench_batch(policy, options.quick ? 1'000 : 10'000, options, json);
+
+  auto const report = json.finish();
+  if(options.output) {
+    auto file = fmt::output_file(*options.output);
+    file.print("{}", report);
+  } else {
+    fmt::print("{}", report);
+  }
+
+  if(options.trace) {
+    write_trace(policy, { .n = ns.back(), .dims = 16, .k = ks.back() },
+                *options.trace);
+  }
+}
+
+void print_usage()
+{
+  fmt::print(stderr, "usage: kmn_bench [--quick] [--repetitions 5] "
+                     "[--threads 0] [--output f.json] "
+                     "[--trace trace.json]\n");
+}
+
+auto run(std::span<char const* const> args) -> int
+{
+  bench_options options;
+  for(size_type i{ 1 }; i < args.size(); ++i) //
+  {
+    std::string_view const flag{ args[i] };
+    if(flag == "--quick") {
+      options.quick = true;
+    } else if(flag == "--repetitions" and i + 1 < args.size()) {
+      options.repetitions = std::max(std::stoul(args[++i]), 1UL);
+    } else if(flag == "--threads" and i + 1 < args.size()) {
+      options.threads = std::stoul(args[++i]);
+    } else if(flag == "--output" and i + 1 < args.size()) {
+      options.output = args[++i];
+    } else if(flag == "--trace" and i + 1 < args.size()) {
+      if(not kmn::hlpr::instrumented) {
+        fmt::print(stderr, "kmn_bench: --trace needs a build with "
+                           "KMN_INSTRUMENTATION=1\n");
+        return 1;
+      }
+      options.trace = args[++i];
+    } else {
+      return (print_usage(), 1);
+    }
+  }
+
+  if(options.threads) {
+    kmn::parallel_policy const policy{ *options.threads };
+    run_all(policy, fmt::format("par/{}", policy.threads()), options);
+  } else {
+    run_all(kmn::seq, "seq", options);
+  }
+  return 0;
+}
+
+} // namespace
+
+auto main(int argc, char const* argv[]) -> int
+{
+  try {
+    return run({ argv, static_cast<size_type>(argc) });
+  } catch(std::exception const& e) {
+    fmt::print(stderr, "kmn_bench: {}\n", e.what());
+    return 1;
+  }
+}
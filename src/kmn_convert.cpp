@@ -0,0 +1,253 @@
+#include <charconv>
+#include <fmt/core.h>
+#include <fmt/format.h> // fmt::join
+#include <fmt/os.h>
+#include <fstream>
+#include <kmn/Dataset_file.hpp>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// kmn_convert: Converts between CSV and kmn dataset files.
+//
+//   kmn_convert csv <in.csv> <out.kmnd> [--type f32] [--align 64]
+//                                       [--pad-rows] [--skip-header]
+//   kmn_convert export <in.kmnd> <out.csv>
+//   kmn_convert native <in.kmnd> <out.kmnd>
+//   kmn_convert info <in.kmnd>
+
+namespace {
+
+using kmn::size_type;
+
+struct csv_options
+{
+  kmn::element_type type{ kmn::element_type::f32 };
+  kmn::dataset_layout layout{};
+  bool skip_header{ false };
+};
+
+[[nodiscard]] auto parse_type(std::string_view name)
+-> std::optional<kmn::element_type>
+{
+  for(auto t = static_cast<int>(kmn::element_type::i8);
+      t <= static_cast<int>(kmn::element_type::f64); ++t)
+  {
+    auto const type = static_cast<kmn::element_type>(t);
+    if(kmn::to_string(type) == name) return type;
+  }
+  return std::nullopt;
+}
+
+[[nodiscard]] auto is_separator(char c) noexcept -> bool
+{ return c == ',' or c == ';' or c == ' ' or c == '\t' or c == '\r'; }
+
+// parse_row: Appends the values of a CSV line to row,
+//            returns false on a malformed value
+template<typename T>
+[[nodiscard]] auto parse_row(std::string_view line, std::vector<T>& row)
+-> bool
+{
+  auto const* it = line.data();
+  auto const* const end = line.data() + line.size();
+  while(it != end) //
+  {
+    if(is_separator(*it)) {
+      ++it;
+      continue;
+    }
+    T value{};
+    auto const [next, error] = std::from_chars(it, end, value);
+    if(error != std::errc{}) return false;
+    row.push_back(value);
+    it = next;
+  }
+  return true;
+}
+
+template<typename T>
+void csv_to_dataset(char const* in, char const* out,
+                    csv_options const& options)
+{
+  std::ifstream csv{ in };
+  if(not csv) throw kmn::dataset_error{ fmt::format("cannot open {}", in) };
+
+  std::optional<kmn::dataset_writer<T>> writer;
+  std::vector<T> row;
+  std::string line;
+  size_type line_number{};
+
+  if(options.skip_header) {
+    std::getline(csv, line);
+    ++line_number;
+  }
+
+  while(std::getline(csv, line)) //
+  {
+    ++line_number;
+    row.clear();
+    if(not parse_row(line, row)) {
+      throw kmn::dataset_error{ fmt::format(
+      "{}:{}: not a {} value", in, line_number, kmn::to_string(options.type)) };
+    }
+    if(row.empty()) continue;
+
+    // The first row sets the dimension
+    if(not writer) writer.emplace(out, row.size(), options.layout);
+    if(row.size() != writer->header().dims) {
+      throw kmn::dataset_error{ fmt::format("{}:{}: {} values instead of {}",
+                                            in, line_number, row.size(),
+                                            writer->header().dims) };
+    }
+    writer->write(row);
+  }
+
+  if(not writer) throw kmn::dataset_error{ fmt::format("{} is empty", in) };
+  writer->close();
+}
+
+template<typename T>
+void dataset_to_csv(char const* in, char const* out)
+{
+  kmn::mapped_dataset<T> const dataset{ in };
+  auto csv = fmt::output_file(out);
+
+  for(auto const row: dataset.view()) //
+  {
+    // Bytes are printed as numbers, not characters
+    if constexpr(sizeof(T) == 1) {
+      csv.print("{}\n", fmt::join(row | std::views::transform(
+                                   [](T v) { return static_cast<int>(v); }),
+                                   ","));
+    } else {
+      csv.print("{}\n", fmt::join(row, ","));
+    }
+  }
+}
+
+// to_native: Rewrites a dataset file in native byte order
+template<typename T>
+void to_native(char const* in, char const* out,
+               kmn::dataset_header const& header)
+{
+  using bits_t = std::conditional_t<
+  sizeof(T) == 1, std::uint8_t,
+  std::conditional_t<sizeof(T) == 2, std::uint16_t,
+                     std::conditional_t<sizeof(T) == 4, std::uint32_t,
+                                        std::uint64_t>>>;
+
+  std::ifstream file{ in, std::ios::binary };
+  file.seekg(static_cast<std::streamoff>(header.data_offset));
+
+  kmn::dataset_writer<T> writer{ out, header.dims,
+                                 { .alignment = header.alignment,
+                                   .pad_rows = header.stride != header.dims } };
+
+  auto const swap = header.byte_order != std::endian::native;
+  std::vector<bits_t> raw(header.stride);
+  std::vector<T> row(header.dims);
+
+  for(size_type r{}; r < header.rows; ++r) //
+  {
+    // The last row isn't padded
+    auto const count = r + 1 < header.rows ? header.stride : header.dims;
+    if(not file.read(reinterpret_cast<char*>(raw.data()), // NOLINT
+                     static_cast<std::streamsize>(count * sizeof(T))))
+    { throw kmn::dataset_error{ fmt::format("truncated dataset {}", in) }; }
+
+    for(size_type d{}; d < header.dims; ++d) //
+    { row[d] = std::bit_cast<T>(swap ? kmn::hlpr::byteswap(raw[d]) : raw[d]); }
+    writer.write(row);
+  }
+  writer.close();
+}
+
+void print_info(char const* path)
+{
+  auto const header = kmn::read_dataset_header(path);
+  fmt::print("{}: {} x {} {} values, stride {}, data at byte {}, "
+             "aligned to {}, {} endian\n",
+             path, header.rows, header.dims, kmn::to_string(header.type),
+             header.stride, header.data_offset, header.alignment,
+             header.byte_order == std::endian::little ? "little" : "big");
+}
+
+void print_usage()
+{
+  fmt::print(stderr,
+             "usage: kmn_convert csv <in.csv> <out.kmnd> [--type f32] "
+             "[--align 64] [--pad-rows] [--skip-header]\n"
+             "       kmn_convert export <in.kmnd> <out.csv>\n"
+             "       kmn_convert native <in.kmnd> <out.kmnd>\n"
+             "       kmn_convert info <in.kmnd>\n");
+}
+
+auto run(std::span<char const* const> args) -> int
+{
+  if(args.size() < 3) return (print_usage(), 1);
+  std::string_view const command{ args[1] };
+
+  if(command == "info") {
+    print_info(args[2]);
+    return 0;
+  }
+  if(args.size() < 4) return (print_usage(), 1);
+
+  if(command == "csv") {
+    csv_options options;
+    for(size_type i{ 4 }; i < args.size(); ++i) //
+    {
+      std::string_view const flag{ args[i] };
+      if(flag == "--pad-rows") {
+        options.layout.pad_rows = true;
+      } else if(flag == "--skip-header") {
+        options.skip_header = true;
+      } else if(flag == "--type" and i + 1 < args.size()) {
+        auto const type = parse_type(args[++i]);
+        if(not type) return (print_usage(), 1);
+        options.type = *type;
+      } else if(flag == "--align" and i + 1 < args.size()) {
+        options.layout.alignment = std::stoul(args[++i]);
+      } else {
+        return (print_usage(), 1);
+      }
+    }
+    kmn::with_element_type(options.type,
+                           [&]<typename T>(T)
+                           { csv_to_dataset<T>(args[2], args[3], options); });
+    return 0;
+  }
+
+  auto const header = kmn::read_dataset_header(args[2]);
+  if(command == "export") {
+    if(header.byte_order != std::endian::native) {
+      fmt::print(stderr, "run kmn_convert native on {} first\n", args[2]);
+      return 1;
+    }
+    kmn::with_element_type(header.type, [&]<typename T>(T)
+                           { dataset_to_csv<T>(args[2], args[3]); });
+    return 0;
+  }
+  if(command == "native") {
+    kmn::with_element_type(header.type, [&]<typename T>(T)
+                           { to_native<T>(args[2], args[3], header); });
+    return 0;
+  }
+  return (print_usage(), 1);
+}
+
+} // namespace
+
+auto main(int argc, char const* argv[]) -> int
+{
+  try {
+    return run({ argv, static_cast<size_type>(argc) });
+  } catch(std::exception const& e) {
+    fmt::print(stderr, "kmn_convert: {}\n", e.what());
+    return 1;
+  }
+}
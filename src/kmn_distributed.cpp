@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+#include <kmn/Distributed.hpp>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) or defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#error "kmn_distributed runs its workers as POSIX processes"
+#endif
+
+// kmn_distributed: Reference driver of the shard protocol of
+//                  kmn/Distributed.hpp. Forks one worker process per shard
+//                  of synthetic Gaussian blobs; every iteration, the
+//                  coordinator writes the centroids to each worker's pipe
+//                  and reads back its partial_stats blob. The result is
+//                  checked against a single-process k_means from the same
+//                  initial centroids: same iterations, cluster sizes and
+//                  ids, and centroids and inertia equal up to the rounding
+//                  of summing the shards in a different order.
+//
+//   kmn_distributed [points] [shards] [dims] [k]
+//
+// Exits with 1 if the results differ.
+
+namespace {
+
+using kmn::size_type;
+using value_t = float;
+
+constexpr std::uint64_t driver_seed = 42;
+
+// write_all, read_all: Moves size bytes over a pipe,
+//                      however many calls it takes
+void write_all(int fd, void const* data, size_type size)
+{
+  auto const* bytes = static_cast<char const*>(data);
+  while(size != 0) {
+    auto const written = ::write(fd, bytes, size);
+    if(written < 0 and errno == EINTR) continue;
+    if(written <= 0) throw std::runtime_error{ "pipe write failed" };
+    bytes += written;
+    size -= static_cast<size_type>(written);
+  }
+}
+
+void read_all(int fd, void* data, size_type size)
+{
+  auto* bytes = static_cast<char*>(data);
+  while(size != 0) {
+    auto const got = ::read(fd, bytes, size);
+    if(got < 0 and errno == EINTR) continue;
+    if(got <= 0) throw std::runtime_error{ "pipe read failed" };
+    bytes += got;
+    size -= static_cast<size_type>(got);
+  }
+}
+
+// Messages are a u64 byte count followed by the bytes
+void send(int fd, std::span<std::byte const> message)
+{
+  auto const size = std::uint64_t{ message.size() };
+  write_all(fd, &size, sizeof(size));
+  write_all(fd, message.data(), message.size());
+}
+
+[[nodiscard]] auto receive(int fd) -> std::vector<std::byte>
+{
+  std::uint64_t size{};
+  read_all(fd, &size, sizeof(size));
+  std::vector<std::byte> message(size);
+  read_all(fd, message.data(), message.size());
+  return message;
+}
+
+// worker: Answers each centroids message with the shard's stats, and the
+//         empty message that ends the run with the shard's final ids
+[[noreturn]] void worker(kmn::matrix_view<value_t> shard, int in, int out)
+{
+  std::vector<size_type> ids(shard.rows());
+  try {
+    for(auto message = receive(in); not message.empty();
+        message = receive(in))
+    {
+      std::vector<value_t> centroids(message.size() / sizeof(value_t));
+      std::memcpy(centroids.data(), message.data(), message.size());
+      auto const stats = kmn::local_step(
+      kmn::par, shard, ids, std::span<value_t const>{ centroids });
+      if(not stats) ::_exit(1);
+      send(out, stats->to_blob());
+    }
+    send(out, std::as_bytes(std::span{ ids }));
+  } catch(std::exception const&) {
+    ::_exit(1);
+  }
+  ::_exit(0);
+}
+
+// gaussian_blobs: n points of dims values around k random centers
+[[nodiscard]] auto gaussian_blobs(size_type n, size_type dims, size_type k)
+-> std::vector<value_t>
+{
+  std::mt19937_64 gen{ driver_seed };
+  std::uniform_real_distribution<value_t> center_dist{ -100.f, 100.f };
+  std::normal_distribution<value_t> noise{ 0.f, 5.f };
+
+  std::vector<value_t> centers(k * dims);
+  for(auto& coord: centers) coord = center_dist(gen);
+
+  std::vector<value_t> values(n * dims);
+  for(size_type i{}; i < n; ++i) //
+  {
+    for(size_type d{}; d < dims; ++d) //
+    { values[i * dims + d] = centers[(i % k) * dims + d] + noise(gen); }
+  }
+  return values;
+}
+
+auto run(size_type n, size_type n_shards, size_type dims, size_type k) -> int
+{
+  auto const values = gaussian_blobs(n, dims, k);
+  kmn::matrix_view<value_t> const points(values.data(), n, dims);
+  kmn::k_means_options const options{
+    .convergence = { .max_iterations = 100, .tolerance = 1e-4 }
+  };
+
+  // A real coordinator would seed from a sample gathered from the shards
+  auto const [seeds, seeding] = kmn::seed_centroids<value_t>(
+  kmn::par, kmn::hlpr::rows_of<value_t>(points), k,
+  { .seed = driver_seed });
+
+  // Shards of whole parallel blocks, so that each one is summed
+  // block by block as the single-process passes sum it
+  auto const blocks =
+  (n + kmn::hlpr::parallel_block_size - 1) / kmn::hlpr::parallel_block_size;
+  auto const shard_first = [&](size_type s)
+  {
+    return std::min(n, (blocks * s + n_shards - 1) / n_shards
+                       * kmn::hlpr::parallel_block_size);
+  };
+
+  struct shard_process
+  {
+    pid_t pid;
+    int to_worker;
+    int from_worker;
+    size_type first;
+    size_type last;
+  };
+  std::vector<shard_process> shards;
+  for(size_type s{}; s < n_shards; ++s) //
+  {
+    std::array<int, 2> down{};
+    std::array<int, 2> up{};
+    if(::pipe(down.data()) != 0 or ::pipe(up.data()) != 0)
+    { throw std::runtime_error{ "pipe failed" }; }
+
+    auto const first = shard_first(s);
+    auto const last = shard_first(s + 1);
+    auto const pid = ::fork();
+    if(pid < 0) throw std::runtime_error{ "fork failed" };
+    if(pid == 0) {
+      ::close(down[1]);
+      ::close(up[0]);
+      worker({ values.data() + first * dims, last - first, dims }, down[0],
+             up[1]);
+    }
+    ::close(down[0]);
+    ::close(up[1]);
+    shards.push_back({ pid, down[1], up[0], first, last });
+  }
+
+  using clock = std::chrono::steady_clock;
+  auto const start = clock::now();
+  size_type message_bytes{};
+
+  auto const distributed = kmn::run_distributed(
+  seeds, dims, options,
+  [&](std::span<value_t const> centroids)
+  {
+    for(auto const& shard: shards) //
+    { send(shard.to_worker, std::as_bytes(centroids)); }
+
+    std::vector<kmn::partial_stats<value_t>> stats;
+    for(auto const& shard: shards) //
+    {
+      auto const blob = receive(shard.from_worker);
+      message_bytes += blob.size();
+      auto shard_stats = kmn::partial_stats<value_t>::from_blob(blob);
+      if(not shard_stats) throw std::runtime_error{ "bad stats blob" };
+      stats.push_back(std::move(*shard_stats));
+    }
+    return stats;
+  });
+  std::chrono::duration<double> const elapsed = clock::now() - start;
+
+  // Gather the final ids, then let the workers exit
+  std::vector<size_type> ids(n);
+  for(auto const& shard: shards) //
+  {
+    send(shard.to_worker, {});
+    auto const shard_ids = receive(shard.from_worker);
+    std::memcpy(ids.data() + shard.first, shard_ids.data(),
+                shard_ids.size());
+    ::close(shard.to_worker);
+    ::close(shard.from_worker);
+  }
+  bool workers_ok{ true };
+  for(auto const& shard: shards) //
+  {
+    int status{};
+    ::waitpid(shard.pid, &status, 0);
+    workers_ok = workers_ok and WIFEXITED(status)
+                 and WEXITSTATUS(status) == 0;
+  }
+  if(not distributed or not workers_ok) {
+    fmt::print(stderr, "kmn_distributed: a worker failed\n");
+    return 1;
+  }
+
+  // Single-process run from the same centroids
+  std::vector<std::vector<value_t>> initial;
+  for(size_type c{}; c < k; ++c) //
+  {
+    initial.emplace_back(seeds.begin() + static_cast<std::ptrdiff_t>(c * dims),
+                         seeds.begin()
+                         + static_cast<std::ptrdiff_t>((c + 1) * dims));
+  }
+  std::vector<size_type> single_ids(n);
+  auto const single = kmn::k_means(kmn::par, points, single_ids, initial,
+                                   options);
+  if(not single) return 1;
+
+  double max_shift{};
+  for(size_type c{}; c < k; ++c) //
+  {
+    for(size_type d{}; d < dims; ++d) //
+    {
+      max_shift = std::max(
+      max_shift,
+      std::abs(static_cast<double>(distributed->centroids[c * dims + d])
+               - static_cast<double>(single->centroids()[c][d])));
+    }
+  }
+  auto const inertia_gap = std::abs(distributed->inertia - single->inertia())
+                           / std::max(single->inertia(), 1.0);
+
+  auto const same_iterations = distributed->convergence.iterations
+                               == single->convergence().iterations;
+  auto const same_sizes = distributed->cluster_sizes
+                          == single->cluster_sizes();
+  auto const same_ids = ids == single_ids;
+  auto const same_distances = distributed->convergence.distances
+                              == single->convergence().distances;
+  // float centroids, summed in double in another order
+  auto const close = max_shift <= 1e-4 and inertia_gap <= 1e-9;
+
+  fmt::print("{} points, {} dims, k = {}, {} shards\n", n, dims, k,
+             n_shards);
+  fmt::print("distributed: {} iterations in {:.3f} s, inertia {:.9g}, "
+             "{:.1f} stats bytes per shard and iteration\n",
+             distributed->convergence.iterations, elapsed.count(),
+             distributed->inertia,
+             static_cast<double>(message_bytes)
+             / static_cast<double>(n_shards
+                                   * distributed->convergence.iterations));
+  fmt::print("single:      {} iterations, inertia {:.9g}\n",
+             single->convergence().iterations, single->inertia());
+  fmt::print("iterations {}, cluster sizes {}, ids {}, distances {}, "
+             "max centroid gap {:.3g}, relative inertia gap {:.3g}\n",
+             same_iterations ? "match" : "DIFFER",
+             same_sizes ? "match" : "DIFFER", same_ids ? "match" : "DIFFER",
+             same_distances ? "match" : "DIFFER", max_shift, inertia_gap);
+
+  return same_iterations and same_sizes and same_ids and same_distances
+         and close
+         ? 0
+         : 1;
+}
+
+} // namespace
+
+auto main(int argc, char const* argv[]) -> int
+{
+  auto const arg = [&](int i, size_type fallback)
+  { return argc > i ? static_cast<size_type>(std::stoull(argv[i])) : fallback; };
+
+  try {
+    auto const n = arg(1, size_type{ 1 } << 18);
+    auto const n_shards = std::max(arg(2, 4), size_type{ 1 });
+    auto const dims = std::max(arg(3, 8), size_type{ 1 });
+    auto const k = std::max(arg(4, 16), size_type{ 2 });
+    if(n < k) throw std::invalid_argument{ "fewer points than clusters" };
+    return run(n, n_shards, dims, k);
+  } catch(std::exception const& e) {
+    fmt::print(stderr, "kmn_distributed: {}\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <kmn/Workspace.hpp>
+#include <new>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// kmn_workspace_check: Checks that a kmn::workspace stops allocating once
+//                      it has served its calls. Every call is run twice
+//                      in the same workspace, over DataPoints, a
+//                      matrix_view and a columns_view, with uniform and
+//                      k-means++ seeding, unweighted and weighted, and
+//                      the global operator new counts the allocations of
+//                      the second round, which must make none.
+//
+//   kmn_workspace_check [points] [k]
+//
+// Exits with 1 if the second round allocates.
+
+namespace {
+
+std::atomic<std::size_t> allocations{ 0 };
+
+// Out of line, so that GCC doesn't pair the free with a new expression
+[[gnu::noinline]] void release(void* p) noexcept { std::free(p); }
+
+} // namespace
+
+// Counting replacements of the global allocation functions
+auto operator new(std::size_t size) -> void*
+{
+  ++allocations;
+  if(auto* p = std::malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc{};
+}
+
+auto operator new(std::size_t size, std::align_val_t align) -> void*
+{
+  ++allocations;
+  auto const alignment = static_cast<std::size_t>(align);
+  auto const rounded = (size + alignment - 1) / alignment * alignment;
+  if(auto* p = std::aligned_alloc(alignment, rounded == 0 ? alignment
+                                                          : rounded))
+  { return p; }
+  throw std::bad_alloc{};
+}
+
+auto operator new[](std::size_t size) -> void*
+{ return ::operator new(size); }
+
+auto operator new[](std::size_t size, std::align_val_t align) -> void*
+{ return ::operator new(size, align); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete(void* p, std::size_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{ release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete[](void* p, std::size_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{ release(p); }
+
+namespace {
+
+using kmn::size_type;
+using value_t = float;
+
+constexpr size_type dims = 4;
+constexpr std::uint64_t check_seed = 42;
+
+// gaussian_blobs: n points of dims values around k random centers
+[[nodiscard]] auto gaussian_blobs(size_type n, size_type k)
+-> std::vector<value_t>
+{
+  std::mt19937_64 gen{ check_seed };
+  std::uniform_real_distribution<value_t> center_dist{ -100.f, 100.f };
+  std::normal_distribution<value_t> noise{ 0.f, 5.f };
+
+  std::vector<value_t> centers(k * dims);
+  for(auto& coord: centers) coord = center_dist(gen);
+
+  std::vector<value_t> values(n * dims);
+  for(size_type i{}; i < n; ++i) //
+  {
+    for(size_type d{}; d < dims; ++d) //
+    { values[i * dims + d] = centers[(i % k) * dims + d] + noise(gen); }
+  }
+  return values;
+}
+
+auto run(size_type n, size_type k) -> int
+{
+  if constexpr(kmn::hlpr::instrumented) {
+    fmt::print("instrumented builds allocate every run's profile, "
+               "nothing to check\n");
+    return 0;
+  }
+
+  auto const values = gaussian_blobs(n, k);
+  std::vector<kmn::DataPoint<value_t, dims>> data_points(n);
+  std::vector<std::vector<value_t>> columns(dims, std::vector<value_t>(n));
+  for(size_type i{}; i < n; ++i) //
+  {
+    for(size_type d{}; d < dims; ++d) //
+    {
+      data_points[i][d] = values[i * dims + d];
+      columns[d][i] = values[i * dims + d];
+    }
+  }
+  std::array<value_t const*, dims> column_ptrs{};
+  for(size_type d{}; d < dims; ++d) column_ptrs[d] = columns[d].data();
+
+  kmn::matrix_view<value_t> const rows_view{ values.data(), n, dims };
+  kmn::columns_view<value_t> const columns_view{ column_ptrs, n };
+  std::vector<double> weights(n);
+  for(size_type i{}; i < n; ++i) weights[i] = 1.0 + static_cast<double>(i % 3);
+
+  std::vector<size_type> out_indices(n);
+  kmn::workspace<value_t> ws;
+
+  struct call
+  {
+    std::string name;
+    kmn::k_means_options options;
+  };
+  std::vector<call> calls;
+  for(auto const method: { kmn::seeding_method::uniform,
+                           kmn::seeding_method::k_means_plus_plus })
+  {
+    for(auto const weighted: { false, true }) //
+    {
+      calls.push_back(
+      { fmt::format("{}{}", kmn::to_string(method),
+                    weighted ? ", weighted" : ""),
+        { .convergence = { .max_iterations = 50, .tolerance = 1e-4 },
+          .seeding = { .method = method, .seed = check_seed },
+          .weights = weighted ? std::span<double const>{ weights }
+                              : std::span<double const>{} } });
+    }
+  }
+
+  // One round runs every call over every input, and counts
+  // the allocations of each
+  auto const round = [&](auto&& report)
+  {
+    for(auto const& [name, options]: calls) //
+    {
+      auto const before = allocations.load();
+      auto const over_points = ws.run(data_points, out_indices, k, options);
+      auto const over_rows = ws.run(rows_view, out_indices, k, options);
+      auto const over_columns =
+      ws.run(columns_view, out_indices, k, options);
+      auto const count = allocations.load() - before;
+      if(not over_points or not over_rows or not over_columns) return false;
+      report(name, count);
+    }
+    return true;
+  };
+
+  if(not round([](auto const&, size_type) { })) return 1;
+
+  bool none{ true };
+  std::vector<std::pair<std::string, size_type>> counts;
+  counts.reserve(calls.size());
+  if(not round([&](auto const& name, size_type count)
+               {
+                 counts.emplace_back(name, count);
+                 none = none and count == 0;
+               }))
+  { return 1; }
+
+  fmt::print("{} points, {} dims, k = {}\n", n, dims, k);
+  for(auto const& [name, count]: counts) //
+  { fmt::print("{:<22} {} allocations\n", name, count); }
+  fmt::print("steady-state runs {}\n", none ? "allocate nothing"
+                                            : "ALLOCATE");
+  return none ? 0 : 1;
+}
+
+} // namespace
+
+auto main(int argc, char const* argv[]) -> int
+{
+  auto const arg = [&](int i, size_type fallback)
+  { return argc > i ? static_cast<size_type>(std::stoull(argv[i])) : fallback; };
+
+  try {
+    auto const n = arg(1, 2'000);
+    auto const k = std::max(arg(2, 8), size_type{ 2 });
+    if(n < k) throw std::invalid_argument{ "fewer points than clusters" };
+    return run(n, k);
+  } catch(std::exception const& e) {
+    fmt::print(stderr, "kmn_workspace_check: {}\n", e.what());
+    return 1;
+  }
+}
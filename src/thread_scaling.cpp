@@ -0,0 +1,68 @@
+#include <chrono>
+#include <kmn/K_means.hpp>
+#include <random>
+#include <stdexcept>
+
+// Times the parallel Lloyd passes of k_means from 1 up to all hardware
+// threads over the same synthetic dataset and reports the speedup
+auto main(int argc, char** argv) -> int
+{
+  using kmn::DataPoint, kmn::size_type;
+  using point_t = DataPoint<float, 8>;
+
+  auto n_points = size_type{ 1 } << 20;
+  if(argc > 1) {
+    try {
+      n_points = static_cast<size_type>(std::stoull(argv[1]));
+    } catch(std::logic_error const&) {
+      fmt::print(stderr, "usage: thread_scaling [points]\n");
+      return 1;
+    }
+  }
+  size_type const k{ 16 };
+  size_type const n{ 20 };
+
+  // Gaussian blobs around k random centers
+  std::mt19937 gen{ 42 };
+  std::uniform_real_distribution<float> center_dist{ -100.f, 100.f };
+  std::normal_distribution<float> noise{ 0.f, 5.f };
+
+  std::vector<point_t> centers(k);
+  for(auto& c: centers)
+    for(size_type d{}; d < c.size(); ++d) c[d] = center_dist(gen);
+
+  std::vector<point_t> points(n_points);
+  for(size_type i{}; auto& pt: points) {
+    auto const& c = centers[i++ % k];
+    for(size_type d{}; d < pt.size(); ++d) pt[d] = c[d] + noise(gen);
+  }
+
+  std::vector<size_type> out_indices(n_points);
+
+  // All hardware threads
+  auto const max_threads = kmn::parallel_policy{}.threads();
+
+  fmt::print("{:>8} {:>12} {:>10}\n", "threads", "ms/iter", "speedup");
+
+  double baseline_ms{};
+  for(auto const threads: kmn::hlpr::scaling_thread_counts(max_threads)) //
+  {
+    using clock = std::chrono::steady_clock;
+    auto const start = clock::now();
+
+    auto const result = kmn::k_means(kmn::parallel_policy{ threads }, //
+                                     points, out_indices, k, n);
+    if(not result) return 1;
+
+    std::chrono::duration<double, std::milli> const elapsed =
+    clock::now() - start;
+    auto const ms_per_iter =
+    elapsed.count() / static_cast<double>(result->convergence().iterations);
+
+    if(threads == 1) baseline_ms = ms_per_iter;
+    fmt::print("{:>8} {:>12.3f} {:>10.2f}\n", //
+               threads, ms_per_iter, baseline_ms / ms_per_iter);
+  }
+
+  return 0;
+}